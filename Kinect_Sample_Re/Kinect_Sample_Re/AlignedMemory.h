@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdlib.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// cache-line alignment for buffers touched by SIMD kernels
+const size_t CACHE_LINE_SIZE = 64;
+
+// counts toward HeapAllocationCount() (FrameArena.cpp)
+void CountHeapAllocation();
+
+inline void* AlignedAlloc(size_t nSize, size_t nAlignment = CACHE_LINE_SIZE)
+{
+	CountHeapAllocation();
+#ifdef _WIN32
+	return _aligned_malloc(nSize, nAlignment);
+#else
+	void* p = NULL;
+	if (posix_memalign(&p, nAlignment, nSize) != 0)
+		return NULL;
+	return p;
+#endif
+}
+
+inline void AlignedFree(void* p)
+{
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+template<class T>
+inline T* AlignedAllocArray(size_t nCount)
+{
+	return static_cast<T*>(AlignedAlloc(sizeof(T)* nCount));
+}
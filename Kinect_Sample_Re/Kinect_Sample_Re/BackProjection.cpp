@@ -0,0 +1,319 @@
+#include "BackProjection.h"
+#include "CpuFeatures.h"
+#include "AlignedMemory.h"
+
+#ifdef KINECT_X86
+#include <emmintrin.h>
+#endif
+
+ColorRayTable::ColorRayTable() :
+nWidth(0),
+nHeight(0),
+pRayX(NULL),
+pRayY(NULL)
+{
+}
+
+ColorRayTable::~ColorRayTable()
+{
+	if (pRayX != NULL)	delete[] pRayX;
+	if (pRayY != NULL)	delete[] pRayY;
+}
+
+void ColorRayTable::Initialize(const SensorIntrinsics& intrinsics, int nWidth, int nHeight)
+{
+	if (pRayX != NULL)	delete[] pRayX;
+	if (pRayY != NULL)	delete[] pRayY;
+
+	this->nWidth = nWidth;
+	this->nHeight = nHeight;
+	pRayX = new float[nWidth];
+	pRayY = new float[nHeight];
+
+	for (int cc = 0; cc < nWidth; cc++)
+		pRayX[cc] = (cc - intrinsics.fColorPrincipalX) / intrinsics.fColorFocalX;
+	for (int rr = 0; rr < nHeight; rr++)
+		pRayY[rr] = -(rr - intrinsics.fColorPrincipalY) / intrinsics.fColorFocalY;
+}
+
+DepthRayTable::DepthRayTable() :
+nWidth(0),
+nHeight(0),
+pRayX(NULL),
+pRayY(NULL)
+{
+}
+
+DepthRayTable::~DepthRayTable()
+{
+	AlignedFree(pRayX);
+	AlignedFree(pRayY);
+}
+
+void DepthRayTable::Allocate(int nWidth, int nHeight)
+{
+	AlignedFree(pRayX);
+	AlignedFree(pRayY);
+
+	this->nWidth = nWidth;
+	this->nHeight = nHeight;
+	pRayX = AlignedAllocArray<float>(nWidth * nHeight);
+	pRayY = AlignedAllocArray<float>(nWidth * nHeight);
+}
+
+void DepthRayTable::Initialize(const PointF* pTableEntries, int nWidth, int nHeight)
+{
+	Allocate(nWidth, nHeight);
+
+	for (int ii = 0; ii < nWidth * nHeight; ii++)
+	{
+		pRayX[ii] = pTableEntries[ii].X;
+		pRayY[ii] = pTableEntries[ii].Y;
+	}
+}
+
+void DepthRayTable::Initialize(const SensorIntrinsics& intrinsics, int nWidth, int nHeight)
+{
+	Allocate(nWidth, nHeight);
+
+	for (int rr = 0; rr < nHeight; rr++)
+	{
+		for (int cc = 0; cc < nWidth; cc++)
+		{
+			pRayX[rr * nWidth + cc] = (cc - intrinsics.fDepthPrincipalX) / intrinsics.fDepthFocalX;
+			pRayY[rr * nWidth + cc] = -(rr - intrinsics.fDepthPrincipalY) / intrinsics.fDepthFocalY;
+		}
+	}
+}
+
+static const unsigned int nOpaque = 0xff000000;
+
+static void BackProjectRange_Scalar(
+	const float* pRayX,
+	float fRayY,
+	const CameraSpacePoint* pSrc,
+	const RGBQUAD* pColorSrc,
+	int nRowOffset,
+	int nBegin, int nEnd,
+	PointCloud& cloud)
+{
+	PointList& valid = cloud.valid;
+	const unsigned int* pColorRow = reinterpret_cast<const unsigned int*>(pColorSrc + nRowOffset);
+
+	for (int cc = nBegin; cc < nEnd; cc++)
+	{
+		const int idx = nRowOffset + cc;
+		const float Z = pSrc[cc].Z;
+		const unsigned int color = pColorRow[cc] | nOpaque;
+		cloud.pColor[idx] = color;
+
+		if (Z > 0)
+		{
+			const float X = pRayX[cc] * Z;
+			const float Y = fRayY * Z;
+			cloud.pX[idx] = X;
+			cloud.pY[idx] = Y;
+			cloud.pZ[idx] = Z;
+
+			const int nValid = valid.nCount++;
+			valid.pX[nValid] = X;
+			valid.pY[nValid] = Y;
+			valid.pZ[nValid] = Z;
+			valid.pColor[nValid] = color;
+			valid.pIndex[nValid] = idx;
+		}
+		else
+		{
+			cloud.pX[idx] = 0;
+			cloud.pY[idx] = 0;
+			cloud.pZ[idx] = 0;
+		}
+	}
+}
+
+void BackProjectColorFrame(
+	const ColorRayTable& rays,
+	const CameraSpacePoint* pCameraSpacePoints,
+	const RGBQUAD* pColorSrc,
+	PointCloud& cloud)
+{
+	const int nWidth = rays.nWidth;
+	PointList& valid = cloud.valid;
+	valid.nCount = 0;
+	cloud.extent = PixelRect::Full(rays.nWidth, rays.nHeight);
+
+	for (int rr = 0; rr < rays.nHeight; rr++)
+	{
+		const int nRowOffset = rr * nWidth;
+		const CameraSpacePoint* pSrcRow = pCameraSpacePoints + nRowOffset;
+		int cc = 0;
+
+#ifdef KINECT_X86
+		// 4 points per iteration: gather the Z of 4 packed X,Y,Z triples,
+		// scale the rays, store the planes and append the valid lanes
+		const __m128 rayY = _mm_set1_ps(rays.pRayY[rr]);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128i opaque = _mm_set1_epi32((int)nOpaque);
+		const __m128i laneIndex = _mm_set_epi32(3, 2, 1, 0);
+		const float* pSrc = &pSrcRow[0].X;
+		for (; cc + 4 <= nWidth; cc += 4, pSrc += 12)
+		{
+			const int idx = nRowOffset + cc;
+			const __m128 a = _mm_loadu_ps(pSrc);		// x0 y0 z0 x1
+			const __m128 b = _mm_loadu_ps(pSrc + 4);	// y1 z1 x2 y2
+			const __m128 c = _mm_loadu_ps(pSrc + 8);	// z2 x3 y3 z3
+
+			__m128 Z = _mm_shuffle_ps(
+				_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)),
+				_mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)),
+				_MM_SHUFFLE(2, 0, 2, 0));
+			const __m128 mask = _mm_cmpgt_ps(Z, zero);
+			Z = _mm_and_ps(Z, mask);
+			const __m128 X = _mm_mul_ps(_mm_loadu_ps(rays.pRayX + cc), Z);
+			const __m128 Y = _mm_mul_ps(rayY, Z);
+			const __m128i color = _mm_or_si128(
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(pColorSrc + idx)), opaque);
+
+			_mm_storeu_ps(cloud.pX + idx, X);
+			_mm_storeu_ps(cloud.pY + idx, Y);
+			_mm_storeu_ps(cloud.pZ + idx, Z);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(cloud.pColor + idx), color);
+
+			const int nMask = _mm_movemask_ps(mask);
+			if (nMask == 0)
+				continue;
+
+			const int nValid = valid.nCount;
+			if (nMask == 0xf)
+			{
+				_mm_storeu_ps(valid.pX + nValid, X);
+				_mm_storeu_ps(valid.pY + nValid, Y);
+				_mm_storeu_ps(valid.pZ + nValid, Z);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(valid.pColor + nValid), color);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(valid.pIndex + nValid),
+					_mm_add_epi32(_mm_set1_epi32(idx), laneIndex));
+				valid.nCount += 4;
+			}
+			else
+			{
+				for (int kk = 0; kk < 4; kk++)
+				if (nMask & (1 << kk))
+				{
+					const int nOut = valid.nCount++;
+					valid.pX[nOut] = cloud.pX[idx + kk];
+					valid.pY[nOut] = cloud.pY[idx + kk];
+					valid.pZ[nOut] = cloud.pZ[idx + kk];
+					valid.pColor[nOut] = cloud.pColor[idx + kk];
+					valid.pIndex[nOut] = idx + kk;
+				}
+			}
+		}
+#endif
+
+		BackProjectRange_Scalar(rays.pRayX, rays.pRayY[rr], pSrcRow, pColorSrc, nRowOffset, cc, nWidth, cloud);
+	}
+}
+
+static void BackProjectDepthRange(
+	const DepthRayTable& rays,
+	const UINT16* pDepth,
+	const ColorSpacePoint* pColorSpacePoints,
+	const unsigned int* pColor,
+	int nColorWidth, int nColorHeight,
+	int nBegin, int nEnd,
+	PointCloud& cloud)
+{
+	PointList& valid = cloud.valid;
+
+	for (int idx = nBegin; idx < nEnd; idx++)
+	{
+		// nearest color pixel; unmapped (-inf) positions fail the range test
+		const float fU = pColorSpacePoints[idx].X + 0.5f;
+		const float fV = pColorSpacePoints[idx].Y + 0.5f;
+		const bool bInView = pDepth[idx] != 0 &&
+			fU >= 0 && fU < (float)nColorWidth && fV >= 0 && fV < (float)nColorHeight;
+
+		if (!bInView)
+		{
+			cloud.pX[idx] = 0;
+			cloud.pY[idx] = 0;
+			cloud.pZ[idx] = 0;
+			cloud.pColor[idx] = 0;
+			continue;
+		}
+
+		const float Z = pDepth[idx] * 0.001f;
+		const float X = rays.pRayX[idx] * Z;
+		const float Y = rays.pRayY[idx] * Z;
+		const unsigned int color = pColor[(int)fV * nColorWidth + (int)fU] | nOpaque;
+		cloud.pX[idx] = X;
+		cloud.pY[idx] = Y;
+		cloud.pZ[idx] = Z;
+		cloud.pColor[idx] = color;
+
+		const int nValid = valid.nCount++;
+		valid.pX[nValid] = X;
+		valid.pY[nValid] = Y;
+		valid.pZ[nValid] = Z;
+		valid.pColor[nValid] = color;
+		valid.pIndex[nValid] = idx;
+	}
+}
+
+void BackProjectDepthFrame(
+	const DepthRayTable& rays,
+	const UINT16* pDepth,
+	const ColorSpacePoint* pColorSpacePoints,
+	const RGBQUAD* pColorSrc,
+	int nColorWidth, int nColorHeight,
+	PointCloud& cloud)
+{
+	BackProjectDepthRect(rays, pDepth, pColorSpacePoints, pColorSrc, nColorWidth, nColorHeight,
+		PixelRect::Full(rays.nWidth, rays.nHeight), cloud);
+}
+
+void BackProjectDepthRect(
+	const DepthRayTable& rays,
+	const UINT16* pDepth,
+	const ColorSpacePoint* pColorSpacePoints,
+	const RGBQUAD* pColorSrc,
+	int nColorWidth, int nColorHeight,
+	const PixelRect& rect,
+	PointCloud& cloud)
+{
+	const unsigned int* pColor = reinterpret_cast<const unsigned int*>(pColorSrc);
+	cloud.valid.nCount = 0;
+
+	// the rect gets rewritten below; what lies outside it must be cleared
+	if (!rect.Contains(cloud.extent))
+		cloud.ClearRect(cloud.extent);
+	cloud.extent = rect;
+
+	for (int rr = rect.nTop; rr < rect.nBottom; rr++)
+	{
+		const int nRowOffset = rr * rays.nWidth;
+		BackProjectDepthRange(rays, pDepth, pColorSpacePoints, pColor, nColorWidth, nColorHeight,
+			nRowOffset + rect.nLeft, nRowOffset + rect.nRight, cloud);
+	}
+}
+
+void RegisterColorToDepth(
+	const UINT16* pDepth,
+	const ColorSpacePoint* pColorSpacePoints,
+	int nCount,
+	const RGBQUAD* pColorSrc,
+	int nColorWidth, int nColorHeight,
+	unsigned int* pRegisteredColor)
+{
+	const unsigned int* pColor = reinterpret_cast<const unsigned int*>(pColorSrc);
+
+	for (int idx = 0; idx < nCount; idx++)
+	{
+		const float fU = pColorSpacePoints[idx].X + 0.5f;
+		const float fV = pColorSpacePoints[idx].Y + 0.5f;
+		if (pDepth[idx] != 0 && fU >= 0 && fU < (float)nColorWidth && fV >= 0 && fV < (float)nColorHeight)
+			pRegisteredColor[idx] = pColor[(int)fV * nColorWidth + (int)fU] | nOpaque;
+		else
+			pRegisteredColor[idx] = 0;
+	}
+}
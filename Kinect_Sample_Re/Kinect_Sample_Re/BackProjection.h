@@ -0,0 +1,95 @@
+#pragma once
+
+#include "KinectCompat.h"
+#include "SoftwareMapper.h"
+#include "PointCloud.h"
+
+// Per-column and per-row ray slopes of the color camera, so back-projection
+// is X = pRayX[col] * Z, Y = pRayY[row] * Z with no divides per pixel.
+class ColorRayTable
+{
+public:
+	ColorRayTable();
+	~ColorRayTable();
+
+	void Initialize(const SensorIntrinsics& intrinsics, int nWidth, int nHeight);
+
+	int nWidth;
+	int nHeight;
+	float* pRayX;
+	float* pRayY;
+
+private:
+	ColorRayTable(const ColorRayTable&);
+	ColorRayTable& operator=(const ColorRayTable&);
+};
+
+// Ray slopes of every depth pixel (the depth camera has lens distortion, so
+// they do not separate into rows and columns): X = pRayX[i] * Z, Y = pRayY[i] * Z.
+class DepthRayTable
+{
+public:
+	DepthRayTable();
+	~DepthRayTable();
+
+	// from the sensor's depth frame to camera space table
+	void Initialize(const PointF* pTableEntries, int nWidth, int nHeight);
+	// pinhole model only
+	void Initialize(const SensorIntrinsics& intrinsics, int nWidth, int nHeight);
+
+	int nWidth;
+	int nHeight;
+	float* pRayX;
+	float* pRayY;
+
+private:
+	void Allocate(int nWidth, int nHeight);
+
+	DepthRayTable(const DepthRayTable&);
+	DepthRayTable& operator=(const DepthRayTable&);
+};
+
+// Recomputes X and Y of every color pixel from the Z of pCameraSpacePoints
+// and fills the organized planes of cloud (color from pColorSrc, opaque).
+// Pixels with Z <= 0 (or not a number) get X = Y = Z = 0; all others are
+// also appended to cloud.valid.
+void BackProjectColorFrame(
+	const ColorRayTable& rays,
+	const CameraSpacePoint* pCameraSpacePoints,
+	const RGBQUAD* pColorSrc,
+	PointCloud& cloud);
+
+// Depth-resolution counterpart of BackProjectColorFrame: one point per depth
+// pixel [mm], colored by looking up pColorSpacePoints (depth to color
+// registration) in pColorSrc. Pixels with no depth or no color in view are
+// left out (X = Y = Z = 0).
+void BackProjectDepthFrame(
+	const DepthRayTable& rays,
+	const UINT16* pDepth,
+	const ColorSpacePoint* pColorSpacePoints,
+	const RGBQUAD* pColorSrc,
+	int nColorWidth, int nColorHeight,
+	PointCloud& cloud);
+
+// BackProjectDepthFrame over the pixels of rect only: cloud.valid gets the
+// points inside it and the organized planes are zero everywhere else. Only
+// what earlier calls left outside rect (cloud.extent) is cleared, so a small
+// rect costs little however large the frame is.
+void BackProjectDepthRect(
+	const DepthRayTable& rays,
+	const UINT16* pDepth,
+	const ColorSpacePoint* pColorSpacePoints,
+	const RGBQUAD* pColorSrc,
+	int nColorWidth, int nColorHeight,
+	const PixelRect& rect,
+	PointCloud& cloud);
+
+// Color of every depth pixel through depth to color registration, packed
+// RGBA; 0 where there is no depth or the pixel is outside the color view.
+void RegisterColorToDepth(
+	const UINT16* pDepth,
+	const ColorSpacePoint* pColorSpacePoints,
+	int nCount,
+	const RGBQUAD* pColorSrc,
+	int nColorWidth, int nColorHeight,
+	unsigned int* pRegisteredColor);
@@ -0,0 +1,54 @@
+#include <chrono>
+#include "CaptureThread.h"
+#include "KinectBasic.h"
+
+CaptureThread::CaptureThread(KinectBasic& kinect) :
+kinect(kinect),
+bRunning(false)
+{
+}
+
+CaptureThread::~CaptureThread()
+{
+	Stop();
+}
+
+void CaptureThread::Start()
+{
+	if (bRunning)
+		return;
+
+	bRunning = true;
+	thread = std::thread(&CaptureThread::Run, this);
+}
+
+void CaptureThread::Stop()
+{
+	bRunning = false;
+	if (thread.joinable())
+		thread.join();
+}
+
+bool CaptureThread::IsRunning() const
+{
+	return bRunning;
+}
+
+void CaptureThread::Run()
+{
+	while (bRunning)
+	{
+		// sleep until the source signals a frame; the timeout bounds how
+		// long Stop() can take
+		HRESULT hr = kinect.WaitForFrame(100);
+		if (hr == E_PENDING)
+			continue;
+
+		if (SUCCEEDED(hr))
+			hr = kinect.Update();
+
+		// a source that failed would otherwise be retried in a spin
+		if (FAILED(hr) && hr != E_PENDING)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+}
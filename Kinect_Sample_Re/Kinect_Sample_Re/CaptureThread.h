@@ -0,0 +1,29 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+class KinectBasic;
+
+// runs KinectBasic::Update() (acquire + ProcessFrame) off the GLUT thread;
+// finished frames reach the renderer through KinectBasic::frames
+class CaptureThread
+{
+public:
+	CaptureThread(KinectBasic& kinect);
+	~CaptureThread();
+
+	void Start();
+	void Stop();
+	bool IsRunning() const;
+
+private:
+	void Run();
+
+	CaptureThread(const CaptureThread&);
+	CaptureThread& operator=(const CaptureThread&);
+
+	KinectBasic& kinect;
+	std::thread thread;
+	std::atomic<bool> bRunning;
+};
@@ -0,0 +1,39 @@
+#include <string.h>
+#include "CloudMerge.h"
+#include "ParallelFor.h"
+
+void MergeClouds(const PointList* const* ppClouds, const RigidTransform* pTransforms, int nClouds, PointList& merged)
+{
+	int nTotal = 0;
+	for (int cc = 0; cc < nClouds; cc++)
+		nTotal += ppClouds[cc]->nCount;
+
+	if (merged.nCapacity < nTotal)
+		merged.Allocate(nTotal + nTotal / 2);
+	merged.nCount = nTotal;
+
+	// every cloud into its own range of merged, split over the threads
+	int nOffset = 0;
+	for (int cc = 0; cc < nClouds; cc++)
+	{
+		const PointList& cloud = *ppClouds[cc];
+		const RigidTransform T = pTransforms[cc];
+		float* pX = merged.pX + nOffset;
+		float* pY = merged.pY + nOffset;
+		float* pZ = merged.pZ + nOffset;
+		unsigned int* pColor = merged.pColor + nOffset;
+		int* pIndex = merged.pIndex + nOffset;
+
+		ParallelFor(cloud.nCount, [&](int nBegin, int nEnd)
+		{
+			for (int ii = nBegin; ii < nEnd; ii++)
+				T.Apply(cloud.pX[ii], cloud.pY[ii], cloud.pZ[ii], pX[ii], pY[ii], pZ[ii]);
+
+			memcpy(pColor + nBegin, cloud.pColor + nBegin, sizeof(unsigned int)* (nEnd - nBegin));
+			for (int ii = nBegin; ii < nEnd; ii++)
+				pIndex[ii] = -1;
+		});
+
+		nOffset += cloud.nCount;
+	}
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "PointCloud.h"
+#include "RigidTransform.h"
+
+// Concatenates nClouds point lists into merged, moving the points of cloud
+// cc by pTransforms[cc] (e.g. into the world frame of a rig of sensors).
+// Colors are kept; the merged points have no pixel (pIndex -1). merged only
+// grows, with headroom, so steady frames do not allocate.
+void MergeClouds(const PointList* const* ppClouds, const RigidTransform* pTransforms, int nClouds, PointList& merged);
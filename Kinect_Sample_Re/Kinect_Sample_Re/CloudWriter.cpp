@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <string.h>
+#include "CloudWriter.h"
+
+// points are serialized into this much memory per fwrite
+static const size_t nStagingSize = 4 << 20;
+
+CloudWriter::CloudWriter() :
+bStopping(false),
+pStaging(NULL)
+{
+	for (int ii = 0; ii < nSnapshots; ii++)
+		freeSnapshots.push_back(&snapshots[ii]);
+}
+
+CloudWriter::~CloudWriter()
+{
+	Stop();
+	if (pStaging != NULL)	delete[] pStaging;
+}
+
+PointList* CloudWriter::AcquireSnapshot()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (freeSnapshots.empty())
+		return NULL;
+	PointList* pSnapshot = freeSnapshots.front();
+	freeSnapshots.pop_front();
+
+	// started on first use
+	if (!thread.joinable())
+	{
+		bStopping = false;
+		thread = std::thread(&CloudWriter::Run, this);
+	}
+	return pSnapshot;
+}
+
+bool CloudWriter::Save(const PointList& points, const char* szPath, CloudFileFormat format, const GridMesh* pMesh)
+{
+	PointList* pSnapshot = AcquireSnapshot();
+	if (pSnapshot == NULL)
+		return false;
+
+	// snapshots only grow, so this is a plain copy after the first save
+	if (pSnapshot->nCapacity < points.nCount)
+		pSnapshot->Allocate(points.nCount);
+	pSnapshot->nCount = points.nCount;
+	memcpy(pSnapshot->pX, points.pX, sizeof(float)* points.nCount);
+	memcpy(pSnapshot->pY, points.pY, sizeof(float)* points.nCount);
+	memcpy(pSnapshot->pZ, points.pZ, sizeof(float)* points.nCount);
+	memcpy(pSnapshot->pColor, points.pColor, sizeof(unsigned int)* points.nCount);
+
+	Queue(pSnapshot, false, szPath, format, pMesh);
+	return true;
+}
+
+bool CloudWriter::Save(const CompactPointList& points, const char* szPath, CloudFileFormat format, const GridMesh* pMesh)
+{
+	PointList* pSnapshot = AcquireSnapshot();
+	if (pSnapshot == NULL)
+		return false;
+
+	CompactPointList& snapshot = compactSnapshots[pSnapshot - snapshots];
+	snapshot.Reserve(points.nCount);
+	snapshot.nCount = points.nCount;
+	memcpy(snapshot.pPoints, points.pPoints, sizeof(CompactPoint)* points.nCount);
+
+	Queue(pSnapshot, true, szPath, format, pMesh);
+	return true;
+}
+
+void CloudWriter::Queue(PointList* pSnapshot, bool bCompact, const char* szPath, CloudFileFormat format, const GridMesh* pMesh)
+{
+	// the strip is turned into triangles by the writer thread
+	GridMesh* pMeshSnapshot = &meshSnapshots[pSnapshot - snapshots];
+	pMeshSnapshot->strip.clear();
+	pMeshSnapshot->nTriangles = 0;
+	if (pMesh != NULL && format == CLOUD_FILE_PLY)
+	{
+		pMeshSnapshot->strip.assign(pMesh->strip.begin(), pMesh->strip.end());
+		pMeshSnapshot->nTriangles = pMesh->nTriangles;
+	}
+
+	Job job;
+	job.pPoints = pSnapshot;
+	job.bCompact = bCompact;
+	job.pMesh = pMeshSnapshot;
+	job.path = szPath;
+	job.format = format;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(job);
+	}
+	condition.notify_one();
+}
+
+void CloudWriter::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		bStopping = true;
+	}
+	condition.notify_one();
+
+	if (thread.joinable())
+		thread.join();
+}
+
+void CloudWriter::Run()
+{
+	for (;;)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (jobs.empty() && !bStopping)
+				condition.wait(lock);
+			if (jobs.empty())
+				return;
+			job = jobs.front();
+			jobs.pop_front();
+		}
+
+		const int nCount = job.bCompact ? compactSnapshots[job.pPoints - snapshots].nCount : job.pPoints->nCount;
+		if (Write(job))
+			printf("Saved %d points to %s\n", nCount, job.path.c_str());
+		else
+			printf("Failed to save %s\n", job.path.c_str());
+
+		std::lock_guard<std::mutex> lock(mutex);
+		freeSnapshots.push_back(job.pPoints);
+	}
+}
+
+bool CloudWriter::Write(const Job& job)
+{
+	const CompactPointList& compact = compactSnapshots[job.pPoints - snapshots];
+	const int nCount = job.bCompact ? compact.nCount : job.pPoints->nCount;
+
+	std::vector<unsigned int> triangles;
+	job.pMesh->Triangles(triangles);
+	const int nFaces = (int)(triangles.size() / 3);
+
+	FILE* pFile = fopen(job.path.c_str(), "wb");
+	if (pFile == NULL)
+		return false;
+
+	char szHeader[512];
+	size_t nRecordSize;
+	if (job.format == CLOUD_FILE_PLY)
+	{
+		sprintf(szHeader,
+			"ply\n"
+			"format binary_little_endian 1.0\n"
+			"element vertex %d\n"
+			"property float x\n"
+			"property float y\n"
+			"property float z\n"
+			"property uchar red\n"
+			"property uchar green\n"
+			"property uchar blue\n"
+			"element face %d\n"
+			"property list uchar int vertex_indices\n"
+			"end_header\n",
+			nCount, nFaces);
+		nRecordSize = 3 * sizeof(float) + 3;
+	}
+	else
+	{
+		sprintf(szHeader,
+			"# .PCD v0.7 - Point Cloud Data file format\n"
+			"VERSION 0.7\n"
+			"FIELDS x y z rgb\n"
+			"SIZE 4 4 4 4\n"
+			"TYPE F F F F\n"
+			"COUNT 1 1 1 1\n"
+			"WIDTH %d\n"
+			"HEIGHT 1\n"
+			"VIEWPOINT 0 0 0 1 0 0 0\n"
+			"POINTS %d\n"
+			"DATA binary\n",
+			nCount, nCount);
+		nRecordSize = 4 * sizeof(float);
+	}
+
+	bool bSucceeded = fwrite(szHeader, 1, strlen(szHeader), pFile) == strlen(szHeader);
+
+	if (pStaging == NULL)
+		pStaging = new char[nStagingSize];
+	const int nChunk = (int)(nStagingSize / nRecordSize);
+	if (job.bCompact && unpacked.nCapacity < nChunk)
+		unpacked.Allocate(nChunk);
+
+	// interleave a chunk of points into records, then write it in one go
+	for (int nBegin = 0; nBegin < nCount && bSucceeded; nBegin += nChunk)
+	{
+		const int nEnd = nBegin + nChunk < nCount ? nBegin + nChunk : nCount;
+
+		// the chunk as float planes, indexed from nBegin
+		const PointList* pPoints = job.pPoints;
+		int nFirst = nBegin;
+		if (job.bCompact)
+		{
+			UnpackPoints(compact.pPoints + nBegin, nEnd - nBegin, unpacked.pX, unpacked.pY, unpacked.pZ, unpacked.pColor);
+			pPoints = &unpacked;
+			nFirst = 0;
+		}
+		const float* pX = pPoints->pX + nFirst;
+		const float* pY = pPoints->pY + nFirst;
+		const float* pZ = pPoints->pZ + nFirst;
+		const unsigned int* pColor = pPoints->pColor + nFirst;
+
+		char* pRecord = pStaging;
+		for (int ii = 0; ii < nEnd - nBegin; ii++, pRecord += nRecordSize)
+		{
+			memcpy(pRecord, &pX[ii], sizeof(float));
+			memcpy(pRecord + 4, &pY[ii], sizeof(float));
+			memcpy(pRecord + 8, &pZ[ii], sizeof(float));
+
+			// colors are bytes R, G, B, A in memory
+			const unsigned int color = pColor[ii];
+			if (job.format == CLOUD_FILE_PLY)
+			{
+				memcpy(pRecord + 12, &color, 3);
+			}
+			else
+			{
+				// PCL packs rgb as 0x00RRGGBB in the bits of a float
+				const unsigned int rgb = ((color & 0xff) << 16) | (color & 0xff00) | ((color >> 16) & 0xff);
+				memcpy(pRecord + 12, &rgb, sizeof(unsigned int));
+			}
+		}
+
+		const size_t nBytes = (size_t)(nEnd - nBegin) * nRecordSize;
+		bSucceeded = fwrite(pStaging, 1, nBytes, pFile) == nBytes;
+	}
+
+	// faces as a vertex count and 3 indices each
+	const size_t nFaceSize = 1 + 3 * sizeof(int);
+	const int nFaceChunk = (int)(nStagingSize / nFaceSize);
+	for (int nBegin = 0; nBegin < nFaces && bSucceeded; nBegin += nFaceChunk)
+	{
+		const int nEnd = nBegin + nFaceChunk < nFaces ? nBegin + nFaceChunk : nFaces;
+		char* pRecord = pStaging;
+		for (int ff = nBegin; ff < nEnd; ff++, pRecord += nFaceSize)
+		{
+			pRecord[0] = 3;
+			memcpy(pRecord + 1, &triangles[ff * 3], 3 * sizeof(int));
+		}
+
+		const size_t nBytes = (size_t)(nEnd - nBegin) * nFaceSize;
+		bSucceeded = fwrite(pStaging, 1, nBytes, pFile) == nBytes;
+	}
+
+	if (fclose(pFile) != 0)
+		bSucceeded = false;
+
+	return bSucceeded;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <string>
+#include <vector>
+#include "PointCloud.h"
+#include "GridMesh.h"
+#include "CompactPoints.h"
+
+enum CloudFileFormat
+{
+	CLOUD_FILE_PLY,		// binary little endian PLY, float xyz + uchar rgb (+ faces)
+	CLOUD_FILE_PCD		// binary PCD, float xyz + packed rgb
+};
+
+// Saves point lists in the background. Save() only copies the points into
+// one of a few pooled snapshots and queues it; a writer thread serializes
+// the snapshot through a large staging buffer into sequential writes, so
+// the caller (the GLUT thread) never waits for the disk.
+class CloudWriter
+{
+public:
+	CloudWriter();
+	~CloudWriter();
+
+	// false when every snapshot is still queued or being written;
+	// pMesh (indexing points) is saved as PLY faces, PCD has no faces
+	bool Save(const PointList& points, const char* szPath, CloudFileFormat format, const GridMesh* pMesh = NULL);
+	// the snapshot stays compact, and is unpacked chunk by chunk as it is
+	// written; the files are the same as of the unpacked points
+	bool Save(const CompactPointList& points, const char* szPath, CloudFileFormat format, const GridMesh* pMesh = NULL);
+
+	// writes what is queued, then stops the writer thread
+	void Stop();
+
+private:
+	struct Job
+	{
+		PointList* pPoints;
+		// set when the points are in compactSnapshots instead
+		bool bCompact;
+		// empty when there is no mesh
+		GridMesh* pMesh;
+		std::string path;
+		CloudFileFormat format;
+	};
+
+	static const int nSnapshots = 2;
+
+	PointList* AcquireSnapshot();
+	void Queue(PointList* pSnapshot, bool bCompact, const char* szPath, CloudFileFormat format, const GridMesh* pMesh);
+	void Run();
+	bool Write(const Job& job);
+
+	CloudWriter(const CloudWriter&);
+	CloudWriter& operator=(const CloudWriter&);
+
+	PointList snapshots[nSnapshots];
+	GridMesh meshSnapshots[nSnapshots];
+	CompactPointList compactSnapshots[nSnapshots];
+	std::deque<PointList*> freeSnapshots;
+	std::deque<Job> jobs;
+
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::thread thread;
+	bool bStopping;
+
+	char* pStaging;
+	// a chunk of unpacked compact points
+	PointList unpacked;
+};
@@ -0,0 +1,195 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "CompactPoints.h"
+#include "AlignedMemory.h"
+#include "CpuFeatures.h"
+
+#ifdef KINECT_X86
+#include <emmintrin.h>
+#endif
+
+// rounds to nearest even like _mm_cvtps_epi32, so both paths agree
+static inline short Quantize(float f)
+{
+	const float fUnits = f * (1.0f / fCompactPointScale);
+	if (fUnits >= 32767.0f) return 32767;
+	if (fUnits <= -32768.0f) return -32768;
+	return (short)lrintf(fUnits);
+}
+
+CompactPointList::CompactPointList() :
+nCount(0),
+nCapacity(0),
+pPoints(NULL)
+{
+}
+
+CompactPointList::~CompactPointList()
+{
+	AlignedFree(pPoints);
+}
+
+void CompactPointList::Reserve(int nCapacity)
+{
+	if (nCapacity <= this->nCapacity)
+		return;
+
+	AlignedFree(pPoints);
+	this->nCapacity = nCapacity;
+	pPoints = AlignedAllocArray<CompactPoint>(nCapacity);
+}
+
+void PackPoints(const PointList& points, const int* pOrder, CompactPointList& out)
+{
+	// with headroom, as the count changes a little from frame to frame
+	if (out.nCapacity < points.nCount)
+		out.Reserve(points.nCount + points.nCount / 2);
+	out.nCount = points.nCount;
+	CompactPoint* pDst = out.pPoints;
+
+	if (pOrder != NULL)
+	{
+		for (int ii = 0; ii < points.nCount; ii++)
+		{
+			const int idx = pOrder[ii];
+			pDst[ii].X = Quantize(points.pX[idx]);
+			pDst[ii].Y = Quantize(points.pY[idx]);
+			pDst[ii].Z = Quantize(points.pZ[idx]);
+			pDst[ii].nPad = 0;
+			pDst[ii].color = points.pColor[idx];
+		}
+		return;
+	}
+
+	int ii = 0;
+
+#ifdef KINECT_X86
+	// 4 points make 3 dwords each: (X | Y << 16), (Z | 0), color. They are
+	// transposed into one 16-byte row per point and stored 12 bytes apart,
+	// every store spilling 4 bytes into the next record, which are written
+	// over right after; so the loop stops short of the last point.
+	const __m128 scale = _mm_set1_ps(1.0f / fCompactPointScale);
+	const __m128 unitsMax = _mm_set1_ps(32767.0f);
+	const __m128 unitsMin = _mm_set1_ps(-32768.0f);
+	const __m128i zero = _mm_setzero_si128();
+	for (; ii + 4 < points.nCount; ii += 4)
+	{
+		// saturate to 16 bits like Quantize (cvtps turns what is out of the
+		// 32-bit range into 0x80000000, which would pack to -32768), then
+		// round to nearest
+		const __m128i x = _mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(points.pX + ii), scale), unitsMax), unitsMin));
+		const __m128i y = _mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(points.pY + ii), scale), unitsMax), unitsMin));
+		const __m128i z = _mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(points.pZ + ii), scale), unitsMax), unitsMin));
+		const __m128i xy = _mm_unpacklo_epi16(_mm_packs_epi32(x, x), _mm_packs_epi32(y, y));
+		const __m128i z0 = _mm_unpacklo_epi16(_mm_packs_epi32(z, z), zero);
+
+		__m128 r0 = _mm_castsi128_ps(xy);
+		__m128 r1 = _mm_castsi128_ps(z0);
+		__m128 r2 = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(points.pColor + ii)));
+		__m128 r3 = _mm_setzero_ps();
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+		float* pOut = reinterpret_cast<float*>(pDst + ii);
+		_mm_storeu_ps(pOut, r0);
+		_mm_storeu_ps(pOut + 3, r1);
+		_mm_storeu_ps(pOut + 6, r2);
+		_mm_storeu_ps(pOut + 9, r3);
+	}
+#endif
+
+	for (; ii < points.nCount; ii++)
+	{
+		pDst[ii].X = Quantize(points.pX[ii]);
+		pDst[ii].Y = Quantize(points.pY[ii]);
+		pDst[ii].Z = Quantize(points.pZ[ii]);
+		pDst[ii].nPad = 0;
+		pDst[ii].color = points.pColor[ii];
+	}
+}
+
+void UnpackPoints(const CompactPoint* pSrc, int nCount, float* pX, float* pY, float* pZ, unsigned int* pColor)
+{
+	int ii = 0;
+
+#ifdef KINECT_X86
+	// 16-byte loads 12 bytes apart, the 4 extra bytes of the last one from
+	// the next record, so again the loop stops short of the last point
+	const __m128 scale = _mm_set1_ps(fCompactPointScale);
+	for (; ii + 4 < nCount; ii += 4)
+	{
+		const float* pIn = reinterpret_cast<const float*>(pSrc + ii);
+		__m128 r0 = _mm_loadu_ps(pIn);
+		__m128 r1 = _mm_loadu_ps(pIn + 3);
+		__m128 r2 = _mm_loadu_ps(pIn + 6);
+		__m128 r3 = _mm_loadu_ps(pIn + 9);
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+		// sign-extend the 16-bit halves
+		const __m128i xy = _mm_castps_si128(r0);
+		const __m128i z0 = _mm_castps_si128(r1);
+		const __m128i x = _mm_srai_epi32(_mm_slli_epi32(xy, 16), 16);
+		const __m128i y = _mm_srai_epi32(xy, 16);
+		const __m128i z = _mm_srai_epi32(_mm_slli_epi32(z0, 16), 16);
+
+		_mm_storeu_ps(pX + ii, _mm_mul_ps(_mm_cvtepi32_ps(x), scale));
+		_mm_storeu_ps(pY + ii, _mm_mul_ps(_mm_cvtepi32_ps(y), scale));
+		_mm_storeu_ps(pZ + ii, _mm_mul_ps(_mm_cvtepi32_ps(z), scale));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pColor + ii), _mm_castps_si128(r2));
+	}
+#endif
+
+	for (; ii < nCount; ii++)
+	{
+		pX[ii] = pSrc[ii].X * fCompactPointScale;
+		pY[ii] = pSrc[ii].Y * fCompactPointScale;
+		pZ[ii] = pSrc[ii].Z * fCompactPointScale;
+		pColor[ii] = pSrc[ii].color;
+	}
+}
+
+bool VerifyPackKernels(int nCount)
+{
+	PointList points;
+	points.Allocate(nCount);
+	points.nCount = nCount;
+	std::vector<int> order(nCount);
+
+	// millimeters and halfway between them, within and beyond the 16-bit
+	// range (+/-40 m), and now and then beyond the 32-bit one
+	srand(54321);
+	for (int ii = 0; ii < nCount; ii++)
+	{
+		float* pPlanes[3] = { points.pX, points.pY, points.pZ };
+		for (int pp = 0; pp < 3; pp++)
+		{
+			const int nUnits = (int)((((unsigned int)rand() << 8) ^ rand()) % 80000) - 40000;
+			pPlanes[pp][ii] = (nUnits + (rand() % 2) * 0.5f) * fCompactPointScale;
+			if (rand() % 64 == 0)
+				pPlanes[pp][ii] = nUnits * 1.0e5f;
+		}
+		points.pColor[ii] = ((unsigned int)rand() << 16) ^ rand();
+		points.pIndex[ii] = ii;
+		order[ii] = ii;
+	}
+
+	// in order, 4 at a time; through pOrder, one by one
+	CompactPointList vectorized;
+	CompactPointList scalar;
+	PackPoints(points, NULL, vectorized);
+	PackPoints(points, &order[0], scalar);
+	bool bExact = memcmp(vectorized.pPoints, scalar.pPoints, sizeof(CompactPoint)* nCount) == 0;
+
+	UnpackPoints(vectorized.pPoints, nCount, points.pX, points.pY, points.pZ, points.pColor);
+	for (int ii = 0; ii < nCount && bExact; ii++)
+	{
+		const CompactPoint& point = scalar.pPoints[ii];
+		bExact = points.pX[ii] == point.X * fCompactPointScale &&
+			points.pY[ii] == point.Y * fCompactPointScale &&
+			points.pZ[ii] == point.Z * fCompactPointScale &&
+			points.pColor[ii] == point.color;
+	}
+
+	return bExact;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "PointCloud.h"
+
+// A point in 12 bytes instead of the 16 of float X, Y, Z and a color:
+// X, Y, Z in millimeters as 16-bit integers (+/-32.767 m, saturated
+// beyond), a zero pad, and the color as packed RGBA. The 1 mm step is the
+// depth resolution of the sensor. Records draw directly with
+// glVertexPointer(3, GL_SHORT, ...) scaled by fCompactPointScale.
+struct CompactPoint
+{
+	short X;
+	short Y;
+	short Z;
+	short nPad;
+	unsigned int color;
+};
+
+// meters per unit
+const float fCompactPointScale = 0.001f;
+
+// 64-byte aligned array of compact points
+struct CompactPointList
+{
+	CompactPointList();
+	~CompactPointList();
+
+	// grows the storage when needed; the contents are not kept
+	void Reserve(int nCapacity);
+
+	int nCount;
+	int nCapacity;
+	CompactPoint* pPoints;
+
+private:
+	CompactPointList(const CompactPointList&);
+	CompactPointList& operator=(const CompactPointList&);
+};
+
+// Packs points into out, point pOrder[ii] into record ii when pOrder is
+// given; without it, 4 points at a time with SSE2.
+void PackPoints(const PointList& points, const int* pOrder, CompactPointList& out);
+
+// nCount records back to float planes (pIndex is not touched), 4 at a time
+// with SSE2
+void UnpackPoints(const CompactPoint* pSrc, int nCount, float* pX, float* pY, float* pZ, unsigned int* pColor);
+
+// packs and unpacks nCount synthetic points both 4 at a time and one by
+// one; true when the two agree bit for bit
+bool VerifyPackKernels(int nCount);
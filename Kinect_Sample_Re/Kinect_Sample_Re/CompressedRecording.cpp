@@ -0,0 +1,270 @@
+#include <string.h>
+#include "CompressedRecording.h"
+#include "FrameCodec.h"
+
+const char szCompressedRecordingMagic[4] = { 'K', 'F', 'Z', '1' };
+
+int SeekFile(FILE* pFile, INT64 nOffset, int nOrigin)
+{
+#ifdef _WIN32
+	return _fseeki64(pFile, nOffset, nOrigin);
+#else
+	return fseeko(pFile, (off_t)nOffset, nOrigin);
+#endif
+}
+
+INT64 TellFile(FILE* pFile)
+{
+#ifdef _WIN32
+	return _ftelli64(pFile);
+#else
+	return (INT64)ftello(pFile);
+#endif
+}
+
+CompressedRecordingWriter::CompressedRecordingWriter() :
+nDroppedFrames(0),
+pFile(NULL),
+nOffset(0),
+bFailed(false),
+nNextSequence(0),
+nNextWrite(0),
+bStopping(false)
+{
+	memset(&header, 0, sizeof(header));
+	for (int ii = 0; ii < nSlots; ii++)
+	{
+		slots[ii].state = SLOT_FREE;
+		slots[ii].pDepth = NULL;
+		slots[ii].pInfrared = NULL;
+		slots[ii].pBodyIndex = NULL;
+	}
+}
+
+CompressedRecordingWriter::~CompressedRecordingWriter()
+{
+	Close();
+	for (int ii = 0; ii < nSlots; ii++)
+	{
+		if (slots[ii].pDepth != NULL)	delete[] slots[ii].pDepth;
+		if (slots[ii].pInfrared != NULL)	delete[] slots[ii].pInfrared;
+		if (slots[ii].pBodyIndex != NULL)	delete[] slots[ii].pBodyIndex;
+	}
+}
+
+HRESULT CompressedRecordingWriter::Open(
+	const char* szPath,
+	int nDepthWidth, int nDepthHeight,
+	int nColorWidth, int nColorHeight,
+	const SensorIntrinsics& intrinsics)
+{
+	Close();
+
+	pFile = fopen(szPath, "wb");
+	if (pFile == NULL)
+	{
+		printf("Cannot create recording %s\n", szPath);
+		return E_FAIL;
+	}
+
+	memcpy(header.szMagic, szCompressedRecordingMagic, sizeof(szCompressedRecordingMagic));
+	header.nDepthWidth = nDepthWidth;
+	header.nDepthHeight = nDepthHeight;
+	header.nColorWidth = nColorWidth;
+	header.nColorHeight = nColorHeight;
+	header.nFrameCount = 0;
+	header.nIndexOffset = 0;
+	header.intrinsics = intrinsics;
+
+	// frame count and index offset are patched in Close()
+	if (fwrite(&header, sizeof(header), 1, pFile) != 1)
+	{
+		fclose(pFile);
+		pFile = NULL;
+		return E_FAIL;
+	}
+	nOffset = sizeof(header);
+	index.clear();
+	bFailed = false;
+	nDroppedFrames = 0;
+
+	const int nDepthCount = nDepthWidth * nDepthHeight;
+	for (int ii = 0; ii < nSlots; ii++)
+	{
+		Slot& slot = slots[ii];
+		if (slot.pDepth == NULL)
+		{
+			slot.pDepth = new UINT16[nDepthCount];
+			slot.pInfrared = new UINT16[nDepthCount];
+			slot.pBodyIndex = new BYTE[nDepthCount];
+			// worst case: two planes at ~3 bytes per sample plus 2 bytes per run
+			slot.encoded.reserve(nDepthCount * 8);
+		}
+		slot.state = SLOT_FREE;
+	}
+	nNextSequence = 0;
+	nNextWrite = 0;
+
+	// leave a core for the capture thread
+	int nEncoders = (int)std::thread::hardware_concurrency() - 1;
+	if (nEncoders < 1)	nEncoders = 1;
+	if (nEncoders > 3)	nEncoders = 3;
+
+	bStopping = false;
+	for (int ii = 0; ii < nEncoders; ii++)
+		encoders.push_back(std::thread(&CompressedRecordingWriter::Encode, this));
+	writer = std::thread(&CompressedRecordingWriter::WriteEncoded, this);
+
+	return S_OK;
+}
+
+HRESULT CompressedRecordingWriter::Write(const FrameData& frame)
+{
+	if (pFile == NULL)
+		return E_FAIL;
+
+	Slot* pSlot = &slots[nNextSequence % nSlots];
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (bFailed)
+			return E_FAIL;
+		// the slot is still queued, encoding or waiting for the disk
+		if (pSlot->state != SLOT_FREE)
+		{
+			nDroppedFrames++;
+			return S_FALSE;
+		}
+	}
+
+	// only the capture thread touches a free slot
+	const size_t nDepthCount = header.nDepthWidth * header.nDepthHeight;
+	memcpy(pSlot->pDepth, frame.pDepth, sizeof(UINT16)* nDepthCount);
+	memcpy(pSlot->pInfrared, frame.pInfrared, sizeof(UINT16)* nDepthCount);
+	memcpy(pSlot->pBodyIndex, frame.pBodyIndex, sizeof(BYTE)* nDepthCount);
+	pSlot->nTime = frame.nTime;
+	pSlot->nSequence = nNextSequence++;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pSlot->state = SLOT_CAPTURED;
+	}
+	condition.notify_all();
+
+	return S_OK;
+}
+
+void CompressedRecordingWriter::Encode()
+{
+	const int nDepthCount = header.nDepthWidth * header.nDepthHeight;
+
+	for (;;)
+	{
+		Slot* pSlot = NULL;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			for (;;)
+			{
+				// oldest captured frame first
+				for (int ii = 0; ii < nSlots; ii++)
+				{
+					if (slots[ii].state == SLOT_CAPTURED &&
+						(pSlot == NULL || slots[ii].nSequence < pSlot->nSequence))
+						pSlot = &slots[ii];
+				}
+				if (pSlot != NULL || bStopping)
+					break;
+				condition.wait(lock);
+			}
+			if (pSlot == NULL)
+				return;
+			pSlot->state = SLOT_ENCODING;
+		}
+
+		CompressedFrameHeader& frameHeader = pSlot->frameHeader;
+		pSlot->encoded.clear();
+		frameHeader.nTime = pSlot->nTime;
+		frameHeader.nDepthSize = (UINT32)EncodePlane16(pSlot->pDepth, header.nDepthWidth, header.nDepthHeight, pSlot->encoded);
+		frameHeader.nInfraredSize = (UINT32)EncodePlane16(pSlot->pInfrared, header.nDepthWidth, header.nDepthHeight, pSlot->encoded);
+		frameHeader.nBodyIndexSize = (UINT32)EncodeRuns8(pSlot->pBodyIndex, nDepthCount, pSlot->encoded);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pSlot->state = SLOT_ENCODED;
+		}
+		condition.notify_all();
+	}
+}
+
+void CompressedRecordingWriter::WriteEncoded()
+{
+	for (;;)
+	{
+		Slot* pSlot = &slots[nNextWrite % nSlots];
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!(pSlot->state == SLOT_ENCODED && pSlot->nSequence == nNextWrite) && !bStopping)
+				condition.wait(lock);
+			if (!(pSlot->state == SLOT_ENCODED && pSlot->nSequence == nNextWrite))
+				return;
+		}
+
+		if (!bFailed)
+		{
+			if (fwrite(&pSlot->frameHeader, sizeof(pSlot->frameHeader), 1, pFile) != 1 ||
+				fwrite(pSlot->encoded.data(), 1, pSlot->encoded.size(), pFile) != pSlot->encoded.size())
+			{
+				printf("Writing recording failed\n");
+				std::lock_guard<std::mutex> lock(mutex);
+				bFailed = true;
+			}
+			else
+			{
+				CompressedFrameIndex entry;
+				entry.nTime = pSlot->nTime;
+				entry.nOffset = nOffset;
+				index.push_back(entry);
+				nOffset += sizeof(pSlot->frameHeader) + pSlot->encoded.size();
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pSlot->state = SLOT_FREE;
+			nNextWrite++;
+		}
+		condition.notify_all();
+	}
+}
+
+void CompressedRecordingWriter::Close()
+{
+	if (pFile == NULL)
+		return;
+
+	// let the threads drain every queued frame before stopping them
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (nNextWrite != nNextSequence && !bFailed)
+			condition.wait(lock);
+		bStopping = true;
+	}
+	condition.notify_all();
+
+	for (size_t ii = 0; ii < encoders.size(); ii++)
+		encoders[ii].join();
+	encoders.clear();
+	writer.join();
+
+	header.nFrameCount = (INT32)index.size();
+	if (!bFailed && !index.empty() &&
+		fwrite(index.data(), sizeof(CompressedFrameIndex), index.size(), pFile) == index.size())
+		header.nIndexOffset = nOffset;
+
+	SeekFile(pFile, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, pFile);
+	fclose(pFile);
+	pFile = NULL;
+
+	if (nDroppedFrames > 0)
+		printf("Recording dropped %d frames\n", nDroppedFrames);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "FrameSource.h"
+
+// header of a compressed recording (.kfz), followed by variable-size frame
+// records and, at nIndexOffset, one CompressedFrameIndex per frame.
+// A record is CompressedFrameHeader plus the depth, infrared and body index
+// planes encoded by FrameCodec; color is not stored.
+struct CompressedRecordingHeader
+{
+	char szMagic[4];
+	INT32 nDepthWidth;
+	INT32 nDepthHeight;
+	INT32 nColorWidth;
+	INT32 nColorHeight;
+	INT32 nFrameCount;
+	// 0 when the recording was not closed; the reader then scans the records
+	INT64 nIndexOffset;
+	SensorIntrinsics intrinsics;
+};
+
+struct CompressedFrameHeader
+{
+	INT64 nTime;
+	UINT32 nDepthSize;
+	UINT32 nInfraredSize;
+	UINT32 nBodyIndexSize;
+};
+
+struct CompressedFrameIndex
+{
+	INT64 nTime;
+	INT64 nOffset;
+};
+
+extern const char szCompressedRecordingMagic[4];
+
+// 64-bit file offsets; recordings easily pass 2 GB
+int SeekFile(FILE* pFile, INT64 nOffset, int nOrigin);
+INT64 TellFile(FILE* pFile);
+
+// Writes compressed recordings. Write() only copies the frame into a free
+// slot of a small ring; encoder threads compress the slots in parallel and
+// a writer thread appends them to the file in capture order. When every
+// slot is busy the frame is dropped rather than stalling the capture thread.
+class CompressedRecordingWriter : public FrameRecorder
+{
+public:
+	CompressedRecordingWriter();
+	~CompressedRecordingWriter();
+
+	HRESULT Open(
+		const char* szPath,
+		int nDepthWidth, int nDepthHeight,
+		int nColorWidth, int nColorHeight,
+		const SensorIntrinsics& intrinsics);
+	HRESULT Write(const FrameData& frame);
+	// finishes the queued frames, then writes the index
+	void Close();
+
+	int nDroppedFrames;
+
+private:
+	enum SlotState
+	{
+		SLOT_FREE,
+		SLOT_CAPTURED,
+		SLOT_ENCODING,
+		SLOT_ENCODED
+	};
+
+	struct Slot
+	{
+		SlotState state;
+		INT64 nSequence;
+		INT64 nTime;
+		UINT16* pDepth;
+		UINT16* pInfrared;
+		BYTE* pBodyIndex;
+		std::vector<BYTE> encoded;
+		CompressedFrameHeader frameHeader;
+	};
+
+	static const int nSlots = 8;
+
+	void Encode();
+	void WriteEncoded();
+
+	CompressedRecordingWriter(const CompressedRecordingWriter&);
+	CompressedRecordingWriter& operator=(const CompressedRecordingWriter&);
+
+	FILE* pFile;
+	CompressedRecordingHeader header;
+	INT64 nOffset;
+	std::vector<CompressedFrameIndex> index;
+	bool bFailed;
+
+	Slot slots[nSlots];
+	INT64 nNextSequence;
+	INT64 nNextWrite;
+
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::vector<std::thread> encoders;
+	std::thread writer;
+	bool bStopping;
+};
@@ -0,0 +1,47 @@
+#include "CpuFeatures.h"
+
+#if defined(KINECT_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+bool HasSSE2()
+{
+#if defined(_M_X64) || defined(__x86_64__)
+	return true;
+#elif defined(KINECT_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[3] & (1 << 26)) != 0;
+#elif defined(KINECT_X86)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2") != 0;
+#else
+	return false;
+#endif
+}
+
+bool HasAVX2()
+{
+#if defined(KINECT_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	// the OS has to save the YMM registers (OSXSAVE + XCR0 bits 1,2)
+	__cpuid(info, 1);
+	const bool bOsAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 &&
+		(_xgetbv(0) & 0x6) == 0x6;
+	if (!bOsAvx)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#elif defined(KINECT_X86)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#else
+	return false;
+#endif
+}
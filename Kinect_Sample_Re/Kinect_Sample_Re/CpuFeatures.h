@@ -0,0 +1,17 @@
+#pragma once
+
+// x86 instruction sets available at runtime, for picking kernel variants
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define KINECT_X86
+#endif
+
+// functions using AVX2 intrinsics; MSVC needs no per-function target
+#if defined(__GNUC__) || defined(__clang__)
+#define KINECT_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define KINECT_TARGET_AVX2
+#endif
+
+bool HasSSE2();
+bool HasAVX2();
@@ -0,0 +1,471 @@
+#include <stdlib.h>
+#include <string.h>
+#include "DepthKernels.h"
+#include "CpuFeatures.h"
+
+#ifdef KINECT_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// thresholds reduced to "keep if depth <= nMaxDepth && infrared >= nMinInfrared";
+// nKeepMask is 0 when a threshold rejects everything (e.g. a negative depth limit)
+struct ThresholdBounds
+{
+	UINT16 nMaxDepth;
+	UINT16 nMinInfrared;
+	UINT16 nKeepMask;
+};
+
+static ThresholdBounds MakeBounds(const ThresholdParams& params)
+{
+	ThresholdBounds bounds;
+	bounds.nMaxDepth = 0xffff;
+	bounds.nMinInfrared = 0;
+	bounds.nKeepMask = 0xffff;
+
+	if (params.oThresholdDepth)
+	{
+		if (params.iThresholdDepth < 0)	bounds.nKeepMask = 0;
+		else if (params.iThresholdDepth < 0xffff)	bounds.nMaxDepth = (UINT16)params.iThresholdDepth;
+	}
+
+	if (params.oThresholdInfrared)
+	{
+		if (params.iThresholdInfrared > 0xffff)	bounds.nKeepMask = 0;
+		else if (params.iThresholdInfrared > 0)	bounds.nMinInfrared = (UINT16)params.iThresholdInfrared;
+	}
+
+	return bounds;
+}
+
+void ThresholdDepthInfrared_Reference(
+	const UINT16* pDepthSrc,
+	const UINT16* pInfraredSrc,
+	int nCount,
+	const ThresholdParams& params,
+	UINT16* pDepthDst,
+	BYTE* pDepthData,
+	BYTE* pInfraredData)
+{
+	memcpy(pDepthDst, pDepthSrc, sizeof(UINT16)* nCount);
+
+	// thresholding depth data by depth
+	if (params.oThresholdDepth)
+	{
+		for (int ii = 0; ii < nCount; ii++)
+		if (pDepthDst[ii] > params.iThresholdDepth)
+			pDepthDst[ii] = 0;
+	}
+
+	// thresholding depth data by infrared
+	if (params.oThresholdInfrared)
+	{
+		for (int ii = 0; ii < nCount; ii++)
+		{
+			if (pInfraredSrc[ii] < params.iThresholdInfrared)
+				pDepthDst[ii] = 0;
+		}
+	}
+
+	// process depth
+	for (int ii = 0; ii < nCount; ii++)
+	{
+		const unsigned short depth = (pDepthDst[ii] & 0xfff8) >> 3;
+		pDepthData[ii] = depth % 256;
+	}
+
+	// process infrared
+	for (int ii = 0; ii < nCount; ii++)
+	{
+		const unsigned short infrared = pInfraredSrc[ii] >> 8;
+		pInfraredData[ii] = infrared % 256;
+	}
+}
+
+static void ThresholdRange_Scalar(
+	const UINT16* pDepthSrc,
+	const UINT16* pInfraredSrc,
+	int nBegin, int nEnd,
+	const ThresholdBounds& bounds,
+	UINT16* pDepthDst,
+	BYTE* pDepthData,
+	BYTE* pInfraredData)
+{
+	for (int ii = nBegin; ii < nEnd; ii++)
+	{
+		const UINT16 depth = pDepthSrc[ii];
+		const UINT16 infrared = pInfraredSrc[ii];
+		const bool bKeep = depth <= bounds.nMaxDepth && infrared >= bounds.nMinInfrared;
+		const UINT16 kept = bKeep ? (depth & bounds.nKeepMask) : 0;
+
+		pDepthDst[ii] = kept;
+		pDepthData[ii] = (BYTE)(kept >> 3);
+		pInfraredData[ii] = (BYTE)(infrared >> 8);
+	}
+}
+
+void ThresholdDepthInfrared_Scalar(
+	const UINT16* pDepthSrc,
+	const UINT16* pInfraredSrc,
+	int nCount,
+	const ThresholdParams& params,
+	UINT16* pDepthDst,
+	BYTE* pDepthData,
+	BYTE* pInfraredData)
+{
+	ThresholdRange_Scalar(pDepthSrc, pInfraredSrc, 0, nCount, MakeBounds(params),
+		pDepthDst, pDepthData, pInfraredData);
+}
+
+#ifdef KINECT_X86
+
+void ThresholdDepthInfrared_SSE2(
+	const UINT16* pDepthSrc,
+	const UINT16* pInfraredSrc,
+	int nCount,
+	const ThresholdParams& params,
+	UINT16* pDepthDst,
+	BYTE* pDepthData,
+	BYTE* pInfraredData)
+{
+	const ThresholdBounds bounds = MakeBounds(params);
+	const __m128i maxDepth = _mm_set1_epi16((short)bounds.nMaxDepth);
+	const __m128i minInfrared = _mm_set1_epi16((short)bounds.nMinInfrared);
+	const __m128i keepMask = _mm_set1_epi16((short)bounds.nKeepMask);
+	const __m128i lowByte = _mm_set1_epi16(0xff);
+	const __m128i zero = _mm_setzero_si128();
+
+	// 16 pixels per iteration; unsigned compares via saturating subtraction
+	int ii = 0;
+	for (; ii + 16 <= nCount; ii += 16)
+	{
+		__m128i depth0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pDepthSrc + ii));
+		__m128i depth1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pDepthSrc + ii + 8));
+		const __m128i infrared0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pInfraredSrc + ii));
+		const __m128i infrared1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pInfraredSrc + ii + 8));
+
+		const __m128i keep0 = _mm_and_si128(
+			_mm_cmpeq_epi16(_mm_subs_epu16(depth0, maxDepth), zero),
+			_mm_cmpeq_epi16(_mm_subs_epu16(minInfrared, infrared0), zero));
+		const __m128i keep1 = _mm_and_si128(
+			_mm_cmpeq_epi16(_mm_subs_epu16(depth1, maxDepth), zero),
+			_mm_cmpeq_epi16(_mm_subs_epu16(minInfrared, infrared1), zero));
+
+		depth0 = _mm_and_si128(depth0, _mm_and_si128(keep0, keepMask));
+		depth1 = _mm_and_si128(depth1, _mm_and_si128(keep1, keepMask));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pDepthDst + ii), depth0);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pDepthDst + ii + 8), depth1);
+
+		const __m128i depthData = _mm_packus_epi16(
+			_mm_and_si128(_mm_srli_epi16(depth0, 3), lowByte),
+			_mm_and_si128(_mm_srli_epi16(depth1, 3), lowByte));
+		const __m128i infraredData = _mm_packus_epi16(
+			_mm_srli_epi16(infrared0, 8),
+			_mm_srli_epi16(infrared1, 8));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pDepthData + ii), depthData);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pInfraredData + ii), infraredData);
+	}
+
+	ThresholdRange_Scalar(pDepthSrc, pInfraredSrc, ii, nCount, bounds,
+		pDepthDst, pDepthData, pInfraredData);
+}
+
+KINECT_TARGET_AVX2
+void ThresholdDepthInfrared_AVX2(
+	const UINT16* pDepthSrc,
+	const UINT16* pInfraredSrc,
+	int nCount,
+	const ThresholdParams& params,
+	UINT16* pDepthDst,
+	BYTE* pDepthData,
+	BYTE* pInfraredData)
+{
+	const ThresholdBounds bounds = MakeBounds(params);
+	const __m256i maxDepth = _mm256_set1_epi16((short)bounds.nMaxDepth);
+	const __m256i minInfrared = _mm256_set1_epi16((short)bounds.nMinInfrared);
+	const __m256i keepMask = _mm256_set1_epi16((short)bounds.nKeepMask);
+	const __m256i lowByte = _mm256_set1_epi16(0xff);
+
+	// 32 pixels per iteration; packus works per 128-bit lane, so the
+	// packed bytes are put back in order with a 64-bit permute
+	int ii = 0;
+	for (; ii + 32 <= nCount; ii += 32)
+	{
+		__m256i depth0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pDepthSrc + ii));
+		__m256i depth1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pDepthSrc + ii + 16));
+		const __m256i infrared0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pInfraredSrc + ii));
+		const __m256i infrared1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pInfraredSrc + ii + 16));
+
+		const __m256i keep0 = _mm256_and_si256(
+			_mm256_cmpeq_epi16(_mm256_min_epu16(depth0, maxDepth), depth0),
+			_mm256_cmpeq_epi16(_mm256_max_epu16(infrared0, minInfrared), infrared0));
+		const __m256i keep1 = _mm256_and_si256(
+			_mm256_cmpeq_epi16(_mm256_min_epu16(depth1, maxDepth), depth1),
+			_mm256_cmpeq_epi16(_mm256_max_epu16(infrared1, minInfrared), infrared1));
+
+		depth0 = _mm256_and_si256(depth0, _mm256_and_si256(keep0, keepMask));
+		depth1 = _mm256_and_si256(depth1, _mm256_and_si256(keep1, keepMask));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(pDepthDst + ii), depth0);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(pDepthDst + ii + 16), depth1);
+
+		const __m256i depthData = _mm256_permute4x64_epi64(_mm256_packus_epi16(
+			_mm256_and_si256(_mm256_srli_epi16(depth0, 3), lowByte),
+			_mm256_and_si256(_mm256_srli_epi16(depth1, 3), lowByte)), 0xd8);
+		const __m256i infraredData = _mm256_permute4x64_epi64(_mm256_packus_epi16(
+			_mm256_srli_epi16(infrared0, 8),
+			_mm256_srli_epi16(infrared1, 8)), 0xd8);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(pDepthData + ii), depthData);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(pInfraredData + ii), infraredData);
+	}
+	_mm256_zeroupper();
+
+	ThresholdRange_Scalar(pDepthSrc, pInfraredSrc, ii, nCount, bounds,
+		pDepthDst, pDepthData, pInfraredData);
+}
+
+#else
+
+void ThresholdDepthInfrared_SSE2(
+	const UINT16* pDepthSrc, const UINT16* pInfraredSrc, int nCount, const ThresholdParams& params,
+	UINT16* pDepthDst, BYTE* pDepthData, BYTE* pInfraredData)
+{
+	ThresholdDepthInfrared_Scalar(pDepthSrc, pInfraredSrc, nCount, params, pDepthDst, pDepthData, pInfraredData);
+}
+
+void ThresholdDepthInfrared_AVX2(
+	const UINT16* pDepthSrc, const UINT16* pInfraredSrc, int nCount, const ThresholdParams& params,
+	UINT16* pDepthDst, BYTE* pDepthData, BYTE* pInfraredData)
+{
+	ThresholdDepthInfrared_Scalar(pDepthSrc, pInfraredSrc, nCount, params, pDepthDst, pDepthData, pInfraredData);
+}
+
+#endif
+
+static ThresholdKernel SelectThresholdKernel(const char** pszName)
+{
+	if (HasAVX2())
+	{
+		*pszName = "AVX2";
+		return ThresholdDepthInfrared_AVX2;
+	}
+	if (HasSSE2())
+	{
+		*pszName = "SSE2";
+		return ThresholdDepthInfrared_SSE2;
+	}
+	*pszName = "scalar";
+	return ThresholdDepthInfrared_Scalar;
+}
+
+static const char* szThresholdKernelName = "";
+static const ThresholdKernel pThresholdKernel = SelectThresholdKernel(&szThresholdKernelName);
+
+void ThresholdDepthInfrared(
+	const UINT16* pDepthSrc,
+	const UINT16* pInfraredSrc,
+	int nCount,
+	const ThresholdParams& params,
+	UINT16* pDepthDst,
+	BYTE* pDepthData,
+	BYTE* pInfraredData)
+{
+	pThresholdKernel(pDepthSrc, pInfraredSrc, nCount, params, pDepthDst, pDepthData, pInfraredData);
+}
+
+const char* ThresholdKernelName()
+{
+	return szThresholdKernelName;
+}
+
+// first and last set bit of a non-zero mask
+static inline int LowestBit(unsigned int nMask)
+{
+#ifdef _MSC_VER
+	unsigned long iBit;
+	_BitScanForward(&iBit, nMask);
+	return (int)iBit;
+#else
+	return __builtin_ctz(nMask);
+#endif
+}
+
+static inline int HighestBit(unsigned int nMask)
+{
+#ifdef _MSC_VER
+	unsigned long iBit;
+	_BitScanReverse(&iBit, nMask);
+	return (int)iBit;
+#else
+	return 31 - __builtin_clz(nMask);
+#endif
+}
+
+bool FindBodyRect(const BYTE* pBodyIndex, int nWidth, int nHeight, BYTE iBody, PixelRect& rect)
+{
+	rect.nLeft = nWidth;
+	rect.nTop = nHeight;
+	rect.nRight = 0;
+	rect.nBottom = 0;
+
+#ifdef KINECT_X86
+	const __m128i body = _mm_set1_epi8((char)iBody);
+#endif
+
+	for (int rr = 0; rr < nHeight; rr++)
+	{
+		const BYTE* pRow = pBodyIndex + rr * nWidth;
+		int nFirst = -1;
+		int nLast = -1;
+		int cc = 0;
+
+#ifdef KINECT_X86
+		// 16 pixels per compare; only rows and chunks with a hit cost more
+		for (; cc + 16 <= nWidth; cc += 16)
+		{
+			const unsigned int nMask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow + cc)), body));
+			if (nMask == 0)
+				continue;
+			if (nFirst < 0)
+				nFirst = cc + LowestBit(nMask);
+			nLast = cc + HighestBit(nMask);
+		}
+#endif
+
+		for (; cc < nWidth; cc++)
+		{
+			if (pRow[cc] != iBody)
+				continue;
+			if (nFirst < 0)
+				nFirst = cc;
+			nLast = cc;
+		}
+
+		if (nFirst < 0)
+			continue;
+
+		if (rect.nTop > rr)	rect.nTop = rr;
+		rect.nBottom = rr + 1;
+		if (rect.nLeft > nFirst)	rect.nLeft = nFirst;
+		if (rect.nRight < nLast + 1)	rect.nRight = nLast + 1;
+	}
+
+	if (rect.Empty())
+	{
+		rect = PixelRect::Full(0, 0);
+		return false;
+	}
+	return true;
+}
+
+void ThresholdDepthInfraredRect(
+	const UINT16* pDepthSrc,
+	const UINT16* pInfraredSrc,
+	const BYTE* pBodyIndex,
+	BYTE iBody,
+	int nWidth,
+	const PixelRect& rect,
+	const ThresholdParams& params,
+	UINT16* pDepthDst,
+	BYTE* pDepthData,
+	BYTE* pInfraredData)
+{
+	for (int rr = rect.nTop; rr < rect.nBottom; rr++)
+	{
+		const int nOffset = rr * nWidth + rect.nLeft;
+		pThresholdKernel(
+			pDepthSrc + nOffset,
+			pInfraredSrc + nOffset,
+			rect.Width(),
+			params,
+			pDepthDst + nOffset,
+			pDepthData + nOffset,
+			pInfraredData + nOffset);
+
+		if (pBodyIndex == NULL)
+			continue;
+
+		for (int ii = nOffset; ii < nOffset + rect.Width(); ii++)
+		{
+			if (pBodyIndex[ii] != iBody)
+			{
+				pDepthDst[ii] = 0;
+				pDepthData[ii] = 0;
+			}
+		}
+	}
+}
+
+void ClearDepthRect(UINT16* pDepth, int nWidth, const PixelRect& rect)
+{
+	if (rect.Empty())
+		return;
+
+	for (int rr = rect.nTop; rr < rect.nBottom; rr++)
+		memset(pDepth + rr * nWidth + rect.nLeft, 0, sizeof(UINT16)* rect.Width());
+}
+
+bool VerifyThresholdKernels(int nCount)
+{
+	ThresholdKernel kernels[3] = { ThresholdDepthInfrared_Scalar, NULL, NULL };
+	if (HasSSE2())	kernels[1] = ThresholdDepthInfrared_SSE2;
+	if (HasAVX2())	kernels[2] = ThresholdDepthInfrared_AVX2;
+
+	UINT16* pDepthSrc = new UINT16[nCount];
+	UINT16* pInfraredSrc = new UINT16[nCount];
+	UINT16* pDepthRef = new UINT16[nCount];
+	UINT16* pDepthOut = new UINT16[nCount];
+	BYTE* pData = new BYTE[nCount * 4];
+	BYTE* pDepthDataRef = pData;
+	BYTE* pInfraredDataRef = pData + nCount;
+	BYTE* pDepthDataOut = pData + nCount * 2;
+	BYTE* pInfraredDataOut = pData + nCount * 3;
+
+	// full 16-bit range, including the invalid-pixel bits of raw depth
+	srand(12345);
+	for (int ii = 0; ii < nCount; ii++)
+	{
+		pDepthSrc[ii] = (UINT16)((rand() << 4) ^ rand());
+		pInfraredSrc[ii] = (UINT16)((rand() << 4) ^ rand());
+	}
+
+	const int depthThresholds[] = { 1200, 0, -1, 65535, 70000, 4500 };
+	const int infraredThresholds[] = { 4000, 0, -5, 65535, 65536, 1 };
+
+	bool bExact = true;
+	for (int tt = 0; tt < 6 && bExact; tt++)
+	for (int mode = 0; mode < 4 && bExact; mode++)
+	{
+		ThresholdParams params;
+		params.oThresholdDepth = (mode & 1) != 0;
+		params.oThresholdInfrared = (mode & 2) != 0;
+		params.iThresholdDepth = depthThresholds[tt];
+		params.iThresholdInfrared = infraredThresholds[tt];
+
+		ThresholdDepthInfrared_Reference(pDepthSrc, pInfraredSrc, nCount, params,
+			pDepthRef, pDepthDataRef, pInfraredDataRef);
+
+		for (int kk = 0; kk < 3 && bExact; kk++)
+		{
+			if (kernels[kk] == NULL) continue;
+
+			kernels[kk](pDepthSrc, pInfraredSrc, nCount, params,
+				pDepthOut, pDepthDataOut, pInfraredDataOut);
+			bExact = memcmp(pDepthRef, pDepthOut, sizeof(UINT16)* nCount) == 0 &&
+				memcmp(pDepthDataRef, pDepthDataOut, nCount) == 0 &&
+				memcmp(pInfraredDataRef, pInfraredDataOut, nCount) == 0;
+		}
+	}
+
+	delete[] pDepthSrc;
+	delete[] pInfraredSrc;
+	delete[] pDepthRef;
+	delete[] pDepthOut;
+	delete[] pData;
+
+	return bExact;
+}
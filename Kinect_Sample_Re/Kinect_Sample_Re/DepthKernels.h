@@ -0,0 +1,70 @@
+#pragma once
+
+#include "KinectCompat.h"
+#include "PixelRect.h"
+
+// Depth/infrared thresholding in one pass over the raw frames.
+// A depth pixel is kept when depth <= iThresholdDepth (if oThresholdDepth)
+// and infrared >= iThresholdInfrared (if oThresholdInfrared), else zeroed.
+// Outputs the thresholded depth, its 8-bit view ((depth & 0xfff8) >> 3) % 256
+// and the 8-bit infrared (infrared >> 8) % 256.
+struct ThresholdParams
+{
+	bool oThresholdDepth;
+	bool oThresholdInfrared;
+	int iThresholdDepth;
+	int iThresholdInfrared;
+};
+
+typedef void (*ThresholdKernel)(
+	const UINT16* pDepthSrc,
+	const UINT16* pInfraredSrc,
+	int nCount,
+	const ThresholdParams& params,
+	UINT16* pDepthDst,
+	BYTE* pDepthData,
+	BYTE* pInfraredData);
+
+// fastest variant for this CPU (AVX2, SSE2 or scalar), chosen once
+void ThresholdDepthInfrared(
+	const UINT16* pDepthSrc,
+	const UINT16* pInfraredSrc,
+	int nCount,
+	const ThresholdParams& params,
+	UINT16* pDepthDst,
+	BYTE* pDepthData,
+	BYTE* pInfraredData);
+
+// the separate passes ProcessFrame used to make, kept as the reference
+void ThresholdDepthInfrared_Reference(const UINT16*, const UINT16*, int, const ThresholdParams&, UINT16*, BYTE*, BYTE*);
+void ThresholdDepthInfrared_Scalar(const UINT16*, const UINT16*, int, const ThresholdParams&, UINT16*, BYTE*, BYTE*);
+void ThresholdDepthInfrared_SSE2(const UINT16*, const UINT16*, int, const ThresholdParams&, UINT16*, BYTE*, BYTE*);
+void ThresholdDepthInfrared_AVX2(const UINT16*, const UINT16*, int, const ThresholdParams&, UINT16*, BYTE*, BYTE*);
+
+const char* ThresholdKernelName();
+
+// Bounding box of the pixels of body iBody (0-5, 255 is no body) in a body
+// index frame; false, with an empty rect, when that body is not in view.
+bool FindBodyRect(const BYTE* pBodyIndex, int nWidth, int nHeight, BYTE iBody, PixelRect& rect);
+
+// ThresholdDepthInfrared over the pixels of rect only (frames nWidth wide);
+// with pBodyIndex, depth that does not belong to body iBody is zeroed too.
+// Pixels outside rect are left as they are.
+void ThresholdDepthInfraredRect(
+	const UINT16* pDepthSrc,
+	const UINT16* pInfraredSrc,
+	const BYTE* pBodyIndex,
+	BYTE iBody,
+	int nWidth,
+	const PixelRect& rect,
+	const ThresholdParams& params,
+	UINT16* pDepthDst,
+	BYTE* pDepthData,
+	BYTE* pInfraredData);
+
+// zeroes the pixels of rect
+void ClearDepthRect(UINT16* pDepth, int nWidth, const PixelRect& rect);
+
+// runs every variant available on this CPU against the reference on
+// synthetic frames of nCount pixels; true when all are bit-exact
+bool VerifyThresholdKernels(int nCount);
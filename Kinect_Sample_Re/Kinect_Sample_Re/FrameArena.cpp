@@ -0,0 +1,309 @@
+#include <new>
+#include <atomic>
+#include <stdlib.h>
+#include <string.h>
+#include "FrameArena.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#define FRAME_ARENA_THREAD_LOCAL __declspec(thread)
+#else
+#include <sys/mman.h>
+#define FRAME_ARENA_THREAD_LOCAL __thread
+#endif
+
+static std::atomic<long long> nHeapAllocations(0);
+static FRAME_ARENA_THREAD_LOCAL long long nThreadHeapAllocations = 0;
+
+void CountHeapAllocation()
+{
+	nHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+	nThreadHeapAllocations++;
+}
+
+long long HeapAllocationCount()
+{
+	return nHeapAllocations.load(std::memory_order_relaxed);
+}
+
+long long ThreadHeapAllocationCount()
+{
+	return nThreadHeapAllocations;
+}
+
+void AddThreadHeapAllocations(long long nCount)
+{
+	nThreadHeapAllocations += nCount;
+}
+
+// every operator new of the program goes through here to be counted
+static void* CountedMalloc(size_t nSize)
+{
+	CountHeapAllocation();
+	return malloc(nSize != 0 ? nSize : 1);
+}
+
+void* operator new(size_t nSize)
+{
+	void* p = CountedMalloc(nSize);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t nSize)
+{
+	void* p = CountedMalloc(nSize);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(size_t nSize, const std::nothrow_t&) throw()
+{
+	return CountedMalloc(nSize);
+}
+
+void* operator new[](size_t nSize, const std::nothrow_t&) throw()
+{
+	return CountedMalloc(nSize);
+}
+
+void operator delete(void* p) throw()
+{
+	free(p);
+}
+
+void operator delete[](void* p) throw()
+{
+	free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) throw()
+{
+	free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) throw()
+{
+	free(p);
+}
+
+// the sized forms C++14 calls when the size is known
+void operator delete(void* p, size_t) throw()
+{
+	free(p);
+}
+
+void operator delete[](void* p, size_t) throw()
+{
+	free(p);
+}
+
+#ifdef __cpp_aligned_new
+// C++17 new of over-aligned types, counted as well through AlignedAlloc
+static void* CountedAlignedMalloc(size_t nSize, std::align_val_t alignment)
+{
+	return AlignedAlloc(nSize != 0 ? nSize : 1, static_cast<size_t>(alignment));
+}
+
+void* operator new(size_t nSize, std::align_val_t alignment)
+{
+	void* p = CountedAlignedMalloc(nSize, alignment);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t nSize, std::align_val_t alignment)
+{
+	void* p = CountedAlignedMalloc(nSize, alignment);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(size_t nSize, std::align_val_t alignment, const std::nothrow_t&) throw()
+{
+	return CountedAlignedMalloc(nSize, alignment);
+}
+
+void* operator new[](size_t nSize, std::align_val_t alignment, const std::nothrow_t&) throw()
+{
+	return CountedAlignedMalloc(nSize, alignment);
+}
+
+void operator delete(void* p, std::align_val_t) throw()
+{
+	AlignedFree(p);
+}
+
+void operator delete[](void* p, std::align_val_t) throw()
+{
+	AlignedFree(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) throw()
+{
+	AlignedFree(p);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t) throw()
+{
+	AlignedFree(p);
+}
+
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) throw()
+{
+	AlignedFree(p);
+}
+
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) throw()
+{
+	AlignedFree(p);
+}
+#endif
+
+static const size_t nLargePageSize = 2 << 20;
+
+static size_t RoundUp(size_t n, size_t nMultiple)
+{
+	return (n + nMultiple - 1) / nMultiple * nMultiple;
+}
+
+#ifdef _WIN32
+// large pages need SeLockMemoryPrivilege held by the account and enabled
+// in the process token
+static bool EnableLockMemoryPrivilege()
+{
+	HANDLE hToken = NULL;
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken))
+		return false;
+
+	TOKEN_PRIVILEGES privileges;
+	privileges.PrivilegeCount = 1;
+	privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	bool bEnabled = LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) != FALSE;
+	// succeeds without assigning when the account lacks the privilege
+	if (bEnabled)
+		bEnabled = AdjustTokenPrivileges(hToken, FALSE, &privileges, 0, NULL, NULL) != FALSE && GetLastError() == ERROR_SUCCESS;
+
+	CloseHandle(hToken);
+	return bEnabled;
+}
+#endif
+
+FrameArena::FrameArena() :
+nSize(0),
+nUsed(0),
+bLargePages(false),
+pBlock(NULL),
+bMapped(false)
+{
+}
+
+FrameArena::~FrameArena()
+{
+	Release();
+}
+
+bool FrameArena::Reserve(size_t nBytes, bool bLargePages)
+{
+	Release();
+
+	this->bLargePages = false;
+	void* p = NULL;
+
+#ifdef _WIN32
+	if (bLargePages && GetLargePageMinimum() != 0 && EnableLockMemoryPrivilege())
+	{
+		const size_t nLargeSize = RoundUp(nBytes, GetLargePageMinimum());
+		p = VirtualAlloc(NULL, nLargeSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+		if (p != NULL)
+		{
+			nBytes = nLargeSize;
+			this->bLargePages = true;
+		}
+	}
+	if (p == NULL)
+		p = VirtualAlloc(NULL, nBytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+	if (bLargePages)
+	{
+		const size_t nLargeSize = RoundUp(nBytes, nLargePageSize);
+		p = mmap(NULL, nLargeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (p != MAP_FAILED)
+		{
+			nBytes = nLargeSize;
+			this->bLargePages = true;
+		}
+		else
+			p = NULL;
+	}
+	if (p == NULL)
+	{
+		p = mmap(NULL, nBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			p = NULL;
+#ifdef MADV_HUGEPAGE
+		// no pool of huge pages set aside; transparent ones may still do
+		if (p != NULL && bLargePages)
+			madvise(p, nBytes, MADV_HUGEPAGE);
+#endif
+	}
+#endif
+
+	if (p != NULL)
+		bMapped = true;
+	else
+	{
+		// without the OS calls, the heap (zeroed here instead)
+		p = AlignedAlloc(nBytes, PAGE_SIZE_BYTES);
+		if (p == NULL)
+			return false;
+		memset(p, 0, nBytes);
+		bMapped = false;
+	}
+
+	pBlock = static_cast<char*>(p);
+	nSize = nBytes;
+	nUsed = 0;
+	return true;
+}
+
+void FrameArena::Release()
+{
+	if (pBlock != NULL)
+	{
+		if (!bMapped)
+			AlignedFree(pBlock);
+		else
+		{
+#ifdef _WIN32
+			VirtualFree(pBlock, 0, MEM_RELEASE);
+#else
+			munmap(pBlock, nSize);
+#endif
+		}
+	}
+
+	pBlock = NULL;
+	nSize = 0;
+	nUsed = 0;
+	bLargePages = false;
+	bMapped = false;
+}
+
+void* FrameArena::Allocate(size_t nBytes, size_t nAlignment)
+{
+	if (pBlock == NULL)
+		return NULL;
+
+	// the block itself is page aligned
+	const size_t nOffset = RoundUp(nUsed, nAlignment);
+	if (nOffset > nSize || nBytes > nSize - nOffset)
+		return NULL;
+
+	nUsed = nOffset + nBytes;
+	return pBlock + nOffset;
+}
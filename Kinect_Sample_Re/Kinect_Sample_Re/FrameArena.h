@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stddef.h>
+#include "AlignedMemory.h"
+
+const size_t PAGE_SIZE_BYTES = 4096;
+
+// One block of memory reserved up front, out of which the buffers that live
+// as long as the frames (sensor scratch, the point clouds of the triple
+// buffer) are carved by bumping an offset. The block comes straight from the
+// OS, so it starts zeroed and is only backed by memory as it is touched;
+// with bLargePages it is backed by 2 MB pages when the OS allows it (on
+// Windows that needs the "Lock pages in memory" privilege), which takes TLB
+// misses out of the random access of the point kernels. Buffers are never
+// freed one by one; the whole block goes with the arena.
+class FrameArena
+{
+public:
+	FrameArena();
+	~FrameArena();
+
+	// false when the OS has no memory for it
+	bool Reserve(size_t nBytes, bool bLargePages);
+	void Release();
+
+	// zeroed, aligned to nAlignment (a power of two); NULL when the block is full
+	void* Allocate(size_t nBytes, size_t nAlignment = CACHE_LINE_SIZE);
+
+	template<class T>
+	T* AllocateArray(size_t nCount, size_t nAlignment = CACHE_LINE_SIZE)
+	{
+		return static_cast<T*>(Allocate(sizeof(T)* nCount, nAlignment));
+	}
+
+	// what Allocate(nBytes, nAlignment) takes from the block at most, for sizing it
+	static size_t Footprint(size_t nBytes, size_t nAlignment = CACHE_LINE_SIZE)
+	{
+		return nBytes + nAlignment - 1;
+	}
+
+	size_t nSize;
+	size_t nUsed;
+	bool bLargePages;
+
+private:
+	FrameArena(const FrameArena&);
+	FrameArena& operator=(const FrameArena&);
+
+	char* pBlock;
+	// how pBlock was obtained, to give it back the same way
+	bool bMapped;
+};
+
+// Heap allocations (operator new and AlignedAlloc) since the process
+// started, by all threads and by the calling thread; the latter includes
+// what the ParallelFor workers allocated on its behalf. The difference over
+// a ProcessFrame() call is what processing a frame allocated, which is zero
+// once every buffer reached its steady size.
+long long HeapAllocationCount();
+long long ThreadHeapAllocationCount();
+// for a thread that worked on behalf of the calling one (the workers of
+// ParallelFor): adds what it allocated to the calling thread's count only
+void AddThreadHeapAllocations(long long nCount);
@@ -0,0 +1,239 @@
+#include "FrameCodec.h"
+
+// quotients from here on are sent as an escape plus the raw value
+static const unsigned int nEscapeQuotient = 24;
+static const int nRawBits = 18;		// zigzag of a 16-bit difference
+static const int nParameterBits = 5;
+static const int nMaxParameter = 16;
+
+class BitWriter
+{
+public:
+	BitWriter(std::vector<BYTE>& out) : out(out), nBits(0), nBuffer(0) {}
+
+	void Put(unsigned int nValue, int nCount)
+	{
+		nBuffer |= (unsigned long long)nValue << nBits;
+		nBits += nCount;
+		while (nBits >= 8)
+		{
+			out.push_back((BYTE)nBuffer);
+			nBuffer >>= 8;
+			nBits -= 8;
+		}
+	}
+
+	void PutOnes(unsigned int nCount)
+	{
+		for (; nCount >= 16; nCount -= 16)
+			Put(0xffff, 16);
+		Put((1u << nCount) - 1, nCount);
+	}
+
+	void Flush()
+	{
+		if (nBits > 0)
+			out.push_back((BYTE)nBuffer);
+		nBits = 0;
+		nBuffer = 0;
+	}
+
+private:
+	BitWriter& operator=(const BitWriter&);
+
+	std::vector<BYTE>& out;
+	int nBits;
+	unsigned long long nBuffer;
+};
+
+class BitReader
+{
+public:
+	BitReader(const BYTE* pSrc, size_t nSize) : bOverrun(false), pSrc(pSrc), pEnd(pSrc + nSize), nBits(0), nBuffer(0) {}
+
+	unsigned int Get(int nCount)
+	{
+		Fill();
+		if (nCount > nBits)
+		{
+			bOverrun = true;
+			return 0;
+		}
+		const unsigned int nValue = (unsigned int)(nBuffer & ((1ULL << nCount) - 1));
+		nBuffer >>= nCount;
+		nBits -= nCount;
+		return nValue;
+	}
+
+	// number of 1 bits before the next 0 (which is consumed), at most nLimit
+	unsigned int GetOnes(unsigned int nLimit)
+	{
+		unsigned int nCount = 0;
+		for (;;)
+		{
+			Fill();
+			if (nBits == 0)
+			{
+				bOverrun = true;
+				return nCount;
+			}
+			while (nBits > 0 && (nBuffer & 1) && nCount < nLimit)
+			{
+				nBuffer >>= 1;
+				nBits--;
+				nCount++;
+			}
+			if (nCount == nLimit)
+				return nCount;
+			if (nBits > 0)
+			{
+				nBuffer >>= 1;
+				nBits--;
+				return nCount;
+			}
+		}
+	}
+
+	bool bOverrun;
+
+private:
+	void Fill()
+	{
+		while (nBits <= 56 && pSrc != pEnd)
+		{
+			nBuffer |= (unsigned long long)(*pSrc++) << nBits;
+			nBits += 8;
+		}
+	}
+
+	const BYTE* pSrc;
+	const BYTE* pEnd;
+	int nBits;
+	unsigned long long nBuffer;
+};
+
+static inline unsigned int ZigZag(int n)
+{
+	return n >= 0 ? (unsigned int)n << 1 : ((unsigned int)(-n) << 1) - 1;
+}
+
+static inline int UnZigZag(unsigned int n)
+{
+	return (n & 1) ? -(int)((n + 1) >> 1) : (int)(n >> 1);
+}
+
+size_t EncodePlane16(const UINT16* pSrc, int nWidth, int nHeight, std::vector<BYTE>& out)
+{
+	const size_t nStart = out.size();
+	BitWriter writer(out);
+
+	for (int rr = 0; rr < nHeight; rr++)
+	{
+		const UINT16* pRow = pSrc + rr * nWidth;
+		const int nFirstPrediction = rr > 0 ? pRow[-nWidth] : 0;
+		int nPrediction = nFirstPrediction;
+		unsigned long long nSum = 0;
+		for (int cc = 0; cc < nWidth; cc++)
+		{
+			nSum += ZigZag((int)pRow[cc] - nPrediction);
+			nPrediction = pRow[cc];
+		}
+
+		// Rice parameter ~ log2 of the mean residual
+		int k = 0;
+		while (k < nMaxParameter && ((unsigned long long)nWidth << (k + 1)) <= nSum)
+			k++;
+		writer.Put(k, nParameterBits);
+
+		// the residuals again, cheaper than keeping a row of them around
+		nPrediction = nFirstPrediction;
+		for (int cc = 0; cc < nWidth; cc++)
+		{
+			const unsigned int nResidual = ZigZag((int)pRow[cc] - nPrediction);
+			nPrediction = pRow[cc];
+
+			const unsigned int nQuotient = nResidual >> k;
+			if (nQuotient < nEscapeQuotient)
+			{
+				writer.PutOnes(nQuotient);
+				writer.Put(0, 1);
+				writer.Put(nResidual & ((1u << k) - 1), k);
+			}
+			else
+			{
+				writer.PutOnes(nEscapeQuotient);
+				writer.Put(nResidual, nRawBits);
+			}
+		}
+	}
+
+	writer.Flush();
+	return out.size() - nStart;
+}
+
+bool DecodePlane16(const BYTE* pSrc, size_t nSize, int nWidth, int nHeight, UINT16* pDst)
+{
+	BitReader reader(pSrc, nSize);
+
+	for (int rr = 0; rr < nHeight; rr++)
+	{
+		UINT16* pRow = pDst + rr * nWidth;
+		int nPrediction = rr > 0 ? pRow[-nWidth] : 0;
+
+		const int k = (int)reader.Get(nParameterBits);
+		if (k > nMaxParameter)
+			return false;
+
+		for (int cc = 0; cc < nWidth; cc++)
+		{
+			const unsigned int nQuotient = reader.GetOnes(nEscapeQuotient);
+			unsigned int nResidual;
+			if (nQuotient < nEscapeQuotient)
+				nResidual = (nQuotient << k) | reader.Get(k);
+			else
+				nResidual = reader.Get(nRawBits);
+
+			const int nValue = nPrediction + UnZigZag(nResidual);
+			if (nValue < 0 || nValue > 0xffff || reader.bOverrun)
+				return false;
+			pRow[cc] = (UINT16)nValue;
+			nPrediction = nValue;
+		}
+	}
+
+	return true;
+}
+
+size_t EncodeRuns8(const BYTE* pSrc, int nCount, std::vector<BYTE>& out)
+{
+	const size_t nStart = out.size();
+
+	for (int ii = 0; ii < nCount;)
+	{
+		const BYTE value = pSrc[ii];
+		int nRun = 1;
+		while (ii + nRun < nCount && nRun < 255 && pSrc[ii + nRun] == value)
+			nRun++;
+
+		out.push_back(value);
+		out.push_back((BYTE)nRun);
+		ii += nRun;
+	}
+
+	return out.size() - nStart;
+}
+
+bool DecodeRuns8(const BYTE* pSrc, size_t nSize, int nCount, BYTE* pDst)
+{
+	int ii = 0;
+	for (size_t nn = 0; nn + 1 < nSize; nn += 2)
+	{
+		const int nRun = pSrc[nn + 1];
+		if (ii + nRun > nCount)
+			return false;
+		for (int rr = 0; rr < nRun; rr++)
+			pDst[ii++] = pSrc[nn];
+	}
+
+	return ii == nCount;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <vector>
+#include "KinectCompat.h"
+
+// Lossless codecs for the depth-resolution frames of a compressed recording.
+
+// 16-bit planes (depth, infrared): each pixel is predicted by its left
+// neighbour (the first pixel of a row by the one above it), and the
+// zigzagged residuals are Rice coded with one parameter per row.
+// Appends to out; returns the number of bytes appended.
+size_t EncodePlane16(const UINT16* pSrc, int nWidth, int nHeight, std::vector<BYTE>& out);
+bool DecodePlane16(const BYTE* pSrc, size_t nSize, int nWidth, int nHeight, UINT16* pDst);
+
+// 8-bit label planes (body index): run-length pairs of (value, length).
+size_t EncodeRuns8(const BYTE* pSrc, int nCount, std::vector<BYTE>& out);
+bool DecodeRuns8(const BYTE* pSrc, size_t nSize, int nCount, BYTE* pDst);
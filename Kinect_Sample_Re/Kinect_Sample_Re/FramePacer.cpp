@@ -0,0 +1,60 @@
+#include <thread>
+#include "FramePacer.h"
+
+FramePacer::FramePacer() :
+bPending(false),
+minInterval(0),
+pShared(NULL)
+{
+}
+
+void FramePacer::Notify()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		bPending = true;
+	}
+	condition.notify_one();
+
+	FramePacer* pSharedPacer = pShared;
+	if (pSharedPacer != NULL)
+		pSharedPacer->Notify();
+}
+
+void FramePacer::NotifyAlso(FramePacer* pShared)
+{
+	this->pShared = pShared;
+}
+
+bool FramePacer::WaitForFrame(int iTimeoutMs)
+{
+	const std::chrono::steady_clock::time_point tTimeout =
+		std::chrono::steady_clock::now() + std::chrono::milliseconds(iTimeoutMs);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	if (!condition.wait_until(lock, tTimeout, [this]() { return bPending; }))
+		return false;
+
+	// under a cap, sleep until the frame's slot (or the timeout) comes
+	const std::chrono::steady_clock::time_point tDue = tLastFrame + minInterval;
+	if (tDue > std::chrono::steady_clock::now())
+	{
+		lock.unlock();
+		std::this_thread::sleep_until(tDue < tTimeout ? tDue : tTimeout);
+		lock.lock();
+		if (tDue > std::chrono::steady_clock::now())
+			return false;
+	}
+
+	bPending = false;
+	tLastFrame = std::chrono::steady_clock::now();
+	return true;
+}
+
+void FramePacer::SetRateCap(float fMaxRate)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	minInterval = fMaxRate > 0.0f ?
+		std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / fMaxRate)) :
+		std::chrono::steady_clock::duration(0);
+}
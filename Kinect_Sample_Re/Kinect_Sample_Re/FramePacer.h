@@ -0,0 +1,39 @@
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+
+// Hands "a new frame was published" from the capture thread to the GLUT
+// thread, which sleeps in WaitForFrame() instead of polling. An optional
+// rate cap spaces out the frames it lets through.
+class FramePacer
+{
+public:
+	FramePacer();
+
+	// producer side, after TripleBuffer::Publish()
+	void Notify();
+	// every Notify() also notifies pShared (NULL for none), so that one
+	// pacer can be waited on for the frames of several producers
+	void NotifyAlso(FramePacer* pShared);
+
+	// consumer side: true when a frame arrived and is due under the cap;
+	// false after iTimeoutMs without one
+	bool WaitForFrame(int iTimeoutMs);
+
+	// frames per second, 0 for no cap
+	void SetRateCap(float fMaxRate);
+
+private:
+	FramePacer(const FramePacer&);
+	FramePacer& operator=(const FramePacer&);
+
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool bPending;
+	std::chrono::steady_clock::duration minInterval;
+	std::chrono::steady_clock::time_point tLastFrame;
+	std::atomic<FramePacer*> pShared;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "KinectCompat.h"
+#include "SoftwareMapper.h"
+
+// one set of frames acquired together;
+// the buffers stay valid until FrameSource::ReleaseFrame()
+struct FrameData
+{
+	INT64 nTime;
+	const UINT16* pDepth;
+	const UINT16* pInfrared;
+	const RGBQUAD* pColor;
+	const BYTE* pBodyIndex;
+};
+
+// where KinectBasic gets its frames from: a live sensor or a recording
+class FrameSource
+{
+public:
+	virtual ~FrameSource() {}
+
+	virtual HRESULT Open() = 0;
+	virtual void Close() = 0;
+
+	// sleeps until a frame is likely available (S_OK) or iTimeoutMs passed
+	// (E_PENDING); AcquireFrame() may still find none
+	virtual HRESULT WaitForFrame(int iTimeoutMs) = 0;
+
+	// returns E_PENDING when no new frame is available yet
+	virtual HRESULT AcquireFrame(FrameData& frame) = 0;
+	virtual void ReleaseFrame() = 0;
+
+	virtual HRESULT MapColorFrameToCameraSpace(
+		UINT nDepthPointCount,
+		const UINT16* pDepthFrameData,
+		UINT nCameraPointCount,
+		CameraSpacePoint* pCameraSpacePoints) = 0;
+
+	// color pixel of every depth pixel (-inf where there is none)
+	virtual HRESULT MapDepthFrameToColorSpace(
+		UINT nDepthPointCount,
+		const UINT16* pDepthFrameData,
+		UINT nColorPointCount,
+		ColorSpacePoint* pColorSpacePoints) = 0;
+
+	// X/Z and Y/Z of every depth pixel, lens distortion included;
+	// E_PENDING (like GetSensorIntrinsics) while a live sensor has not
+	// streamed yet and has no calibration to give
+	virtual HRESULT GetDepthFrameToCameraSpaceTable(
+		UINT nTableEntryCount,
+		PointF* pTableEntries) = 0;
+
+	virtual HRESULT GetSensorIntrinsics(SensorIntrinsics& intrinsics) = 0;
+};
+
+// where KinectBasic writes the frames it processes: a raw or compressed recording
+class FrameRecorder
+{
+public:
+	virtual ~FrameRecorder() {}
+
+	// S_FALSE when the frame had to be dropped
+	virtual HRESULT Write(const FrameData& frame) = 0;
+	virtual void Close() = 0;
+};
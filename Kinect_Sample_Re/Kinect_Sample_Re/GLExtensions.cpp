@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <string.h>
+#include "GLExtensions.h"
+
+static bool HasGLVersion(int nMajor, int nMinor)
+{
+	const char* szVersion = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+	int nCurrentMajor = 0;
+	int nCurrentMinor = 0;
+	if (szVersion == NULL || sscanf(szVersion, "%d.%d", &nCurrentMajor, &nCurrentMinor) != 2)
+		return false;
+
+	return nCurrentMajor > nMajor || (nCurrentMajor == nMajor && nCurrentMinor >= nMinor);
+}
+
+static bool HasGLExtension(const char* szName)
+{
+	const char* szExtensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+	if (szExtensions == NULL)
+		return false;
+
+	// match whole names only
+	const size_t nLength = strlen(szName);
+	for (const char* p = strstr(szExtensions, szName); p != NULL; p = strstr(p + nLength, szName))
+	{
+		if ((p == szExtensions || p[-1] == ' ') && (p[nLength] == ' ' || p[nLength] == 0))
+			return true;
+	}
+	return false;
+}
+
+template<class Function>
+static void LoadFunction(Function& pFunction, const char* szName)
+{
+	pFunction = reinterpret_cast<Function>(glutGetProcAddress(szName));
+}
+
+bool LoadGLBufferApi(GLBufferApi& api)
+{
+	memset(&api, 0, sizeof(api));
+
+	// GLX hands out addresses for any name, so check versions/extensions first
+	if (HasGLVersion(1, 5))
+	{
+		LoadFunction(api.GenBuffers, "glGenBuffers");
+		LoadFunction(api.DeleteBuffers, "glDeleteBuffers");
+		LoadFunction(api.BindBuffer, "glBindBuffer");
+		LoadFunction(api.BufferData, "glBufferData");
+		LoadFunction(api.MapBuffer, "glMapBuffer");
+		LoadFunction(api.UnmapBuffer, "glUnmapBuffer");
+	}
+	api.bBuffers = api.GenBuffers != NULL && api.DeleteBuffers != NULL && api.BindBuffer != NULL &&
+		api.BufferData != NULL && api.MapBuffer != NULL && api.UnmapBuffer != NULL;
+	if (!api.bBuffers)
+		return false;
+
+	// part of 1.4, so there with 1.5
+	LoadFunction(api.MultiDrawArrays, "glMultiDrawArrays");
+
+	if (HasGLVersion(3, 0) || HasGLExtension("GL_ARB_map_buffer_range"))
+		LoadFunction(api.MapBufferRange, "glMapBufferRange");
+	api.bMapBufferRange = api.MapBufferRange != NULL;
+
+	if (api.bMapBufferRange &&
+		(HasGLVersion(4, 4) || (HasGLExtension("GL_ARB_buffer_storage") && HasGLExtension("GL_ARB_sync"))))
+	{
+		LoadFunction(api.BufferStorage, "glBufferStorage");
+		LoadFunction(api.FenceSync, "glFenceSync");
+		LoadFunction(api.ClientWaitSync, "glClientWaitSync");
+		LoadFunction(api.DeleteSync, "glDeleteSync");
+	}
+	api.bPersistentMapping = api.BufferStorage != NULL && api.FenceSync != NULL &&
+		api.ClientWaitSync != NULL && api.DeleteSync != NULL;
+
+	return true;
+}
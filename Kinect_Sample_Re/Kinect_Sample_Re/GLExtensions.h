@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+#include <GL/freeglut.h>
+
+// OpenGL entry points beyond 1.1, which opengl32.lib does not export;
+// they are looked up at runtime through glutGetProcAddress.
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER					0x8892
+#define GL_ELEMENT_ARRAY_BUFFER			0x8893
+#define GL_STREAM_DRAW					0x88E0
+#define GL_WRITE_ONLY					0x88B9
+#endif
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT				0x0002
+#define GL_MAP_INVALIDATE_BUFFER_BIT	0x0008
+#define GL_MAP_UNSYNCHRONIZED_BIT		0x0020
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT			0x0040
+#define GL_MAP_COHERENT_BIT				0x0080
+#endif
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE	0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT		0x00000001
+#define GL_TIMEOUT_EXPIRED				0x911B
+#define GL_WAIT_FAILED					0x911D
+#endif
+
+typedef void* GLsyncHandle;
+
+struct GLBufferApi
+{
+	void (APIENTRY *GenBuffers)(GLsizei n, GLuint* buffers);
+	void (APIENTRY *DeleteBuffers)(GLsizei n, const GLuint* buffers);
+	void (APIENTRY *BindBuffer)(GLenum target, GLuint buffer);
+	void (APIENTRY *BufferData)(GLenum target, ptrdiff_t size, const void* data, GLenum usage);
+	void* (APIENTRY *MapBuffer)(GLenum target, GLenum access);
+	GLboolean (APIENTRY *UnmapBuffer)(GLenum target);
+
+	// GL 1.4, may be NULL
+	void (APIENTRY *MultiDrawArrays)(GLenum mode, const GLint* first, const GLsizei* count, GLsizei drawcount);
+
+	// GL 3.0 / ARB_map_buffer_range, may be NULL
+	void* (APIENTRY *MapBufferRange)(GLenum target, ptrdiff_t offset, ptrdiff_t length, GLbitfield access);
+
+	// GL 4.4 / ARB_buffer_storage + ARB_sync, may be NULL
+	void (APIENTRY *BufferStorage)(GLenum target, ptrdiff_t size, const void* data, GLbitfield flags);
+	GLsyncHandle (APIENTRY *FenceSync)(GLenum condition, GLbitfield flags);
+	GLenum (APIENTRY *ClientWaitSync)(GLsyncHandle sync, GLbitfield flags, unsigned long long timeout);
+	void (APIENTRY *DeleteSync)(GLsyncHandle sync);
+
+	bool bBuffers;
+	bool bMapBufferRange;
+	bool bPersistentMapping;
+};
+
+// needs a current context; returns false when vertex buffers are unsupported
+bool LoadGLBufferApi(GLBufferApi& api);
@@ -0,0 +1,195 @@
+#include <math.h>
+#include <string.h>
+#include "GridMesh.h"
+#include "ParallelFor.h"
+
+// appends a strip of nCount indices to strip, joined to what is there by
+// degenerate triangles; a strip starts at an even position, so every
+// triangle keeps the winding it has on its own
+static void AppendStrip(std::vector<unsigned int>& strip, const unsigned int* pIndices, size_t nCount)
+{
+	if (nCount == 0)
+		return;
+
+	if (!strip.empty())
+	{
+		const unsigned int nLast = strip.back();
+		strip.push_back(nLast);
+		strip.push_back(pIndices[0]);
+		if (strip.size() % 2 == 1)
+			strip.push_back(pIndices[0]);
+	}
+	strip.insert(strip.end(), pIndices, pIndices + nCount);
+}
+
+GridMesh::GridMesh() :
+nTriangles(0)
+{
+}
+
+void GridMesh::Triangles(std::vector<unsigned int>& triangles) const
+{
+	triangles.clear();
+	triangles.reserve((size_t)nTriangles * 3);
+
+	for (size_t ii = 0; ii + 2 < strip.size(); ii++)
+	{
+		unsigned int a = strip[ii];
+		unsigned int b = strip[ii + 1];
+		const unsigned int c = strip[ii + 2];
+		if (a == b || b == c || a == c)
+			continue;
+
+		// every other triangle of a strip is wound the other way
+		if (ii % 2 == 1)
+		{
+			const unsigned int t = a;
+			a = b;
+			b = t;
+		}
+		triangles.push_back(a);
+		triangles.push_back(b);
+		triangles.push_back(c);
+	}
+}
+
+GridMesher::GridMesher() :
+fDepthJump(0.03f)
+{
+}
+
+GridMesher::~GridMesher()
+{
+}
+
+void GridMesher::Initialize(float fDepthJump)
+{
+	this->fDepthJump = fDepthJump;
+}
+
+void GridMesher::Build(const PointCloud& cloud, GridMesh& mesh)
+{
+	mesh.strip.clear();
+	mesh.nTriangles = 0;
+
+	const PixelRect rect = cloud.extent;
+	if (rect.Height() < 2 || rect.Width() < 2)
+		return;
+
+	if ((int)validIndex.size() < cloud.nCount)
+		validIndex.resize(cloud.nCount);
+
+	const int nBands = ParallelThreadCount();
+	if ((int)bands.size() < nBands)
+		bands.resize(nBands);
+
+	const PointList& valid = cloud.valid;
+	ParallelFor(valid.nCount, [&](int nBegin, int nEnd)
+	{
+		for (int ii = nBegin; ii < nEnd; ii++)
+			validIndex[valid.pIndex[ii]] = (unsigned int)ii;
+	});
+
+	// bands of row pairs
+	const int nPairs = rect.Height() - 1;
+	ParallelFor(nBands, [&](int nBegin, int nEnd)
+	{
+		for (int bb = nBegin; bb < nEnd; bb++)
+		{
+			MeshRows(cloud, rect,
+				rect.nTop + nPairs * bb / nBands,
+				rect.nTop + nPairs * (bb + 1) / nBands,
+				bands[bb]);
+		}
+	});
+
+	size_t nSize = 0;
+	for (int bb = 0; bb < nBands; bb++)
+		nSize += bands[bb].strip.size() + 3;
+	// with headroom, as the size changes a little from frame to frame
+	if (mesh.strip.capacity() < nSize)
+		mesh.strip.reserve(nSize + nSize / 2);
+
+	for (int bb = 0; bb < nBands; bb++)
+	{
+		if (!bands[bb].strip.empty())
+			AppendStrip(mesh.strip, &bands[bb].strip[0], bands[bb].strip.size());
+		mesh.nTriangles += bands[bb].nTriangles;
+	}
+}
+
+void GridMesher::MeshRows(const PointCloud& cloud, const PixelRect& rect, int nBegin, int nEnd, Band& band) const
+{
+	const int W = cloud.nWidth;
+	const float* pZ = cloud.pZ;
+	const unsigned int* pValidIndex = &validIndex[0];
+	const float fJump = fDepthJump;
+
+	band.strip.clear();
+	band.nTriangles = 0;
+
+	// both ends have a point and no discontinuity lies between them
+	auto Edge = [&](int a, int b) -> bool
+	{
+		const float Za = pZ[a];
+		const float Zb = pZ[b];
+		const float Z = Za < Zb ? Za : Zb;
+		return Z > 0 && fabsf(Za - Zb) <= fJump * Z * Z;
+	};
+
+	// a run is the strip of a row pair over consecutive columns:
+	// top, bottom, top, bottom, ...
+	std::vector<unsigned int>& run = band.run;
+	run.reserve(2 * rect.Width());
+
+	for (int rr = nBegin; rr < nEnd; rr++)
+	{
+		bool bOpen = false;
+		run.clear();
+
+		for (int cc = rect.nLeft; cc + 1 < rect.nRight; cc++)
+		{
+			// the 2x2 block, and its triangles (p00, p10, p01), (p01, p10, p11)
+			const int p00 = rr * W + cc;
+			const int p01 = p00 + 1;
+			const int p10 = p00 + W;
+			const int p11 = p10 + 1;
+			const bool bDiagonal = Edge(p10, p01);
+			const bool bUpper = bDiagonal && Edge(p00, p10) && Edge(p00, p01);
+			const bool bLower = bDiagonal && Edge(p01, p11) && Edge(p10, p11);
+
+			if (bUpper)
+			{
+				if (!bOpen)
+				{
+					AppendStrip(band.strip, run.empty() ? NULL : &run[0], run.size());
+					run.clear();
+					run.push_back(pValidIndex[p00]);
+					run.push_back(pValidIndex[p10]);
+				}
+				run.push_back(pValidIndex[p01]);
+				band.nTriangles++;
+
+				if (bLower)
+				{
+					run.push_back(pValidIndex[p11]);
+					band.nTriangles++;
+				}
+				bOpen = bLower;
+			}
+			else
+			{
+				bOpen = false;
+				if (bLower)
+				{
+					// on its own, wound like in a run
+					const unsigned int triangle[3] = { pValidIndex[p01], pValidIndex[p10], pValidIndex[p11] };
+					AppendStrip(band.strip, triangle, 3);
+					band.nTriangles++;
+				}
+			}
+		}
+
+		AppendStrip(band.strip, run.empty() ? NULL : &run[0], run.size());
+	}
+}
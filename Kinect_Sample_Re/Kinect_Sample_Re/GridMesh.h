@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include "PointCloud.h"
+
+// Triangles over the valid points of an organized cloud as a single
+// triangle strip: the strips of separate surface pieces are joined by
+// degenerate triangles, so the mesh draws with one glDrawElements call.
+// Indices refer to cloud.valid, the order the points are uploaded in.
+struct GridMesh
+{
+	GridMesh();
+
+	// the non-degenerate triangles, 3 indices each, consistently wound
+	void Triangles(std::vector<unsigned int>& triangles) const;
+
+	std::vector<unsigned int> strip;
+	// not counting the degenerate ones
+	int nTriangles;
+};
+
+// Connects the neighboring pixels of an organized cloud, two triangles per
+// 2x2 block, except across depth discontinuities: an edge is kept while the
+// depth difference of its ends is at most fDepthJump * Z^2 [m], following
+// the depth noise of a time-of-flight camera, which grows with the square of
+// the depth. The rows are split into bands meshed in parallel, each into its
+// own strip; the strips are joined at the end.
+class GridMesher
+{
+public:
+	GridMesher();
+	~GridMesher();
+
+	void Initialize(float fDepthJump = 0.03f);
+
+	// meshes cloud.extent
+	void Build(const PointCloud& cloud, GridMesh& mesh);
+
+	float fDepthJump;
+
+private:
+	struct Band
+	{
+		std::vector<unsigned int> strip;
+		int nTriangles;
+		// scratch of MeshRows, kept so it does not allocate per frame
+		std::vector<unsigned int> run;
+	};
+
+	void MeshRows(const PointCloud& cloud, const PixelRect& rect, int nBegin, int nEnd, Band& band) const;
+
+	GridMesher(const GridMesher&);
+	GridMesher& operator=(const GridMesher&);
+
+	// position of every valid pixel in cloud.valid
+	std::vector<unsigned int> validIndex;
+	std::vector<Band> bands;
+};
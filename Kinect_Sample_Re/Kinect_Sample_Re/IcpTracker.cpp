@@ -0,0 +1,280 @@
+#include <math.h>
+#include <string.h>
+#include "IcpTracker.h"
+#include "ParallelFor.h"
+
+// fewer pairs than this do not constrain a pose reliably
+static const int nMinPairs = 500;
+// updates below this [rad, m] end the iterations
+static const double fConvergence = 1e-5;
+
+// solves A x = b for the symmetric positive definite A, given by its upper
+// triangle row by row, with a Cholesky decomposition
+static bool SolveNormalEquations(const double pUpper[21], const double b[6], double x[6])
+{
+	double A[6][6];
+	for (int rr = 0, kk = 0; rr < 6; rr++)
+	for (int cc = rr; cc < 6; cc++, kk++)
+		A[rr][cc] = A[cc][rr] = pUpper[kk];
+
+	// A = L L^T, L stored in the lower triangle of A
+	for (int jj = 0; jj < 6; jj++)
+	{
+		double fDiagonal = A[jj][jj];
+		for (int kk = 0; kk < jj; kk++)
+			fDiagonal -= A[jj][kk] * A[jj][kk];
+		if (fDiagonal <= 1e-12)
+			return false;
+		A[jj][jj] = sqrt(fDiagonal);
+
+		for (int ii = jj + 1; ii < 6; ii++)
+		{
+			double fSum = A[ii][jj];
+			for (int kk = 0; kk < jj; kk++)
+				fSum -= A[ii][kk] * A[jj][kk];
+			A[ii][jj] = fSum / A[jj][jj];
+		}
+	}
+
+	// L y = b, then L^T x = y
+	double y[6];
+	for (int ii = 0; ii < 6; ii++)
+	{
+		double fSum = b[ii];
+		for (int kk = 0; kk < ii; kk++)
+			fSum -= A[ii][kk] * y[kk];
+		y[ii] = fSum / A[ii][ii];
+	}
+	for (int ii = 5; ii >= 0; ii--)
+	{
+		double fSum = y[ii];
+		for (int kk = ii + 1; kk < 6; kk++)
+			fSum -= A[kk][ii] * x[kk];
+		x[ii] = fSum / A[ii][ii];
+	}
+	return true;
+}
+
+IcpTracker::IcpTracker() :
+nMaxIterations(10),
+fMaxDistance(0.05f),
+nMaxGridWidth(512),
+iSampleStride(2),
+bKeepReference(false),
+nIterations(0),
+nInliers(0),
+fRmsError(0),
+bHasReference(false),
+nReferenceWidth(0),
+nReferenceHeight(0)
+{
+	referencePose = RigidTransform::Identity();
+	lastRelative = RigidTransform::Identity();
+	memset(&referenceCamera, 0, sizeof(referenceCamera));
+}
+
+IcpTracker::~IcpTracker()
+{
+}
+
+void IcpTracker::Reset()
+{
+	bHasReference = false;
+	referencePose = RigidTransform::Identity();
+	lastRelative = RigidTransform::Identity();
+}
+
+bool IcpTracker::Track(const PointCloud& cloud, const NormalMap& normals, const GridCamera& camera, RigidTransform& pose)
+{
+	const int iStep = (cloud.nWidth + nMaxGridWidth - 1) / nMaxGridWidth;
+
+	nIterations = 0;
+	nInliers = 0;
+	fRmsError = 0;
+
+	if (!bHasReference)
+	{
+		SetReference(cloud, normals, camera, iStep);
+		bHasReference = true;
+		referencePose = RigidTransform::Identity();
+		lastRelative = RigidTransform::Identity();
+		pose = referencePose;
+		return true;
+	}
+
+	const int iSourceStep = iStep * iSampleStride;
+	const int nSourceRows = (cloud.nHeight + iSourceStep - 1) / iSourceStep;
+	const int nBands = ParallelThreadCount();
+	if ((int)partials.size() < nBands)
+		partials.resize(nBands);
+
+	// reference <- cloud; a cloud aligned to a fixed reference moves on from
+	// where the last one was
+	RigidTransform T = bKeepReference ? lastRelative : RigidTransform::Identity();
+	bool bSucceeded = false;
+
+	for (int iteration = 0; iteration < nMaxIterations; iteration++)
+	{
+		ParallelFor(nBands, [&](int nBegin, int nEnd)
+		{
+			for (int bb = nBegin; bb < nEnd; bb++)
+				Accumulate(cloud, iSourceStep, T, nSourceRows * bb / nBands, nSourceRows * (bb + 1) / nBands, partials[bb]);
+		});
+
+		Partial total;
+		memset(&total, 0, sizeof(total));
+		for (int bb = 0; bb < nBands; bb++)
+		{
+			for (int kk = 0; kk < 21; kk++)	total.A[kk] += partials[bb].A[kk];
+			for (int kk = 0; kk < 6; kk++)	total.b[kk] += partials[bb].b[kk];
+			total.fError += partials[bb].fError;
+			total.nPairs += partials[bb].nPairs;
+		}
+
+		nInliers = total.nPairs;
+		fRmsError = total.nPairs > 0 ? (float)sqrt(total.fError / total.nPairs) : 0.0f;
+
+		double x[6];
+		double b[6];
+		for (int kk = 0; kk < 6; kk++)
+			b[kk] = -total.b[kk];
+		if (total.nPairs < nMinPairs || !SolveNormalEquations(total.A, b, x))
+		{
+			bSucceeded = false;
+			break;
+		}
+
+		T = RigidTransform::FromTwist(x[0], x[1], x[2], x[3], x[4], x[5]) * T;
+		nIterations++;
+		bSucceeded = true;
+
+		if (x[0] * x[0] + x[1] * x[1] + x[2] * x[2] < fConvergence * fConvergence &&
+			x[3] * x[3] + x[4] * x[4] + x[5] * x[5] < fConvergence * fConvergence)
+			break;
+	}
+
+	if (bSucceeded)
+	{
+		pose = referencePose * T;
+		lastRelative = T;
+	}
+	else
+		pose = referencePose;
+
+	if (!bKeepReference || !bSucceeded)
+	{
+		SetReference(cloud, normals, camera, iStep);
+		referencePose = pose;
+		lastRelative = RigidTransform::Identity();
+	}
+
+	return bSucceeded;
+}
+
+void IcpTracker::SetReference(const PointCloud& cloud, const NormalMap& normals, const GridCamera& camera, int iStep)
+{
+	nReferenceWidth = (cloud.nWidth + iStep - 1) / iStep;
+	nReferenceHeight = (cloud.nHeight + iStep - 1) / iStep;
+
+	// pixel (col, row) of the cloud is (col / iStep, row / iStep) here
+	referenceCamera.fFocalX = camera.fFocalX / iStep;
+	referenceCamera.fFocalY = camera.fFocalY / iStep;
+	referenceCamera.fPrincipalX = camera.fPrincipalX / iStep;
+	referenceCamera.fPrincipalY = camera.fPrincipalY / iStep;
+
+	const int nCount = nReferenceWidth * nReferenceHeight;
+	referenceX.resize(nCount);
+	referenceY.resize(nCount);
+	referenceZ.resize(nCount);
+	referenceNX.resize(nCount);
+	referenceNY.resize(nCount);
+	referenceNZ.resize(nCount);
+
+	for (int rr = 0; rr < nReferenceHeight; rr++)
+	{
+		for (int cc = 0; cc < nReferenceWidth; cc++)
+		{
+			const int idx = rr * iStep * cloud.nWidth + cc * iStep;
+			const int iOut = rr * nReferenceWidth + cc;
+			referenceX[iOut] = cloud.pX[idx];
+			referenceY[iOut] = cloud.pY[idx];
+			// the normals are only defined where there is a point
+			referenceZ[iOut] = cloud.pZ[idx];
+			referenceNX[iOut] = cloud.pZ[idx] > 0 ? normals.pX[idx] : 0.0f;
+			referenceNY[iOut] = cloud.pZ[idx] > 0 ? normals.pY[idx] : 0.0f;
+			referenceNZ[iOut] = cloud.pZ[idx] > 0 ? normals.pZ[idx] : 0.0f;
+		}
+	}
+}
+
+void IcpTracker::Accumulate(const PointCloud& cloud, int iStep, const RigidTransform& T, int nBegin, int nEnd, Partial& partial) const
+{
+	memset(&partial, 0, sizeof(partial));
+
+	const GridCamera& cam = referenceCamera;
+	const float fMaxDistance2 = fMaxDistance * fMaxDistance;
+
+	for (int ss = nBegin; ss < nEnd; ss++)
+	{
+		// a row is summed in floats, the rows in doubles
+		float A[21];
+		float b[6];
+		float fError = 0;
+		memset(A, 0, sizeof(A));
+		memset(b, 0, sizeof(b));
+
+		const int rr = ss * iStep;
+		for (int cc = 0; cc < cloud.nWidth; cc += iStep)
+		{
+			const int idx = rr * cloud.nWidth + cc;
+			if (cloud.pZ[idx] <= 0)
+				continue;
+
+			// into the reference camera, then onto its grid
+			float px, py, pz;
+			T.Apply(cloud.pX[idx], cloud.pY[idx], cloud.pZ[idx], px, py, pz);
+			if (pz <= 0)
+				continue;
+			const float fInvZ = 1.0f / pz;
+			const int u = (int)floorf(cam.fFocalX * px * fInvZ + cam.fPrincipalX + 0.5f);
+			const int v = (int)floorf(cam.fPrincipalY - cam.fFocalY * py * fInvZ + 0.5f);
+			if (u < 0 || u >= nReferenceWidth || v < 0 || v >= nReferenceHeight)
+				continue;
+
+			const int iRef = v * nReferenceWidth + u;
+			const float qz = referenceZ[iRef];
+			const float nx = referenceNX[iRef];
+			const float ny = referenceNY[iRef];
+			const float nz = referenceNZ[iRef];
+			if (qz <= 0 || (nx == 0 && ny == 0 && nz == 0))
+				continue;
+
+			const float dx = px - referenceX[iRef];
+			const float dy = py - referenceY[iRef];
+			const float dz = pz - qz;
+			if (dx * dx + dy * dy + dz * dz > fMaxDistance2)
+				continue;
+
+			// residual and its derivative by (rotation, translation)
+			const float r = dx * nx + dy * ny + dz * nz;
+			const float J[6] = {
+				py * nz - pz * ny,
+				pz * nx - px * nz,
+				px * ny - py * nx,
+				nx, ny, nz };
+
+			for (int ii = 0, kk = 0; ii < 6; ii++)
+			{
+				for (int jj = ii; jj < 6; jj++, kk++)
+					A[kk] += J[ii] * J[jj];
+				b[ii] += J[ii] * r;
+			}
+			fError += r * r;
+			partial.nPairs++;
+		}
+
+		for (int kk = 0; kk < 21; kk++)	partial.A[kk] += A[kk];
+		for (int kk = 0; kk < 6; kk++)	partial.b[kk] += b[kk];
+		partial.fError += fError;
+	}
+}
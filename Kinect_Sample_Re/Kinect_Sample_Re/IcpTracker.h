@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+#include "PointCloud.h"
+#include "RigidTransform.h"
+
+// Pinhole model of the pixel grid of an organized cloud:
+// col = fFocalX X / Z + fPrincipalX, row = fPrincipalY - fFocalY Y / Z.
+struct GridCamera
+{
+	float fFocalX;
+	float fFocalY;
+	float fPrincipalX;
+	float fPrincipalY;
+};
+
+// Frame to frame pose tracking by point-to-plane ICP. Correspondences come
+// from projective data association: a point, moved by the current estimate,
+// is projected into the reference grid and paired with the reference point
+// at that pixel, so no search structure is needed. Every iteration sums the
+// 6x6 normal equations of the linearized point-to-plane error over bands of
+// rows in parallel, then solves them on one thread.
+//
+// Large clouds are tracked on a grid decimated to at most nMaxGridWidth
+// columns, and every iSampleStride-th point of that grid in both
+// directions is aligned. Lens distortion is ignored in the projection; it
+// only shifts which neighbor a point is paired with.
+class IcpTracker
+{
+public:
+	IcpTracker();
+	~IcpTracker();
+
+	// the next cloud becomes the reference, at the identity pose
+	void Reset();
+
+	// Aligns cloud to the reference and returns its pose relative to the
+	// first cloud since Reset(). Unless bKeepReference, cloud (whose normals
+	// must be in normals) then becomes the reference. false when the
+	// alignment failed; pose is then the reference's pose and tracking goes
+	// on from cloud.
+	bool Track(const PointCloud& cloud, const NormalMap& normals, const GridCamera& camera, RigidTransform& pose);
+
+	int nMaxIterations;
+	// pairs further apart [m] are not used
+	float fMaxDistance;
+	int nMaxGridWidth;
+	int iSampleStride;
+	// align every cloud to the first one instead of to the previous one
+	bool bKeepReference;
+
+	// of the last Track()
+	int nIterations;
+	int nInliers;
+	float fRmsError;
+
+private:
+	// upper triangle of A (21), b (6), sum of squared residuals, pairs
+	struct Partial
+	{
+		double A[21];
+		double b[6];
+		double fError;
+		int nPairs;
+	};
+
+	void SetReference(const PointCloud& cloud, const NormalMap& normals, const GridCamera& camera, int iStep);
+	void Accumulate(const PointCloud& cloud, int iStep, const RigidTransform& T, int nBegin, int nEnd, Partial& partial) const;
+
+	IcpTracker(const IcpTracker&);
+	IcpTracker& operator=(const IcpTracker&);
+
+	bool bHasReference;
+	// pose of the reference relative to the first cloud
+	RigidTransform referencePose;
+	// last alignment to the reference, the next one's starting point
+	RigidTransform lastRelative;
+
+	// decimated reference grid
+	int nReferenceWidth;
+	int nReferenceHeight;
+	GridCamera referenceCamera;
+	std::vector<float> referenceX;
+	std::vector<float> referenceY;
+	std::vector<float> referenceZ;
+	std::vector<float> referenceNX;
+	std::vector<float> referenceNY;
+	std::vector<float> referenceNZ;
+
+	std::vector<Partial> partials;
+};
@@ -1,5 +1,13 @@
-#include <gl\freeglut.h>		// OpenGL header files
+#include <string.h>
+#include <utility>
+#include <new>
 #include "KinectBasic.h"
+#include "DepthKernels.h"
+#include "BackProjection.h"
+#include "KinectFrameSource.h"
+#include "ReplayFrameSource.h"
+#include "CompressedRecording.h"
+#include "QueryTimeCheck.h"
 
 const int KinectBasic::nDepthWidth = 512;
 const int KinectBasic::nDepthHeight = 424;
@@ -11,117 +19,233 @@ const int KinectBasic::nDepthCount = nDepthWidth * nDepthHeight;
 const int KinectBasic::nColorCount = nColorWidth * nColorHeight;
 const int KinectBasic::nInfraredCount = nInfraredWidth * nInfraredHeight;
 
+CloudFrame::CloudFrame() :
+nTime(0),
+nHeapAllocations(0),
+bNormals(false),
+bMeshed(false),
+bTracked(false),
+bDownsampled(false),
+bAccumulated(false),
+bIndexed(false),
+bTiled(false),
+bCompact(false)
+{
+	pose = RigidTransform::Identity();
+}
+
+void CloudFrame::Allocate(FrameArena* pArena)
+{
+	cloud.Allocate(KinectBasic::nColorWidth, KinectBasic::nColorHeight, pArena);
+}
+
+size_t CloudFrame::ArenaFootprint()
+{
+	return PointCloud::ArenaFootprint(KinectBasic::nColorWidth, KinectBasic::nColorHeight);
+}
+
+// what KinectBasic takes from its arena
+static size_t FrameArenaSize()
+{
+	const size_t nDepthCount = KinectBasic::nDepthCount;
+	const size_t nColorCount = KinectBasic::nColorCount;
+	return
+		2 * FrameArena::Footprint(sizeof(unsigned short)* nDepthCount) +
+		FrameArena::Footprint(sizeof(unsigned char)* nDepthCount) +
+		FrameArena::Footprint(sizeof(unsigned char)* KinectBasic::nInfraredCount) +
+		FrameArena::Footprint(sizeof(CameraSpacePoint)* nColorCount) +
+		FrameArena::Footprint(sizeof(DepthSpacePoint)* nDepthCount) +
+		FrameArena::Footprint(sizeof(ColorSpacePoint)* nDepthCount) +
+		FrameArena::Footprint(sizeof(unsigned int)* nDepthCount) +
+		TripleBuffer<CloudFrame>::nSlots * CloudFrame::ArenaFootprint();
+}
+
 KinectBasic::KinectBasic() :
-pKinectSensor(NULL),
-pCoordinateMapper(NULL),
-pMultiSourceFrameReader(NULL),
+pFrameSource(NULL),
+pRecorder(NULL),
 pDepthBuffer(NULL),
+pFilteredDepthBuffer(NULL),
 pDepthData(NULL),
-pColorBuffer(NULL),
-pColorData(NULL),
-pInfraredBuffer(NULL),
 pInfraredData(NULL),
 pCameraSpacePoints(NULL),
 pColorSpacePoints(NULL),
 pDepthSpacePoints(NULL),
+pRegisteredColor(NULL),
 oPickBodyIndex(false),
 oThresholdDepth(true),
 oThresholdInfrared(true),
+oDepthCloud(false),
+oNonlocalMeans(false),
+oNormals(false),
+oMesh(false),
+oTracking(false),
+oResetTracking(false),
+oVoxelGrid(false),
+fVoxelLeafSize(0.01f),
+oAccumulate(false),
+oResetVolume(false),
+oSelect(false),
+oLevelOfDetail(true),
+oCompact(false),
 iPickedBodyIndex(255),
 iThresholdDepth(1200),
 iThresholdInfrared(4000),
+bIntrinsicsPending(false),
 nStartTime(0),
 nFrameCounter(0)
 {
-	pDepthBuffer = new unsigned short[nDepthCount];
-	pDepthData = new unsigned char[nDepthCount];
-	pColorBuffer = new RGBQUAD[nColorCount];
-	pColorData = new unsigned char[nColorCount * 3];
-	pInfraredBuffer = new unsigned short[nInfraredCount];
-	pInfraredData = new unsigned char[nInfraredCount];
-
-	pCameraSpacePoints = new CameraSpacePoint[nColorCount];
-	pDepthSpacePoints = new DepthSpacePoint[nDepthCount];
-
-	memset(pDepthBuffer, 0, sizeof(unsigned short)* nDepthCount);
-	memset(pDepthData, 0, sizeof(unsigned char)* nDepthCount);
-	memset(pColorBuffer, 0, sizeof(RGBQUAD)* nColorCount);
-	memset(pColorData, 0, sizeof(unsigned char)* nColorCount * 3);
-	memset(pInfraredBuffer, 0, sizeof(unsigned short)* nInfraredCount);
-	memset(pInfraredData, 0, sizeof(unsigned char)* nInfraredCount);
-	memset(pCameraSpacePoints, 0, sizeof(CameraSpacePoint)* nColorCount);
-	memset(pDepthSpacePoints, 0, sizeof(DepthSpacePoint)* nDepthCount);
-
+	// one block, zeroed by the OS as it is touched instead of memset up
+	// front; large pages when the OS grants them
+	if (!arena.Reserve(FrameArenaSize(), true))
+		throw std::bad_alloc();
+
+	pDepthBuffer = arena.AllocateArray<unsigned short>(nDepthCount);
+	pFilteredDepthBuffer = arena.AllocateArray<unsigned short>(nDepthCount);
+	pDepthData = arena.AllocateArray<unsigned char>(nDepthCount);
+	pInfraredData = arena.AllocateArray<unsigned char>(nInfraredCount);
+
+	pCameraSpacePoints = arena.AllocateArray<CameraSpacePoint>(nColorCount);
+	pDepthSpacePoints = arena.AllocateArray<DepthSpacePoint>(nDepthCount);
+	pColorSpacePoints = arena.AllocateArray<ColorSpacePoint>(nDepthCount);
+	pRegisteredColor = arena.AllocateArray<unsigned int>(nDepthCount);
+	depthExtent = PixelRect::Full(0, 0);
+
+	for (int ii = 0; ii < TripleBuffer<CloudFrame>::nSlots; ii++)
+		frames.Slot(ii).Allocate(&arena);
+
+	intrinsics = SensorIntrinsics::Default();
+	colorRays.Initialize(intrinsics, nColorWidth, nColorHeight);
+	depthRays.Initialize(intrinsics, nDepthWidth, nDepthHeight);
+
+	nlmFilter.Initialize(nDepthWidth, nDepthHeight);
+
+	// 2 m cube of 4 mm voxels in front of the sensor, at most 64 MB of blocks
+	volume.Initialize(0.004f, 64, 64, 64, -1.024f, -1.024f, 0.3f, 16384);
+
+#ifdef _DEBUG
+	// the vectorized thresholding must match the scalar passes bit for bit
+	if (!VerifyThresholdKernels(nDepthCount))
+		cerr << "Threshold kernel (" << ThresholdKernelName() << ") does not match the scalar path" << endl;
+	if (!VerifyPackKernels(nColorCount))
+		cerr << "Compact point packing does not match the scalar path" << endl;
+#endif
 }
 
 KinectBasic::~KinectBasic()
 {
-	if (pDepthBuffer != NULL)	delete[] pDepthBuffer;
-	if (pDepthData != NULL)		delete[] pDepthData;
-	if (pColorBuffer != NULL)	delete[] pColorBuffer;
-	if (pColorData != NULL)		delete[] pColorData;
-	if (pInfraredBuffer != NULL)	delete[] pInfraredBuffer;
-	if (pInfraredData != NULL)	delete[] pInfraredData;
+	// the buffers go with the arena
+	StopRecording();
 
-	if (pCameraSpacePoints != NULL)	delete[] pColorSpacePoints;
-	if (pDepthSpacePoints != NULL)	delete[] pDepthSpacePoints;
+	if (pFrameSource != NULL)	delete pFrameSource;
+}
 
-	SafeRelease(pCoordinateMapper);
-	SafeRelease(pMultiSourceFrameReader);
+HRESULT KinectBasic::InitializeDefaultSensor()
+{
+#ifdef _WIN32
+	if (pFrameSource != NULL)	delete pFrameSource;
+	pFrameSource = new KinectFrameSource();
 
-	if (pKinectSensor != NULL)	pKinectSensor->Close();
-	SafeRelease(pKinectSensor);
+	HRESULT hr = pFrameSource->Open();
+	if (SUCCEEDED(hr))
+		InitializeIntrinsics();
+
+	return hr;
+#else
+	cerr << "No ready Kinect found" << endl;
+	return E_FAIL;
+#endif
 }
 
-HRESULT KinectBasic::InitializeDefaultSensor()
+HRESULT KinectBasic::InitializeReplay(const char* szPath, bool bRealTime, int nStartFrame)
 {
-	HRESULT hr;
+	if (pFrameSource != NULL)	delete pFrameSource;
+	ReplayFrameSource* pReplay = new ReplayFrameSource(szPath, bRealTime);
+	pFrameSource = pReplay;
 
-	hr = GetDefaultKinectSensor(&pKinectSensor);
-	if (FAILED(hr))
-	{
-		return hr;
-	}
+	HRESULT hr = pFrameSource->Open();
+	if (SUCCEEDED(hr) && nStartFrame > 0)
+		hr = pReplay->Seek(nStartFrame);
+	if (SUCCEEDED(hr))
+		InitializeIntrinsics();
 
-	if (pKinectSensor)
-	{
-		// Initialize the Kinect and get coordinate mapper and the fream reader
-		if (SUCCEEDED(hr))
-		{
-			hr = pKinectSensor->get_CoordinateMapper(&pCoordinateMapper);
-		}
+	return hr;
+}
 
-		if (SUCCEEDED(hr))
-		{
-			hr = pKinectSensor->Open();
-		}
+void KinectBasic::InitializeIntrinsics()
+{
+	HRESULT hr = pFrameSource->GetSensorIntrinsics(intrinsics);
+	bIntrinsicsPending = hr == E_PENDING;
+	if (FAILED(hr) || !intrinsics.IsValid())
+		intrinsics = SensorIntrinsics::Default();
+
+	colorRays.Initialize(intrinsics, nColorWidth, nColorHeight);
+
+	// prefer the sensor's table, which corrects lens distortion
+	PointF* pTable = new PointF[nDepthCount];
+	hr = pFrameSource->GetDepthFrameToCameraSpaceTable(nDepthCount, pTable);
+	if (hr == E_PENDING)
+		bIntrinsicsPending = true;
+	if (SUCCEEDED(hr))
+		depthRays.Initialize(pTable, nDepthWidth, nDepthHeight);
+	else
+		depthRays.Initialize(intrinsics, nDepthWidth, nDepthHeight);
+	delete[] pTable;
+}
 
-		if (SUCCEEDED(hr))
-		{
-			hr = pKinectSensor->OpenMultiSourceFrameReader(
-				FrameSourceTypes::FrameSourceTypes_Depth |
-				FrameSourceTypes::FrameSourceTypes_Color |
-				FrameSourceTypes::FrameSourceTypes_Infrared |
-				FrameSourceTypes::FrameSourceTypes_BodyIndex,
-				&pMultiSourceFrameReader);
-		}
-	}
+HRESULT KinectBasic::StartRecording(const char* szPath)
+{
+	if (pFrameSource == NULL)
+		return E_FAIL;
 
-	if (pKinectSensor == NULL || FAILED(hr))
+	// the header takes the intrinsics the frames are processed with, the
+	// defaults if the sensor has not streamed yet
+	HRESULT hr;
+	StopRecording();
+	const size_t nLength = strlen(szPath);
+	if (nLength > 4 && strcmp(szPath + nLength - 4, ".kfz") == 0)
 	{
-		cerr << "No ready Kinect found" << endl;
-		return E_FAIL;
+		CompressedRecordingWriter* pWriter = new CompressedRecordingWriter();
+		pRecorder = pWriter;
+		hr = pWriter->Open(
+			szPath,
+			nDepthWidth, nDepthHeight,
+			nColorWidth, nColorHeight,
+			intrinsics);
+	}
+	else
+	{
+		RecordingWriter* pWriter = new RecordingWriter();
+		pRecorder = pWriter;
+		hr = pWriter->Open(
+			szPath,
+			nDepthWidth, nDepthHeight,
+			nColorWidth, nColorHeight,
+			intrinsics);
 	}
+	if (FAILED(hr))
+		StopRecording();
 
 	return hr;
 }
 
+void KinectBasic::StopRecording()
+{
+	if (pRecorder != NULL)	delete pRecorder;
+	pRecorder = NULL;
+}
+
 void KinectBasic::ProcessFrame(
 	INT64 nTime,
 	const UINT16* pDepthSrc,
 	const UINT16* pInfraredSrc,
+	const RGBQUAD* pColorSrc,
 	const BYTE* pBodyIndexSrc)
 {
+	const long long nAllocationsBefore = ThreadHeapAllocationCount();
+	CloudFrame& frame = frames.Back();
+	PointCloud& cp = frame.cloud;
+	frame.nTime = nTime;
+
 	// process time
 	if (nStartTime == 0) nStartTime = nTime;
 	else if (nStartTime != nTime)
@@ -129,342 +253,348 @@ void KinectBasic::ProcessFrame(
 		nFrameCounter++;
 	}
 
-	memcpy(pDepthBuffer, pDepthSrc, sizeof(UINT16)* nDepthCount);
-
-	// copy infrared data
-	memcpy(pInfraredBuffer, pInfraredSrc, sizeof(UINT16)* nInfraredCount);
-
-	// thresholding depth data by depth
-	if (oThresholdDepth)
+	// with a body picked, only the pixels of that body are processed: its
+	// bounding box is thresholded and back-projected, the rest stays zero
+	const bool bPickBody = oPickBodyIndex && pBodyIndexSrc != NULL;
+	const BYTE iBody = (BYTE)iPickedBodyIndex;
+	PixelRect roi = PixelRect::Full(nDepthWidth, nDepthHeight);
+	if (bPickBody)
+		FindBodyRect(pBodyIndexSrc, nDepthWidth, nDepthHeight, iBody, roi);
+
+	// threshold depth by depth and infrared, and make the 8-bit depth and
+	// infrared images, in a single pass (inside the roi only, when picking)
+	ThresholdParams params;
+	params.oThresholdDepth = oThresholdDepth;
+	params.oThresholdInfrared = oThresholdInfrared;
+	params.iThresholdDepth = iThresholdDepth;
+	params.iThresholdInfrared = iThresholdInfrared;
 	{
-		for (int register ii = 0; ii < nDepthCount; ii++)
-		if (pDepthBuffer[ii] < 0 || pDepthBuffer[ii] > iThresholdDepth)
-			pDepthBuffer[ii] = 0;
+		TIME_SCOPE(TIME_THRESHOLD);
+		if (bPickBody)
+		{
+			if (!roi.Contains(depthExtent))
+				ClearDepthRect(pDepthBuffer, nDepthWidth, depthExtent);
+			ThresholdDepthInfraredRect(
+				pDepthSrc,
+				pInfraredSrc,
+				pBodyIndexSrc,
+				iBody,
+				nDepthWidth,
+				roi,
+				params,
+				pDepthBuffer,
+				pDepthData,
+				pInfraredData);
+		}
+		else
+		{
+			ThresholdDepthInfrared(
+				pDepthSrc,
+				pInfraredSrc,
+				nDepthCount,
+				params,
+				pDepthBuffer,
+				pDepthData,
+				pInfraredData);
+		}
+		depthExtent = roi;
 	}
 
-	// thresholding depth data by infrared
-	if (oThresholdInfrared)
+	// denoise the thresholded depth; everything below uses the result
+	if (oNonlocalMeans)
 	{
-		for (int register ii = 0; ii < nDepthCount; ii++)
-		{
-			if (pInfraredBuffer[ii] < iThresholdInfrared)
-				pDepthBuffer[ii] = 0;
-		}
+		TIME_SCOPE(TIME_FILTER);
+		nlmFilter.Filter(pDepthBuffer, pFilteredDepthBuffer);
+		swap(pDepthBuffer, pFilteredDepthBuffer);
+		depthExtent = PixelRect::Full(nDepthWidth, nDepthHeight);
 	}
 
 	HRESULT hr;
 
-	// convert points to camera space
-	hr = pCoordinateMapper->MapColorFrameToCameraSpace(
-		nDepthCount,
-		pDepthBuffer,
-		nColorCount,
-		pCameraSpacePoints);
-
-
-	// recompute x, y using z and focal length
-	//focal length [ 1063.018  1065.133 ]  [ 1.880  1.889 ]
-	//principal point [ 962.373  526.689 ]  [ 1.085  0.885 ]
-	//distortion [ 0.042369  -0.037696  -0.002894  0.000978 ]  [ 0.002178  0.009347  0.000238  0.000308 ]
-	float fl_x = 1063.118;
-	float fl_y = 1065.233;
-	float pp_x = 962.473;
-	float pp_y = 526.789;
-
-	for (int register rr = 0; rr < nColorHeight; rr++)
-	for (int register cc = 0; cc < nColorWidth; cc++)
+	// a picked body is always a depth-resolution cloud: the color mode maps
+	// every color pixel, however few of them the body covers
+	const bool bDepthCloud = oDepthCloud || bPickBody;
+	if (bDepthCloud)
 	{
-		float Z = pCameraSpacePoints[rr * nColorWidth + cc].Z;
-		cp.index[rr][cc].Z = Z;
-		if (Z > 0)
+		// register depth to color, then back-project the depth pixels
+		TIME_START(tMapping);
+		hr = pFrameSource->MapDepthFrameToColorSpace(
+			nDepthCount,
+			pDepthBuffer,
+			nDepthCount,
+			pColorSpacePoints);
+		TIME_STOP(tMapping, TIME_MAPPING);
+		if (FAILED(hr))
 		{
-			cp.index[rr][cc].X = (cc - pp_x) * Z / fl_x;
-			cp.index[rr][cc].Y = -(rr - pp_y) * Z / fl_y;
+			cout << "ProcessFrame failed." << endl;
+			return;
 		}
+
+		TIME_SCOPE(TIME_BACKPROJECTION);
+		cp.Reshape(nDepthWidth, nDepthHeight);
+		BackProjectDepthRect(depthRays, pDepthBuffer, pColorSpacePoints, pColorSrc, nColorWidth, nColorHeight, roi, cp);
 	}
-	
-	if (SUCCEEDED(hr))
+	else
 	{
-		// process depth
-		for (int ii = 0; ii < nDepthCount; ii++)
-		{
-			pDepthBuffer[ii] = (pDepthBuffer[ii] & 0xfff8) >> 3;
-			pDepthData[ii] = pDepthBuffer[ii] % 256;
-		}
-
-		// process infrared
-		for (int ii = 0; ii < nInfraredCount; ii++)
+		// convert points to camera space
+		TIME_START(tMapping);
+		hr = pFrameSource->MapColorFrameToCameraSpace(
+			nDepthCount,
+			pDepthBuffer,
+			nColorCount,
+			pCameraSpacePoints);
+		TIME_STOP(tMapping, TIME_MAPPING);
+		if (FAILED(hr))
 		{
-			pInfraredBuffer[ii] = pInfraredBuffer[ii] >> 8;
-			pInfraredData[ii] = pInfraredBuffer[ii] % 256;
+			cout << "ProcessFrame failed." << endl;
+			return;
 		}
 
-		// process color: convert to RGB
-		int idx_char = 0;
-		int idx_quad = 0;
-		for (int rr = 0; rr < nColorHeight; rr++)
-		{
-			for (int cc = 0; cc < nColorWidth; cc++, idx_quad++)
-			{
-				this->pColorData[idx_char++] = pColorBuffer[idx_quad].rgbBlue;
-				this->pColorData[idx_char++] = pColorBuffer[idx_quad].rgbGreen;
-				this->pColorData[idx_char++] = pColorBuffer[idx_quad].rgbRed;
-			}
-		}
+		// recompute x, y using z and the color camera rays, attach the colors
+		// and collect the valid points
+		TIME_SCOPE(TIME_BACKPROJECTION);
+		cp.Reshape(nColorWidth, nColorHeight);
+		BackProjectColorFrame(colorRays, pCameraSpacePoints, pColorSrc, cp);
 	}
-	else cout << "ProcessFrame failed." << endl;
-}
 
-void KinectBasic::Update()
-{
-	if (pMultiSourceFrameReader == NULL)
+	// normals of the organized cloud, for lighting and the surface stages;
+	// tracking aligns to the normals of the previous frame
+	const bool bTracking = oTracking;
+	frame.bNormals = oNormals || bTracking;
+	if (frame.bNormals)
 	{
-		return;
+		TIME_SCOPE(TIME_NORMALS);
+		normalEstimator.Compute(cp, frame.normals);
 	}
 
-	IMultiSourceFrame* pMultiSourceFrame = NULL;
-	IDepthFrame* pDepthFrame = NULL;
-	IColorFrame* pColorFrame = NULL;
-	IInfraredFrame* pInfraredFrame = NULL;
-	IBodyIndexFrame* pBodyIndexFrame = NULL;
+	// where the sensor is now, relative to the first tracked frame
+	frame.bTracked = bTracking;
+	if (frame.bTracked)
+	{
+		TIME_SCOPE(TIME_TRACKING);
+		if (oResetTracking.exchange(false))
+			tracker.Reset();
+
+		GridCamera camera;
+		camera.fFocalX = bDepthCloud ? intrinsics.fDepthFocalX : intrinsics.fColorFocalX;
+		camera.fFocalY = bDepthCloud ? intrinsics.fDepthFocalY : intrinsics.fColorFocalY;
+		camera.fPrincipalX = bDepthCloud ? intrinsics.fDepthPrincipalX : intrinsics.fColorPrincipalX;
+		camera.fPrincipalY = bDepthCloud ? intrinsics.fDepthPrincipalY : intrinsics.fColorPrincipalY;
+		tracker.Track(cp, frame.normals, camera, frame.pose);
+	}
 
-	HRESULT hr = pMultiSourceFrameReader->AcquireLatestFrame(&pMultiSourceFrame);
-	if (FAILED(hr))
-		printf("AcquireLatestFrame(&pMultiSourceFrame) failed.\n");
+	// triangles between neighboring pixels, torn at depth discontinuities
+	frame.bMeshed = oMesh;
+	if (frame.bMeshed)
+	{
+		TIME_SCOPE(TIME_MESH);
+		mesher.Build(cp, frame.mesh);
+	}
 
-	// acquire depth frame
-	if (SUCCEEDED(hr))
+	// one averaged point per occupied voxel
+	frame.bDownsampled = oVoxelGrid;
+	if (frame.bDownsampled)
 	{
-		IDepthFrameReference* pDepthFrameReference = NULL;
+		TIME_SCOPE(TIME_VOXEL_GRID);
+		voxelGrid.Downsample(cp.valid, fVoxelLeafSize, frame.downsampled);
+	}
 
-		hr = pMultiSourceFrame->get_DepthFrameReference(&pDepthFrameReference);
-		if (FAILED(hr))
-			printf("get_DepthFrameReference(&pDepthFrameReference) failed.\n");
+	// fuse the depth frame into the TSDF volume
+	frame.bAccumulated = oAccumulate;
+	if (frame.bAccumulated)
+	{
+		TIME_SCOPE(TIME_FUSION);
+		if (oResetVolume.exchange(false))
+			volume.Reset();
 
+		// the color mode does not register depth to color by itself
+		if (!bDepthCloud)
+			hr = pFrameSource->MapDepthFrameToColorSpace(nDepthCount, pDepthBuffer, nDepthCount, pColorSpacePoints);
 		if (SUCCEEDED(hr))
-		{
-			hr = pDepthFrameReference->AcquireFrame(&pDepthFrame);
-			if (FAILED(hr))
-				printf("AcquireFrame(&pDepthFrame) failed.\n");
-		}
-
-		SafeRelease(pDepthFrameReference);
+			RegisterColorToDepth(pDepthBuffer, pColorSpacePoints, nDepthCount, pColorSrc, nColorWidth, nColorHeight, pRegisteredColor);
+
+		volume.Integrate(
+			pDepthBuffer,
+			SUCCEEDED(hr) ? pRegisteredColor : NULL,
+			nDepthWidth, nDepthHeight,
+			depthRays.pRayX, depthRays.pRayY,
+			intrinsics);
+		volume.ExtractSurface(frame.accumulated);
 	}
 
-	// acquire color frame
-	if (SUCCEEDED(hr))
+	// index what is shown, so the renderer can select from it
+	frame.bIndexed = oSelect;
+	if (frame.bIndexed)
 	{
-		IColorFrameReference* pColorFrameReference = NULL;
-
-		hr = pMultiSourceFrame->get_ColorFrameReference(&pColorFrameReference);
-		if (FAILED(hr))
-			printf("get_ColorFrameReference(&pColorFrameReference) failed.\n");
-
-		if (SUCCEEDED(hr))
-		{
-			hr = pColorFrameReference->AcquireFrame(&pColorFrame);
-			if (FAILED(hr))
-				printf("AcquireFrame(&pColorFrame) failed.\n");
-		}
+		TIME_SCOPE(TIME_OCTREE);
+		frame.octree.Build(frame.Points());
+	}
 
-		SafeRelease(pColorFrameReference);
+	// the full resolution points are drawn tile by tile
+	frame.bTiled = oLevelOfDetail && !frame.bMeshed && !frame.bDownsampled && !frame.bAccumulated;
+	if (frame.bTiled)
+	{
+		TIME_SCOPE(TIME_TILES);
+		tiler.Build(cp, frame.tiles);
 	}
 
-	// acquire infrared frame
-	if (SUCCEEDED(hr))
+	frame.bCompact = oCompact && !(frame.bNormals && oNormals);
+	if (frame.bCompact)
 	{
-		IInfraredFrameReference* pInfraredFrameReference = NULL;
+		TIME_SCOPE(TIME_PACK);
+		const int* pOrder = frame.bTiled && !frame.tiles.order.empty() ? &frame.tiles.order[0] : NULL;
+		PackPoints(frame.Points(), pOrder, frame.compact);
+	}
 
-		hr = pMultiSourceFrame->get_InfraredFrameReference(&pInfraredFrameReference);
-		if (FAILED(hr))
-			printf("get_InfraredFrameReference(&pInfraredFrameReference) failed.\n");
+	frame.nHeapAllocations = (int)(ThreadHeapAllocationCount() - nAllocationsBefore);
+	frames.Publish();
+	pacer.Notify();
+}
 
-		if (SUCCEEDED(hr))
-		{
-			hr = pInfraredFrameReference->AcquireFrame(&pInfraredFrame);
-			if (FAILED(hr))
-				printf("AcquireFrame(&pInfraredFrame) failed.\n");
-		}
+HRESULT KinectBasic::WaitForFrame(int iTimeoutMs)
+{
+	if (pFrameSource == NULL)
+		return E_FAIL;
+
+	return pFrameSource->WaitForFrame(iTimeoutMs);
+}
 
-		SafeRelease(pInfraredFrameReference);
+HRESULT KinectBasic::Update()
+{
+	if (pFrameSource == NULL)
+	{
+		return E_FAIL;
 	}
 
-	// acquire body index frame
+	// only frames that arrived are timed, not the polls that found none
+	FrameData frame;
+	TIME_START(tAcquire);
+	HRESULT hr = pFrameSource->AcquireFrame(frame);
 	if (SUCCEEDED(hr))
 	{
-		IBodyIndexFrameReference* pBodyIndexFrameReference = NULL;
-
-		hr = pMultiSourceFrame->get_BodyIndexFrameReference(&pBodyIndexFrameReference);
-		if (SUCCEEDED(hr))
-		{
-			hr = pBodyIndexFrameReference->AcquireFrame(&pBodyIndexFrame);
-		}
-
-		SafeRelease(pBodyIndexFrameReference);
+		TIME_STOP(tAcquire, TIME_ACQUIRE);
 	}
 
 	if (SUCCEEDED(hr))
 	{
-		INT64 nDepthTime = 0;
-		IFrameDescription* pDepthFrameDescription = NULL;
-		USHORT nDepthMinReliableDistance = 0;
-		USHORT nDepthMaxReliableDistance = 0;
-		int nDepthWidth = 0;
-		int nDepthHeight = 0;
-		UINT nDepthBufferSize = 0;
-		UINT16 *pDepthBuffer = NULL;
-
-		IFrameDescription* pColorFrameDescription = NULL;
-		int nColorWidth = 0;
-		int nColorHeight = 0;
-		ColorImageFormat imageFormat = ColorImageFormat_None;
-
-		IFrameDescription* pInfraredFrameDescription = NULL;
-		int nInfraredWidth = 0;
-		int nInfraredHeight = 0;
-		UINT nInfraredBufferSize = 0;
-		UINT16* pInfraredBuffer = NULL;
-
-		IFrameDescription* pBodyIndexFrameDescription = NULL;
-		int nBodyIndexWidth = 0;
-		int nBodyIndexHeight = 0;
-		UINT nBodyIndexBufferSize = 0;
-		BYTE* pBodyIndexBuffer = NULL;
-
-		// get depth frame data
-		{
-			hr = pDepthFrame->get_RelativeTime(&nDepthTime);
+		// a live sensor has its calibration once frames flow
+		if (bIntrinsicsPending)
+			InitializeIntrinsics();
+
+		ProcessFrame(
+			frame.nTime,
+			frame.pDepth,
+			frame.pInfrared,
+			frame.pColor,
+			frame.pBodyIndex);
+
+		if (pRecorder != NULL && FAILED(pRecorder->Write(frame)))
+			StopRecording();
+	}
 
-			if (SUCCEEDED(hr))
-				hr = pDepthFrame->get_FrameDescription(&pDepthFrameDescription);
+	pFrameSource->ReleaseFrame();
 
-			if (SUCCEEDED(hr))
-				hr = pDepthFrameDescription->get_Width(&nDepthWidth);
+	return hr;
+}
 
-			if (SUCCEEDED(hr))
-				hr = pDepthFrameDescription->get_Height(&nDepthHeight);
+void KinectBasic::Toggle_PickBodyIndex(string& dispString)
+{
+	this->oPickBodyIndex = !this->oPickBodyIndex;
+	if(this->oPickBodyIndex == true)
+	Set_PickedBodyIndex('0', dispString);
+	else dispString = "";
+}
 
-			if (SUCCEEDED(hr))
-				hr = pDepthFrame->get_DepthMinReliableDistance(&nDepthMinReliableDistance);
+void KinectBasic::Toggle_ThresholdDepthMode()
+{
+	this->oThresholdDepth = !this->oThresholdDepth;
+}
 
-			if (SUCCEEDED(hr))
-				hr = pDepthFrame->get_DepthMaxReliableDistance(&nDepthMaxReliableDistance);
+void KinectBasic::Toggle_ThresholdInfraredMode()
+{
+	this->oThresholdInfrared = !this->oThresholdInfrared;
+}
 
-			if (SUCCEEDED(hr))
-			{
-				hr = pDepthFrame->AccessUnderlyingBuffer(&nDepthBufferSize, &pDepthBuffer);
-				if (FAILED(hr))
-					printf("AccessUnderlyingBuffer(&nDepthBufferSize, &pDepthBuffer) failed.\n");
+void KinectBasic::Toggle_CloudMode()
+{
+	this->oDepthCloud = !this->oDepthCloud;
+}
 
-			}
-		}
+void KinectBasic::Toggle_NonlocalMeansFilter(string& dispString)
+{
+	this->oNonlocalMeans = !this->oNonlocalMeans;
+	dispString = this->oNonlocalMeans ? "Nonlocal Means Filter: on" : "Nonlocal Means Filter: off";
+}
 
-		// get color frame data
-		{
-			if (SUCCEEDED(hr))
-				hr = pColorFrame->get_FrameDescription(&pColorFrameDescription);
-
-			if (SUCCEEDED(hr))
-				hr = pColorFrameDescription->get_Width(&nColorWidth);
-
-			if (SUCCEEDED(hr))
-				hr = pColorFrameDescription->get_Height(&nColorHeight);
-
-			if (SUCCEEDED(hr))
-				hr = pColorFrame->get_RawColorImageFormat(&imageFormat);
-
-			if (SUCCEEDED(hr))
-			{
-				hr = pColorFrame->CopyConvertedFrameDataToArray(
-					nColorCount * 4,
-					reinterpret_cast<BYTE*>(pColorBuffer),
-					ColorImageFormat_Rgba);
-				if (FAILED(hr))
-					printf("CopyConvertedFrameDataToArray(pColorBuffer) failed.\n");
-			}
-		}
+void KinectBasic::Toggle_Normals(string& dispString)
+{
+	this->oNormals = !this->oNormals;
+	dispString = this->oNormals ? "Normals: on" : "Normals: off";
+}
 
-		// get infrared frame data
-		{
-			if (SUCCEEDED(hr))
-				hr = pInfraredFrame->get_FrameDescription(&pInfraredFrameDescription);
+void KinectBasic::Toggle_Mesh(string& dispString)
+{
+	this->oMesh = !this->oMesh;
+	dispString = this->oMesh ? "Mesh: on" : "Mesh: off";
+}
 
-			if (SUCCEEDED(hr))
-				hr = pInfraredFrameDescription->get_Width(&nInfraredWidth);
+void KinectBasic::Toggle_Tracking(string& dispString)
+{
+	// every tracking run starts from the identity pose
+	if (!this->oTracking)
+		this->oResetTracking = true;
+	this->oTracking = !this->oTracking;
 
-			if (SUCCEEDED(hr))
-				hr = pInfraredFrameDescription->get_Height(&nInfraredHeight);
+	dispString = this->oTracking ? "Tracking (ICP): on" : "Tracking (ICP): off";
+}
 
-			if (SUCCEEDED(hr))
-			{
-				hr = pInfraredFrame->AccessUnderlyingBuffer(&nInfraredBufferSize, &pInfraredBuffer);
-				if (FAILED(hr))
-					printf("AccessUnderlyingBuffer(&nInfraredBufferSize, &pInfraredBuffer) failed.\n");
-			}
-		}
+void KinectBasic::Toggle_VoxelGrid(string& dispString)
+{
+	this->oVoxelGrid = !this->oVoxelGrid;
+	Scale_VoxelLeafSize(1.0f, dispString);
+}
 
-		// get body index frame data
-		{
-			if (SUCCEEDED(hr))
-			{
-				hr = pBodyIndexFrame->get_FrameDescription(&pBodyIndexFrameDescription);
-			}
-
-			if (SUCCEEDED(hr))
-			{
-				hr = pBodyIndexFrameDescription->get_Width(&nBodyIndexWidth);
-			}
-
-			if (SUCCEEDED(hr))
-			{
-				hr = pBodyIndexFrameDescription->get_Height(&nBodyIndexHeight);
-			}
-
-			if (SUCCEEDED(hr))
-			{
-				hr = pBodyIndexFrame->AccessUnderlyingBuffer(&nBodyIndexBufferSize, &pBodyIndexBuffer);
-			}
-		}
+void KinectBasic::Scale_VoxelLeafSize(float fScale, string& dispString)
+{
+	float fLeafSize = this->fVoxelLeafSize * fScale;
+	if (fLeafSize < 0.001f) fLeafSize = 0.001f;
+	if (fLeafSize > 0.5f) fLeafSize = 0.5f;
+	this->fVoxelLeafSize = fLeafSize;
 
-		if (SUCCEEDED(hr))
-		{
-			ProcessFrame(
-				nDepthTime,
-				pDepthBuffer,
-				pInfraredBuffer,
-				pBodyIndexBuffer);
-		}
-		else cout << "bad" << endl;
+	char buff[1024];
+	if (this->oVoxelGrid)
+		sprintf_s(buff, "VoxelGrid: %.1f mm", fLeafSize * 1000.0f);
+	else
+		sprintf_s(buff, "VoxelGrid: off");
+	dispString = buff;
+}
 
-		SafeRelease(pDepthFrameDescription);
-		SafeRelease(pColorFrameDescription);
-		SafeRelease(pInfraredFrameDescription);
-		SafeRelease(pBodyIndexFrameDescription);
-	}
+void KinectBasic::Toggle_AccumulateMode(string& dispString)
+{
+	// every accumulation starts from an empty volume
+	if (!this->oAccumulate)
+		this->oResetVolume = true;
+	this->oAccumulate = !this->oAccumulate;
 
-	SafeRelease(pDepthFrame);
-	SafeRelease(pColorFrame);
-	SafeRelease(pInfraredFrame);
-	SafeRelease(pBodyIndexFrame);
-	SafeRelease(pMultiSourceFrame);
+	dispString = this->oAccumulate ? "Accumulate Mode: on" : "Accumulate Mode: off";
 }
 
-void KinectBasic::Toggle_PickBodyIndex(string& dispString)
+void KinectBasic::Toggle_SelectMode(string& dispString)
 {
-	this->oPickBodyIndex = !this->oPickBodyIndex;
-	if(this->oPickBodyIndex == true)
-	Set_PickedBodyIndex('0', dispString);
-	else dispString = "";
+	this->oSelect = !this->oSelect;
+	dispString = this->oSelect ? "Select Mode: on (drag with the left button)" : "Select Mode: off";
 }
 
-void KinectBasic::Toggle_ThresholdDepthMode()
+void KinectBasic::Toggle_LevelOfDetail(string& dispString)
 {
-	this->oThresholdDepth = !this->oThresholdDepth;
+	this->oLevelOfDetail = !this->oLevelOfDetail;
+	dispString = this->oLevelOfDetail ? "Culling/LOD: on" : "Culling/LOD: off";
 }
 
-void KinectBasic::Toggle_ThresholdInfraredMode()
+void KinectBasic::Toggle_CompactPoints(string& dispString)
 {
-	this->oThresholdInfrared = !this->oThresholdInfrared;
+	this->oCompact = !this->oCompact;
+	dispString = this->oCompact ? "Compact Points: on" : "Compact Points: off";
 }
 
 void KinectBasic::Set_PickedBodyIndex(const char bodyKey, string& dispString)
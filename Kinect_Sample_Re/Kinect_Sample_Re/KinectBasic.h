@@ -1,10 +1,30 @@
+#pragma once
+
 #include <iostream>
-#include <Kinect.h>
 #include <vector>
+#include <atomic>
+#include "KinectCompat.h"
+#include "FrameSource.h"
+#include "TripleBuffer.h"
+#include "FramePacer.h"
+#include "BackProjection.h"
+#include "PointCloud.h"
+#include "VoxelGrid.h"
+#include "TsdfVolume.h"
+#include "NlmFilter.h"
+#include "NormalEstimation.h"
+#include "GridMesh.h"
+#include "IcpTracker.h"
+#include "Octree.h"
+#include "PointTiles.h"
+#include "CompactPoints.h"
+#include "FrameArena.h"
 
 using namespace std;
 
+#ifndef M_PI
 #define M_PI 3.141592
+#endif
 
 template<class Interface>
 inline void SafeRelease(Interface *& pInterfaceToRelease)
@@ -16,16 +36,65 @@ inline void SafeRelease(Interface *& pInterfaceToRelease)
 	}
 }
 
-struct stpos
+// output of one ProcessFrame pass, handed to the renderer
+struct CloudFrame
 {
-	float X;
-	float Y;
-	float Z;
-};
+	CloudFrame();
 
-struct index3D
-{
-	stpos index[1080][1920];
+	// the cloud at the color resolution, from pArena when given
+	void Allocate(FrameArena* pArena);
+	static size_t ArenaFootprint();
+
+	INT64 nTime;
+	// made by the capture thread while processing the frame
+	int nHeapAllocations;
+	PointCloud cloud;
+
+	// normals of cloud, when estimating them
+	NormalMap normals;
+	bool bNormals;
+
+	// triangles over cloud.valid, in mesh mode
+	GridMesh mesh;
+	bool bMeshed;
+
+	// sensor pose relative to where tracking started, in tracking mode
+	RigidTransform pose;
+	bool bTracked;
+
+	// voxel grid output of cloud.valid, when downsampling is on
+	PointList downsampled;
+	bool bDownsampled;
+
+	// surface of the TSDF volume, in accumulate mode
+	PointList accumulated;
+	bool bAccumulated;
+
+	// spatial index over Points(), in select mode
+	Octree octree;
+	bool bIndexed;
+
+	// cloud.valid by tiles, for culling and level of detail when it is drawn
+	PointTiles tiles;
+	bool bTiled;
+
+	// Points() packed to 12 bytes a point, in tile order when tiled, for the
+	// renderer and the writer; not with lighting, which needs the normals
+	CompactPointList compact;
+	bool bCompact;
+
+	// the points to render/save/export
+	const PointList& Points() const
+	{
+		// the mesh indexes the full resolution points
+		if (bMeshed) return cloud.valid;
+		if (bAccumulated) return accumulated;
+		return bDownsampled ? downsampled : cloud.valid;
+	}
+
+private:
+	CloudFrame(const CloudFrame&);
+	CloudFrame& operator=(const CloudFrame&);
 };
 
 class KinectBasic
@@ -34,32 +103,67 @@ public:
 	KinectBasic();
 	~KinectBasic();
 
-	IKinectSensor* pKinectSensor;
-	IMultiSourceFrameReader* pMultiSourceFrameReader;
-	ICoordinateMapper* pCoordinateMapper;
+	FrameSource* pFrameSource;
+	FrameRecorder* pRecorder;
+
+	// the buffers below and the clouds of frames, allocated together
+	FrameArena arena;
 
 	unsigned short* pDepthBuffer;
+	unsigned short* pFilteredDepthBuffer;
 	unsigned char* pDepthData;
-	unsigned char* pColorData;
-	unsigned short* pInfraredBuffer;
 	unsigned char* pInfraredData;
 	unsigned char* pBodyIndexData;
-	RGBQUAD* pColorBuffer;
+	// the part of pDepthBuffer that may be non-zero
+	PixelRect depthExtent;
 
 	CameraSpacePoint* pCameraSpacePoints;
 	DepthSpacePoint* pDepthSpacePoints;
 	ColorSpacePoint* pColorSpacePoints;
-
-	index3D cp;
+	unsigned int* pRegisteredColor;
+
+	SensorIntrinsics intrinsics;
+	ColorRayTable colorRays;
+	DepthRayTable depthRays;
+	// the source had no calibration yet (a live sensor before it streams);
+	// the defaults stand in and Update() asks again on the next frame
+	bool bIntrinsicsPending;
+	NlmFilter nlmFilter;
+	NormalEstimator normalEstimator;
+	GridMesher mesher;
+	IcpTracker tracker;
+	PointTiler tiler;
+	VoxelGrid voxelGrid;
+	TsdfVolume volume;
+
+	// written by ProcessFrame (capture thread), read by the renderer
+	TripleBuffer<CloudFrame> frames;
+	// signaled on every Publish(), so the renderer can sleep until then
+	FramePacer pacer;
 
 	INT64 nStartTime;
 	INT64 nFrameCounter;
 
-	bool oPickBodyIndex;
-	bool oThresholdDepth;
-	bool oThresholdInfrared;
-
-	int iPickedBodyIndex;
+	// toggled from the GUI thread while frames are processed
+	atomic<bool> oPickBodyIndex;
+	atomic<bool> oThresholdDepth;
+	atomic<bool> oThresholdInfrared;
+	// one point per depth pixel instead of per color pixel
+	atomic<bool> oDepthCloud;
+	atomic<bool> oNonlocalMeans;
+	atomic<bool> oNormals;
+	atomic<bool> oMesh;
+	atomic<bool> oTracking;
+	atomic<bool> oResetTracking;
+	atomic<bool> oVoxelGrid;
+	atomic<float> fVoxelLeafSize;
+	atomic<bool> oAccumulate;
+	atomic<bool> oResetVolume;
+	atomic<bool> oSelect;
+	atomic<bool> oLevelOfDetail;
+	atomic<bool> oCompact;
+
+	atomic<int> iPickedBodyIndex;
 	int iThresholdDepth;
 	int iThresholdInfrared;
 
@@ -74,15 +178,34 @@ public:
 	static const int nInfraredCount;
 
 	HRESULT InitializeDefaultSensor();
+	HRESULT InitializeReplay(const char* szPath, bool bRealTime, int nStartFrame = 0);
+	void InitializeIntrinsics();
+	// a .kfz path records compressed depth/infrared/body index, anything else raw frames
+	HRESULT StartRecording(const char* szPath);
+	void StopRecording();
 	void ProcessFrame(
 		INT64 nTime,
 		const UINT16* pDepthSrc,
 		const UINT16* pInfraredSrc,
+		const RGBQUAD* pColorSrc,
 		const BYTE* pBodyIndexSrc);
-	void Update();
+	// blocks until the source may have a new frame; E_PENDING on timeout
+	HRESULT WaitForFrame(int iTimeoutMs);
+	HRESULT Update();
 
 	void Toggle_PickBodyIndex(string& dispString);
 	void Toggle_ThresholdDepthMode();
 	void Toggle_ThresholdInfraredMode();
+	void Toggle_CloudMode();
+	void Toggle_NonlocalMeansFilter(string& dispString);
+	void Toggle_Normals(string& dispString);
+	void Toggle_Mesh(string& dispString);
+	void Toggle_Tracking(string& dispString);
+	void Toggle_VoxelGrid(string& dispString);
+	void Scale_VoxelLeafSize(float fScale, string& dispString);
+	void Toggle_AccumulateMode(string& dispString);
+	void Toggle_SelectMode(string& dispString);
+	void Toggle_LevelOfDetail(string& dispString);
+	void Toggle_CompactPoints(string& dispString);
 	void Set_PickedBodyIndex(const char bodyIndex, string& dispString);
 };
\ No newline at end of file
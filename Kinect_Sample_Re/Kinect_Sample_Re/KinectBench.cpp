@@ -0,0 +1,400 @@
+// Microbenchmarks of the ProcessFrame kernels, each run in isolation on
+// synthetic frames of the sensor's sizes (depth/infrared 512x424, color
+// 1920x1080), so they run without a sensor or a window. This is a separate
+// executable; on Linux for example:
+//
+//	g++ -O2 -std=c++11 -pthread KinectBench.cpp DepthKernels.cpp CpuFeatures.cpp
+//		BackProjection.cpp PointCloud.cpp SoftwareMapper.cpp NlmFilter.cpp
+//		ParallelFor.cpp VoxelGrid.cpp FrameCodec.cpp NormalEstimation.cpp
+//		GridMesh.cpp IcpTracker.cpp Octree.cpp PointTiles.cpp CompactPoints.cpp
+//		FrameArena.cpp CloudMerge.cpp -o kinect_bench
+//
+// kinect_bench [seconds per kernel] [name filter]
+//
+// Bytes are what a kernel has to read and write at least, so bytes/cycle
+// compares directly against the memory bandwidth of the machine. Cycles are
+// time stamp counter ticks, which run at the nominal clock of the CPU.
+// Allocations are the heap allocations of the calling thread per call once
+// warmed up, which should be 0.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include "KinectCompat.h"
+#include "CpuFeatures.h"
+#include "DepthKernels.h"
+#include "SoftwareMapper.h"
+#include "BackProjection.h"
+#include "PointCloud.h"
+#include "NlmFilter.h"
+#include "NormalEstimation.h"
+#include "GridMesh.h"
+#include "IcpTracker.h"
+#include "Octree.h"
+#include "PointTiles.h"
+#include "CompactPoints.h"
+#include "CloudMerge.h"
+#include "FrameArena.h"
+#include "VoxelGrid.h"
+#include "FrameCodec.h"
+#include "ParallelFor.h"
+
+#ifdef KINECT_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+static const int nDepthWidth = 512;
+static const int nDepthHeight = 424;
+static const int nColorWidth = 1920;
+static const int nColorHeight = 1080;
+static const int nDepthCount = nDepthWidth * nDepthHeight;
+static const int nColorCount = nColorWidth * nColorHeight;
+
+static double fSecondsPerKernel = 1.0;
+static const char* szFilter = NULL;
+
+static unsigned long long ReadCycles()
+{
+#ifdef KINECT_X86
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+// runs kernel repeatedly for fSecondsPerKernel and prints the median call;
+// nPixels and fBytes are per call
+static void RunBenchmark(const char* szName, int nPixels, double fBytes, const std::function<void()>& kernel)
+{
+	if (szFilter != NULL && strstr(szName, szFilter) == NULL)
+		return;
+
+	// fault in the outputs and warm the caches
+	for (int ii = 0; ii < 3; ii++)
+		kernel();
+
+	std::vector<double> times;
+	std::vector<double> cycles;
+	long long nAllocations = 0;
+	const std::chrono::steady_clock::time_point tStart = std::chrono::steady_clock::now();
+	for (;;)
+	{
+		const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		const long long nAllocationsBefore = ThreadHeapAllocationCount();
+		const unsigned long long c0 = ReadCycles();
+		kernel();
+		const unsigned long long c1 = ReadCycles();
+		nAllocations += ThreadHeapAllocationCount() - nAllocationsBefore;
+		const std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+
+		times.push_back(std::chrono::duration<double>(t1 - t0).count());
+		cycles.push_back((double)(c1 - c0));
+		if (times.size() >= 5 && std::chrono::duration<double>(t1 - tStart).count() >= fSecondsPerKernel)
+			break;
+	}
+
+	std::sort(times.begin(), times.end());
+	std::sort(cycles.begin(), cycles.end());
+	const double fTime = times[times.size() / 2];
+	const double fCycles = cycles[cycles.size() / 2];
+
+	char szBytesPerCycle[32] = "-";
+	if (fCycles > 0.0)
+		sprintf(szBytesPerCycle, "%.2f", fBytes / fCycles);
+	printf("%-34s %9.3f ms %9.1f Mpix/s %9.2f GB/s %10s B/cycle %6d runs %6.1f allocs\n",
+		szName, fTime * 1e3, nPixels / fTime * 1e-6, fBytes / fTime * 1e-9, szBytesPerCycle, (int)times.size(),
+		(double)nAllocations / times.size());
+}
+
+// a sphere in front of a slanted wall, with the holes and noise of real depth
+static void MakeDepthFrame(UINT16* pDepth, UINT16* pInfrared, BYTE* pBodyIndex)
+{
+	srand(1);
+	for (int rr = 0; rr < nDepthHeight; rr++)
+	{
+		for (int cc = 0; cc < nDepthWidth; cc++)
+		{
+			const int idx = rr * nDepthWidth + cc;
+			const float fX = (cc - nDepthWidth * 0.5f) / 100.0f;
+			const float fY = (rr - nDepthHeight * 0.5f) / 100.0f;
+			const float fR2 = fX * fX + fY * fY;
+
+			int iDepth;
+			if (fR2 < 1.0f)
+			{
+				iDepth = (int)(1200.0f - 300.0f * sqrtf(1.0f - fR2));
+				pBodyIndex[idx] = 0;
+			}
+			else
+			{
+				iDepth = 2500 + cc * 2;
+				pBodyIndex[idx] = 0xff;
+			}
+			iDepth += rand() % 7 - 3;
+
+			// dropouts, mostly along the sphere's rim
+			if (rand() % 50 == 0 || (fR2 > 0.97f && fR2 < 1.03f))
+				iDepth = 0;
+
+			pDepth[idx] = (UINT16)iDepth;
+			pInfrared[idx] = (UINT16)(iDepth == 0 ? rand() % 256 : 60000000 / (iDepth + 1000) + rand() % 512);
+		}
+	}
+}
+
+static void MakeColorFrame(RGBQUAD* pColor)
+{
+	for (int rr = 0; rr < nColorHeight; rr++)
+	{
+		for (int cc = 0; cc < nColorWidth; cc++)
+		{
+			RGBQUAD& color = pColor[rr * nColorWidth + cc];
+			color.rgbBlue = (BYTE)cc;
+			color.rgbGreen = (BYTE)rr;
+			color.rgbRed = (BYTE)(cc ^ rr);
+			color.rgbReserved = 0xff;
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1)	fSecondsPerKernel = atof(argv[1]);
+	if (argc > 2)	szFilter = argv[2];
+
+	printf("SSE2 %s, AVX2 %s, %d threads, %.1f s per kernel\n\n",
+		HasSSE2() ? "yes" : "no", HasAVX2() ? "yes" : "no", ParallelThreadCount(), fSecondsPerKernel);
+
+	std::vector<UINT16> depth(nDepthCount), infrared(nDepthCount), thresholded(nDepthCount), filtered(nDepthCount);
+	std::vector<BYTE> bodyIndex(nDepthCount), depthData(nDepthCount), infraredData(nDepthCount);
+	std::vector<RGBQUAD> color(nColorCount);
+	MakeDepthFrame(&depth[0], &infrared[0], &bodyIndex[0]);
+	MakeColorFrame(&color[0]);
+
+	// thresholding, with the depth/infrared shifts to 8 bits folded in
+	ThresholdParams params;
+	params.oThresholdDepth = true;
+	params.oThresholdInfrared = true;
+	params.iThresholdDepth = 2000;
+	params.iThresholdInfrared = 2000;
+	const double fThresholdBytes = nDepthCount * (2.0 + 2.0 + 2.0 + 1.0 + 1.0);
+
+	struct
+	{
+		const char* szName;
+		ThresholdKernel kernel;
+		bool bAvailable;
+	} thresholds[] =
+	{
+		{ "threshold+shifts reference", ThresholdDepthInfrared_Reference, true },
+		{ "threshold+shifts scalar", ThresholdDepthInfrared_Scalar, true },
+		{ "threshold+shifts SSE2", ThresholdDepthInfrared_SSE2, HasSSE2() },
+		{ "threshold+shifts AVX2", ThresholdDepthInfrared_AVX2, HasAVX2() },
+	};
+	for (size_t ii = 0; ii < sizeof(thresholds) / sizeof(thresholds[0]); ii++)
+	{
+		if (!thresholds[ii].bAvailable)
+			continue;
+		const ThresholdKernel kernel = thresholds[ii].kernel;
+		RunBenchmark(thresholds[ii].szName, nDepthCount, fThresholdBytes, [&]()
+		{
+			kernel(&depth[0], &infrared[0], nDepthCount, params, &thresholded[0], &depthData[0], &infraredData[0]);
+		});
+	}
+
+	// coordinate mapping, as done for replays
+	SoftwareMapper mapper;
+	const SensorIntrinsics intrinsics = SensorIntrinsics::Default();
+	mapper.Initialize(intrinsics, nDepthWidth, nDepthHeight, nColorWidth, nColorHeight);
+
+	std::vector<CameraSpacePoint> cameraSpacePoints(nColorCount);
+	std::vector<ColorSpacePoint> colorSpacePoints(nDepthCount);
+	RunBenchmark("map color to camera space", nColorCount, nDepthCount * 2.0 + nColorCount * 12.0, [&]()
+	{
+		mapper.MapColorFrameToCameraSpace(nDepthCount, &depth[0], nColorCount, &cameraSpacePoints[0]);
+	});
+	RunBenchmark("map depth to color space", nDepthCount, nDepthCount * (2.0 + 8.0), [&]()
+	{
+		mapper.MapDepthFrameToColorSpace(nDepthCount, &depth[0], nDepthCount, &colorSpacePoints[0]);
+	});
+	mapper.MapColorFrameToCameraSpace(nDepthCount, &depth[0], nColorCount, &cameraSpacePoints[0]);
+	mapper.MapDepthFrameToColorSpace(nDepthCount, &depth[0], nDepthCount, &colorSpacePoints[0]);
+
+	// back-projection: camera points and colors in, organized planes plus the
+	// valid list out
+	ColorRayTable colorRays;
+	colorRays.Initialize(intrinsics, nColorWidth, nColorHeight);
+	PointCloud colorCloud;
+	colorCloud.Allocate(nColorWidth, nColorHeight);
+	BackProjectColorFrame(colorRays, &cameraSpacePoints[0], &color[0], colorCloud);
+	RunBenchmark("back-project color frame", nColorCount, nColorCount * (12.0 + 4.0 + 16.0) + colorCloud.valid.nCount * 16.0, [&]()
+	{
+		BackProjectColorFrame(colorRays, &cameraSpacePoints[0], &color[0], colorCloud);
+	});
+
+	std::vector<PointF> table(nDepthCount);
+	mapper.GetDepthFrameToCameraSpaceTable(nDepthCount, &table[0]);
+	DepthRayTable depthRays;
+	depthRays.Initialize(&table[0], nDepthWidth, nDepthHeight);
+	PointCloud depthCloud;
+	depthCloud.Allocate(nDepthWidth, nDepthHeight);
+	BackProjectDepthFrame(depthRays, &depth[0], &colorSpacePoints[0], &color[0], nColorWidth, nColorHeight, depthCloud);
+	RunBenchmark("back-project depth frame", nDepthCount, nDepthCount * (2.0 + 8.0 + 8.0 + 4.0 + 16.0) + depthCloud.valid.nCount * 16.0, [&]()
+	{
+		BackProjectDepthFrame(depthRays, &depth[0], &colorSpacePoints[0], &color[0], nColorWidth, nColorHeight, depthCloud);
+	});
+
+	// color conversion: the SDK hands over RGBA, which is used as is, so what
+	// is left is gathering the registered color of every depth pixel
+	std::vector<unsigned int> registeredColor(nDepthCount);
+	RunBenchmark("register color to depth", nDepthCount, nDepthCount * (2.0 + 8.0 + 4.0 + 4.0), [&]()
+	{
+		RegisterColorToDepth(&depth[0], &colorSpacePoints[0], nDepthCount, &color[0], nColorWidth, nColorHeight, &registeredColor[0]);
+	});
+
+	// the optional stages
+	NlmFilter nlmFilter;
+	nlmFilter.Initialize(nDepthWidth, nDepthHeight);
+	RunBenchmark("nonlocal means filter", nDepthCount, nDepthCount * (2.0 + 2.0), [&]()
+	{
+		nlmFilter.Filter(&depth[0], &filtered[0]);
+	});
+
+	NormalEstimator normalEstimator;
+	NormalMap normals;
+	RunBenchmark("normals (depth cloud)", nDepthCount, nDepthCount * (12.0 + 12.0), [&]()
+	{
+		normalEstimator.Compute(depthCloud, normals);
+	});
+	RunBenchmark("normals (color cloud)", nColorCount, nColorCount * (12.0 + 12.0), [&]()
+	{
+		normalEstimator.Compute(colorCloud, normals);
+	});
+
+	// the depth cloud against itself: the cost of one iteration, since it is
+	// aligned at once
+	IcpTracker tracker;
+	GridCamera depthCamera = { intrinsics.fDepthFocalX, intrinsics.fDepthFocalY, intrinsics.fDepthPrincipalX, intrinsics.fDepthPrincipalY };
+	RigidTransform pose;
+	normalEstimator.Compute(depthCloud, normals);
+	tracker.Track(depthCloud, normals, depthCamera, pose);
+	RunBenchmark("icp iteration (depth cloud)", nDepthCount, nDepthCount * 12.0, [&]()
+	{
+		tracker.Track(depthCloud, normals, depthCamera, pose);
+	});
+
+	GridMesher mesher;
+	GridMesh mesh;
+	RunBenchmark("grid mesh (color cloud)", nColorCount, nColorCount * (4.0 + 4.0) + colorCloud.valid.nCount * 8.0, [&]()
+	{
+		mesher.Build(colorCloud, mesh);
+	});
+
+	// a box around the middle of the scene, as a selection would be
+	Octree octree;
+	RunBenchmark("octree build (color cloud)", colorCloud.valid.nCount, colorCloud.valid.nCount * 24.0, [&]()
+	{
+		octree.Build(colorCloud.valid);
+	});
+	std::vector<int> selected;
+	const float fBoxMin[3] = { -0.25f, -0.25f, 0.0f };
+	const float fBoxMax[3] = { 0.25f, 0.25f, 10.0f };
+	RunBenchmark("octree box query (color cloud)", colorCloud.valid.nCount, 0, [&]()
+	{
+		octree.QueryBox(fBoxMin, fBoxMax, selected);
+	});
+
+	PointTiler tiler;
+	PointTiles tiles;
+	RunBenchmark("lod tiles (color cloud)", colorCloud.valid.nCount, colorCloud.valid.nCount * (4.0 + 12.0 + 4.0), [&]()
+	{
+		tiler.Build(colorCloud, tiles);
+	});
+
+	CompactPointList compact;
+	RunBenchmark("pack compact points (color cloud)", colorCloud.valid.nCount, colorCloud.valid.nCount * (16.0 + 12.0), [&]()
+	{
+		PackPoints(colorCloud.valid, NULL, compact);
+	});
+
+	PointList unpacked;
+	unpacked.Allocate(colorCloud.valid.nCount);
+	RunBenchmark("unpack compact points (color cloud)", colorCloud.valid.nCount, colorCloud.valid.nCount * (12.0 + 16.0), [&]()
+	{
+		UnpackPoints(compact.pPoints, compact.nCount, unpacked.pX, unpacked.pY, unpacked.pZ, unpacked.pColor);
+	});
+
+	if (!VerifyPackKernels(colorCloud.valid.nCount))
+	{
+		printf("\ncompact point packing does not match the scalar path\n");
+		return 1;
+	}
+
+	// a rig of 3 sensors seeing the same frame from different places
+	const PointList* rigClouds[3] = { &colorCloud.valid, &colorCloud.valid, &colorCloud.valid };
+	const RigidTransform extrinsics[3] =
+	{
+		RigidTransform::Identity(),
+		RigidTransform::FromTwist(0.0, 2.0944, 0.0, 1.5, 0.0, 2.5),
+		RigidTransform::FromTwist(0.0, -2.0944, 0.0, -1.5, 0.0, 2.5)
+	};
+	PointList merged;
+	RunBenchmark("merge 3 sensors (color cloud)", 3 * colorCloud.valid.nCount, 3 * colorCloud.valid.nCount * (16.0 + 20.0), [&]()
+	{
+		MergeClouds(rigClouds, extrinsics, 3, merged);
+	});
+
+	VoxelGrid voxelGrid;
+	PointList downsampled;
+	RunBenchmark("voxel grid 1 cm (color cloud)", colorCloud.valid.nCount, colorCloud.valid.nCount * 16.0, [&]()
+	{
+		voxelGrid.Downsample(colorCloud.valid, 0.01f, downsampled);
+	});
+
+	std::vector<BYTE> encoded;
+	encoded.reserve(nDepthCount * 4);
+	RunBenchmark("encode depth plane", nDepthCount, nDepthCount * 2.0, [&]()
+	{
+		encoded.clear();
+		EncodePlane16(&depth[0], nDepthWidth, nDepthHeight, encoded);
+	});
+	encoded.clear();
+	EncodePlane16(&depth[0], nDepthWidth, nDepthHeight, encoded);
+	RunBenchmark("decode depth plane", nDepthCount, nDepthCount * 2.0, [&]()
+	{
+		DecodePlane16(&encoded[0], encoded.size(), nDepthWidth, nDepthHeight, &filtered[0]);
+	});
+
+	// recordings are lossless: every plane must come back bit for bit
+	std::vector<UINT16> decoded(nDepthCount);
+	std::vector<BYTE> decodedRuns(nDepthCount);
+	bool bLossless =
+		DecodePlane16(&encoded[0], encoded.size(), nDepthWidth, nDepthHeight, &decoded[0]) &&
+		memcmp(&decoded[0], &depth[0], sizeof(UINT16)* nDepthCount) == 0;
+	encoded.clear();
+	EncodePlane16(&infrared[0], nDepthWidth, nDepthHeight, encoded);
+	bLossless = bLossless &&
+		DecodePlane16(&encoded[0], encoded.size(), nDepthWidth, nDepthHeight, &decoded[0]) &&
+		memcmp(&decoded[0], &infrared[0], sizeof(UINT16)* nDepthCount) == 0;
+	encoded.clear();
+	EncodeRuns8(&bodyIndex[0], nDepthCount, encoded);
+	bLossless = bLossless &&
+		DecodeRuns8(&encoded[0], encoded.size(), nDepthCount, &decodedRuns[0]) &&
+		memcmp(&decodedRuns[0], &bodyIndex[0], nDepthCount) == 0;
+	if (!bLossless)
+	{
+		printf("\nframe codec round trip does not match the source planes\n");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+// Kinect SDK types used outside of the sensor code.
+// On Windows these come from the SDK; elsewhere (e.g. replay-only builds on
+// Linux) the few types and macros we rely on are defined here.
+
+#ifdef _WIN32
+
+#include <Windows.h>
+#include <Kinect.h>
+
+#else
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int32_t HRESULT;
+typedef int BOOL;
+typedef int64_t INT64;
+typedef uint64_t UINT64;
+typedef int32_t INT32;
+typedef uint32_t UINT32;
+typedef unsigned int UINT;
+typedef uint16_t UINT16;
+typedef uint16_t USHORT;
+typedef uint8_t BYTE;
+typedef void* HANDLE;
+
+#define TRUE 1
+#define FALSE 0
+
+#define S_OK			((HRESULT)0x00000000L)
+#define S_FALSE			((HRESULT)0x00000001L)
+#define E_FAIL			((HRESULT)0x80004005L)
+#define E_POINTER		((HRESULT)0x80004003L)
+#define E_INVALIDARG	((HRESULT)0x80070057L)
+#define E_OUTOFMEMORY	((HRESULT)0x8007000EL)
+#define E_PENDING		((HRESULT)0x8000000AL)
+
+#define SUCCEEDED(hr)	(((HRESULT)(hr)) >= 0)
+#define FAILED(hr)		(((HRESULT)(hr)) < 0)
+
+struct RGBQUAD
+{
+	BYTE rgbBlue;
+	BYTE rgbGreen;
+	BYTE rgbRed;
+	BYTE rgbReserved;
+};
+
+struct PointF
+{
+	float X;
+	float Y;
+};
+
+struct CameraSpacePoint
+{
+	float X;
+	float Y;
+	float Z;
+};
+
+struct DepthSpacePoint
+{
+	float X;
+	float Y;
+};
+
+struct ColorSpacePoint
+{
+	float X;
+	float Y;
+};
+
+template<size_t N>
+inline int sprintf_s(char (&buffer)[N], const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	int n = vsnprintf(buffer, N, format, args);
+	va_end(args);
+	return n;
+}
+
+#endif
@@ -0,0 +1,361 @@
+#ifdef _WIN32
+
+#include "KinectFrameSource.h"
+#include "KinectBasic.h"
+#include "QueryTimeCheck.h"
+
+KinectFrameSource::KinectFrameSource() :
+pKinectSensor(NULL),
+pMultiSourceFrameReader(NULL),
+pCoordinateMapper(NULL),
+hFrameArrived(0),
+pMultiSourceFrame(NULL),
+pDepthFrame(NULL),
+pColorFrame(NULL),
+pInfraredFrame(NULL),
+pBodyIndexFrame(NULL),
+pColorBuffer(NULL)
+{
+	pColorBuffer = new RGBQUAD[KinectBasic::nColorCount];
+	memset(pColorBuffer, 0, sizeof(RGBQUAD)* KinectBasic::nColorCount);
+}
+
+KinectFrameSource::~KinectFrameSource()
+{
+	Close();
+
+	if (pColorBuffer != NULL)	delete[] pColorBuffer;
+}
+
+HRESULT KinectFrameSource::Open()
+{
+	HRESULT hr;
+
+	hr = GetDefaultKinectSensor(&pKinectSensor);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	if (pKinectSensor)
+	{
+		// Initialize the Kinect and get coordinate mapper and the fream reader
+		if (SUCCEEDED(hr))
+		{
+			hr = pKinectSensor->get_CoordinateMapper(&pCoordinateMapper);
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			hr = pKinectSensor->Open();
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			hr = pKinectSensor->OpenMultiSourceFrameReader(
+				FrameSourceTypes::FrameSourceTypes_Depth |
+				FrameSourceTypes::FrameSourceTypes_Color |
+				FrameSourceTypes::FrameSourceTypes_Infrared |
+				FrameSourceTypes::FrameSourceTypes_BodyIndex,
+				&pMultiSourceFrameReader);
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			hr = pMultiSourceFrameReader->SubscribeMultiSourceFrameArrived(&hFrameArrived);
+		}
+	}
+
+	if (pKinectSensor == NULL || FAILED(hr))
+	{
+		cerr << "No ready Kinect found" << endl;
+		return E_FAIL;
+	}
+
+	return hr;
+}
+
+void KinectFrameSource::Close()
+{
+	ReleaseFrame();
+
+	SafeRelease(pCoordinateMapper);
+	if (pMultiSourceFrameReader != NULL && hFrameArrived != 0)
+		pMultiSourceFrameReader->UnsubscribeMultiSourceFrameArrived(hFrameArrived);
+	hFrameArrived = 0;
+	SafeRelease(pMultiSourceFrameReader);
+
+	if (pKinectSensor != NULL)	pKinectSensor->Close();
+	SafeRelease(pKinectSensor);
+}
+
+HRESULT KinectFrameSource::WaitForFrame(int iTimeoutMs)
+{
+	if (hFrameArrived == 0)
+		return E_FAIL;
+
+	if (WaitForSingleObject(reinterpret_cast<HANDLE>(hFrameArrived), iTimeoutMs) != WAIT_OBJECT_0)
+		return E_PENDING;
+
+	// resets the event for the next frame
+	IMultiSourceFrameArrivedEventArgs* pArgs = NULL;
+	if (SUCCEEDED(pMultiSourceFrameReader->GetMultiSourceFrameArrivedEventData(hFrameArrived, &pArgs)))
+		SafeRelease(pArgs);
+
+	return S_OK;
+}
+
+HRESULT KinectFrameSource::AcquireFrame(FrameData& frame)
+{
+	if (pMultiSourceFrameReader == NULL)
+	{
+		return E_FAIL;
+	}
+
+	HRESULT hr = pMultiSourceFrameReader->AcquireLatestFrame(&pMultiSourceFrame);
+	if (FAILED(hr))
+		printf("AcquireLatestFrame(&pMultiSourceFrame) failed.\n");
+
+	// acquire depth frame
+	if (SUCCEEDED(hr))
+	{
+		IDepthFrameReference* pDepthFrameReference = NULL;
+
+		hr = pMultiSourceFrame->get_DepthFrameReference(&pDepthFrameReference);
+		if (FAILED(hr))
+			printf("get_DepthFrameReference(&pDepthFrameReference) failed.\n");
+
+		if (SUCCEEDED(hr))
+		{
+			hr = pDepthFrameReference->AcquireFrame(&pDepthFrame);
+			if (FAILED(hr))
+				printf("AcquireFrame(&pDepthFrame) failed.\n");
+		}
+
+		SafeRelease(pDepthFrameReference);
+	}
+
+	// acquire color frame
+	if (SUCCEEDED(hr))
+	{
+		IColorFrameReference* pColorFrameReference = NULL;
+
+		hr = pMultiSourceFrame->get_ColorFrameReference(&pColorFrameReference);
+		if (FAILED(hr))
+			printf("get_ColorFrameReference(&pColorFrameReference) failed.\n");
+
+		if (SUCCEEDED(hr))
+		{
+			hr = pColorFrameReference->AcquireFrame(&pColorFrame);
+			if (FAILED(hr))
+				printf("AcquireFrame(&pColorFrame) failed.\n");
+		}
+
+		SafeRelease(pColorFrameReference);
+	}
+
+	// acquire infrared frame
+	if (SUCCEEDED(hr))
+	{
+		IInfraredFrameReference* pInfraredFrameReference = NULL;
+
+		hr = pMultiSourceFrame->get_InfraredFrameReference(&pInfraredFrameReference);
+		if (FAILED(hr))
+			printf("get_InfraredFrameReference(&pInfraredFrameReference) failed.\n");
+
+		if (SUCCEEDED(hr))
+		{
+			hr = pInfraredFrameReference->AcquireFrame(&pInfraredFrame);
+			if (FAILED(hr))
+				printf("AcquireFrame(&pInfraredFrame) failed.\n");
+		}
+
+		SafeRelease(pInfraredFrameReference);
+	}
+
+	// acquire body index frame
+	if (SUCCEEDED(hr))
+	{
+		IBodyIndexFrameReference* pBodyIndexFrameReference = NULL;
+
+		hr = pMultiSourceFrame->get_BodyIndexFrameReference(&pBodyIndexFrameReference);
+		if (SUCCEEDED(hr))
+		{
+			hr = pBodyIndexFrameReference->AcquireFrame(&pBodyIndexFrame);
+		}
+
+		SafeRelease(pBodyIndexFrameReference);
+	}
+
+	if (SUCCEEDED(hr))
+	{
+		INT64 nDepthTime = 0;
+		UINT nDepthBufferSize = 0;
+		UINT16 *pDepthBuffer = NULL;
+		UINT nInfraredBufferSize = 0;
+		UINT16* pInfraredBuffer = NULL;
+		UINT nBodyIndexBufferSize = 0;
+		BYTE* pBodyIndexBuffer = NULL;
+
+		// get depth frame data
+		{
+			hr = pDepthFrame->get_RelativeTime(&nDepthTime);
+
+			if (SUCCEEDED(hr))
+			{
+				hr = pDepthFrame->AccessUnderlyingBuffer(&nDepthBufferSize, &pDepthBuffer);
+				if (FAILED(hr))
+					printf("AccessUnderlyingBuffer(&nDepthBufferSize, &pDepthBuffer) failed.\n");
+			}
+		}
+
+		// get color frame data
+		{
+			if (SUCCEEDED(hr))
+			{
+				TIME_SCOPE(TIME_COLOR_CONVERSION);
+				hr = pColorFrame->CopyConvertedFrameDataToArray(
+					KinectBasic::nColorCount * 4,
+					reinterpret_cast<BYTE*>(pColorBuffer),
+					ColorImageFormat_Rgba);
+				if (FAILED(hr))
+					printf("CopyConvertedFrameDataToArray(pColorBuffer) failed.\n");
+			}
+		}
+
+		// get infrared frame data
+		{
+			if (SUCCEEDED(hr))
+			{
+				hr = pInfraredFrame->AccessUnderlyingBuffer(&nInfraredBufferSize, &pInfraredBuffer);
+				if (FAILED(hr))
+					printf("AccessUnderlyingBuffer(&nInfraredBufferSize, &pInfraredBuffer) failed.\n");
+			}
+		}
+
+		// get body index frame data
+		{
+			if (SUCCEEDED(hr))
+			{
+				hr = pBodyIndexFrame->AccessUnderlyingBuffer(&nBodyIndexBufferSize, &pBodyIndexBuffer);
+			}
+		}
+
+		if (SUCCEEDED(hr))
+		{
+			frame.nTime = nDepthTime;
+			frame.pDepth = pDepthBuffer;
+			frame.pInfrared = pInfraredBuffer;
+			frame.pColor = pColorBuffer;
+			frame.pBodyIndex = pBodyIndexBuffer;
+		}
+		else cout << "bad" << endl;
+	}
+
+	// frames are kept until ReleaseFrame() since the buffers above point into them
+	if (FAILED(hr))
+		ReleaseFrame();
+
+	return hr;
+}
+
+void KinectFrameSource::ReleaseFrame()
+{
+	SafeRelease(pDepthFrame);
+	SafeRelease(pColorFrame);
+	SafeRelease(pInfraredFrame);
+	SafeRelease(pBodyIndexFrame);
+	SafeRelease(pMultiSourceFrame);
+}
+
+HRESULT KinectFrameSource::MapColorFrameToCameraSpace(
+	UINT nDepthPointCount,
+	const UINT16* pDepthFrameData,
+	UINT nCameraPointCount,
+	CameraSpacePoint* pCameraSpacePoints)
+{
+	if (pCoordinateMapper == NULL)
+		return E_FAIL;
+
+	return pCoordinateMapper->MapColorFrameToCameraSpace(
+		nDepthPointCount,
+		pDepthFrameData,
+		nCameraPointCount,
+		pCameraSpacePoints);
+}
+
+HRESULT KinectFrameSource::MapDepthFrameToColorSpace(
+	UINT nDepthPointCount,
+	const UINT16* pDepthFrameData,
+	UINT nColorPointCount,
+	ColorSpacePoint* pColorSpacePoints)
+{
+	if (pCoordinateMapper == NULL)
+		return E_FAIL;
+
+	return pCoordinateMapper->MapDepthFrameToColorSpace(
+		nDepthPointCount,
+		pDepthFrameData,
+		nColorPointCount,
+		pColorSpacePoints);
+}
+
+HRESULT KinectFrameSource::GetDepthFrameToCameraSpaceTable(
+	UINT nTableEntryCount,
+	PointF* pTableEntries)
+{
+	if (pCoordinateMapper == NULL)
+		return E_FAIL;
+
+	UINT32 nEntryCount = 0;
+	PointF* pEntries = NULL;
+	HRESULT hr = pCoordinateMapper->GetDepthFrameToCameraSpaceTable(&nEntryCount, &pEntries);
+	if (SUCCEEDED(hr))
+	{
+		if (nEntryCount == nTableEntryCount)
+			memcpy(pTableEntries, pEntries, sizeof(PointF)* nEntryCount);
+		else
+			hr = E_INVALIDARG;
+	}
+
+	// all zeros (with S_OK) until the sensor streams
+	if (SUCCEEDED(hr))
+	{
+		hr = E_PENDING;
+		for (UINT ii = 0; ii < nTableEntryCount && hr == E_PENDING; ii++)
+		{
+			if (pTableEntries[ii].X != 0.0f || pTableEntries[ii].Y != 0.0f)
+				hr = S_OK;
+		}
+	}
+
+	if (pEntries != NULL)	CoTaskMemFree(pEntries);
+
+	return hr;
+}
+
+HRESULT KinectFrameSource::GetSensorIntrinsics(SensorIntrinsics& intrinsics)
+{
+	if (pCoordinateMapper == NULL)
+		return E_FAIL;
+
+	// the SDK only exposes the depth camera; color stays at our calibration
+	CameraIntrinsics depthIntrinsics;
+	HRESULT hr = pCoordinateMapper->GetDepthCameraIntrinsics(&depthIntrinsics);
+	if (SUCCEEDED(hr))
+	{
+		intrinsics = SensorIntrinsics::Default();
+		intrinsics.fDepthFocalX = depthIntrinsics.FocalLengthX;
+		intrinsics.fDepthFocalY = depthIntrinsics.FocalLengthY;
+		intrinsics.fDepthPrincipalX = depthIntrinsics.PrincipalPointX;
+		intrinsics.fDepthPrincipalY = depthIntrinsics.PrincipalPointY;
+
+		// all zeros (with S_OK) until the sensor streams
+		if (!intrinsics.IsValid())
+			hr = E_PENDING;
+	}
+
+	return hr;
+}
+
+#endif
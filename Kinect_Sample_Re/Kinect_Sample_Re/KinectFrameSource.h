@@ -0,0 +1,55 @@
+#pragma once
+
+#ifdef _WIN32
+
+#include "FrameSource.h"
+
+// frames from the default Kinect sensor through IMultiSourceFrameReader
+class KinectFrameSource : public FrameSource
+{
+public:
+	KinectFrameSource();
+	~KinectFrameSource();
+
+	HRESULT Open();
+	void Close();
+
+	HRESULT WaitForFrame(int iTimeoutMs);
+	HRESULT AcquireFrame(FrameData& frame);
+	void ReleaseFrame();
+
+	HRESULT MapColorFrameToCameraSpace(
+		UINT nDepthPointCount,
+		const UINT16* pDepthFrameData,
+		UINT nCameraPointCount,
+		CameraSpacePoint* pCameraSpacePoints);
+
+	HRESULT MapDepthFrameToColorSpace(
+		UINT nDepthPointCount,
+		const UINT16* pDepthFrameData,
+		UINT nColorPointCount,
+		ColorSpacePoint* pColorSpacePoints);
+
+	HRESULT GetDepthFrameToCameraSpaceTable(
+		UINT nTableEntryCount,
+		PointF* pTableEntries);
+
+	HRESULT GetSensorIntrinsics(SensorIntrinsics& intrinsics);
+
+	IKinectSensor* pKinectSensor;
+	IMultiSourceFrameReader* pMultiSourceFrameReader;
+	ICoordinateMapper* pCoordinateMapper;
+	// set by the reader whenever a new multi-source frame arrived
+	WAITABLE_HANDLE hFrameArrived;
+
+private:
+	IMultiSourceFrame* pMultiSourceFrame;
+	IDepthFrame* pDepthFrame;
+	IColorFrame* pColorFrame;
+	IInfraredFrame* pInfraredFrame;
+	IBodyIndexFrame* pBodyIndexFrame;
+
+	RGBQUAD* pColorBuffer;
+};
+
+#endif
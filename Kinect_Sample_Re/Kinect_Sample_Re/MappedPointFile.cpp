@@ -0,0 +1,326 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "MappedPointFile.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// headers are far smaller; this only bounds the search for their end
+static const size_t nMaxHeaderSize = 64 << 10;
+
+// size in bytes of a PLY property type, 0 when unknown
+static int PlyTypeSize(const char* szType)
+{
+	if (!strcmp(szType, "char") || !strcmp(szType, "uchar") || !strcmp(szType, "int8") || !strcmp(szType, "uint8"))
+		return 1;
+	if (!strcmp(szType, "short") || !strcmp(szType, "ushort") || !strcmp(szType, "int16") || !strcmp(szType, "uint16"))
+		return 2;
+	if (!strcmp(szType, "int") || !strcmp(szType, "uint") || !strcmp(szType, "float") ||
+		!strcmp(szType, "int32") || !strcmp(szType, "uint32") || !strcmp(szType, "float32"))
+		return 4;
+	if (!strcmp(szType, "double") || !strcmp(szType, "float64"))
+		return 8;
+	return 0;
+}
+
+// end of the header text (one past its last newline), or NULL
+static const char* FindHeaderEnd(const BYTE* pData, INT64 nSize, const char* szLastLine)
+{
+	const size_t nSearch = (size_t)(nSize < (INT64)nMaxHeaderSize ? nSize : nMaxHeaderSize);
+	const std::string text((const char*)pData, nSearch);
+
+	// the marker has to start a line
+	size_t nPosition = text.find(std::string("\n") + szLastLine);
+	if (nPosition == std::string::npos)
+		return NULL;
+	nPosition = text.find('\n', nPosition + 1);
+	if (nPosition == std::string::npos)
+		return NULL;
+	return (const char*)pData + nPosition + 1;
+}
+
+MappedPointFile::MappedPointFile() :
+nPoints(0),
+pData(NULL),
+nSize(0),
+#ifdef _WIN32
+hFile(INVALID_HANDLE_VALUE),
+hMapping(NULL),
+#endif
+pRecords(NULL),
+nStride(0),
+iOffsetX(-1),
+iOffsetY(-1),
+iOffsetZ(-1),
+iOffsetRed(-1),
+iOffsetGreen(-1),
+iOffsetBlue(-1),
+bPackedColor(false)
+{
+}
+
+MappedPointFile::~MappedPointFile()
+{
+	Close();
+}
+
+bool MappedPointFile::Open(const char* szPath)
+{
+	Close();
+
+#ifdef _WIN32
+	hFile = CreateFileA(szPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	LARGE_INTEGER size;
+	if (hFile == INVALID_HANDLE_VALUE || !GetFileSizeEx(hFile, &size) || size.QuadPart == 0)
+	{
+		printf("Cannot open %s\n", szPath);
+		Close();
+		return false;
+	}
+	nSize = size.QuadPart;
+
+	hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (hMapping != NULL)
+		pData = (const BYTE*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	const int iFile = open(szPath, O_RDONLY);
+	struct stat status;
+	if (iFile < 0 || fstat(iFile, &status) != 0 || status.st_size == 0)
+	{
+		printf("Cannot open %s\n", szPath);
+		if (iFile >= 0)	close(iFile);
+		return false;
+	}
+	nSize = status.st_size;
+
+	// the mapping keeps its own reference to the file
+	void* pMapping = mmap(NULL, (size_t)nSize, PROT_READ, MAP_PRIVATE, iFile, 0);
+	close(iFile);
+	if (pMapping != MAP_FAILED)
+		pData = (const BYTE*)pMapping;
+#endif
+
+	if (pData == NULL)
+	{
+		printf("Cannot map %s\n", szPath);
+		Close();
+		return false;
+	}
+
+	bool bParsed = false;
+	const char* pEnd;
+	if (nSize > 3 && memcmp(pData, "ply", 3) == 0 && (pEnd = FindHeaderEnd(pData, nSize, "end_header")) != NULL)
+		bParsed = ParsePly((const char*)pData, pEnd - (const char*)pData);
+	else if ((pEnd = FindHeaderEnd(pData, nSize, "DATA")) != NULL)
+		bParsed = ParsePcd((const char*)pData, pEnd - (const char*)pData);
+
+	if (bParsed)
+	{
+		pRecords = (const BYTE*)pEnd;
+		bParsed = iOffsetX >= 0 && iOffsetY >= 0 && iOffsetZ >= 0 &&
+			(pRecords - pData) + nPoints * nStride <= nSize;
+	}
+	if (!bParsed)
+	{
+		printf("Not a binary PLY/PCD point file with float x, y, z: %s\n", szPath);
+		Close();
+		return false;
+	}
+
+#ifndef _WIN32
+	// blocks are mostly visited in file order
+	madvise((void*)pData, (size_t)nSize, MADV_SEQUENTIAL);
+#endif
+
+	return true;
+}
+
+void MappedPointFile::Close()
+{
+#ifdef _WIN32
+	if (pData != NULL)	UnmapViewOfFile(pData);
+	if (hMapping != NULL)	CloseHandle(hMapping);
+	if (hFile != INVALID_HANDLE_VALUE)	CloseHandle(hFile);
+	hMapping = NULL;
+	hFile = INVALID_HANDLE_VALUE;
+#else
+	if (pData != NULL)	munmap((void*)pData, (size_t)nSize);
+#endif
+	pData = NULL;
+	nSize = 0;
+	pRecords = NULL;
+	nPoints = 0;
+	nStride = 0;
+	iOffsetX = iOffsetY = iOffsetZ = -1;
+	iOffsetRed = iOffsetGreen = iOffsetBlue = -1;
+	bPackedColor = false;
+}
+
+bool MappedPointFile::ParsePly(const char* pHeader, size_t nHeaderSize)
+{
+	const std::string text(pHeader, nHeaderSize);
+	bool bBinary = false;
+	bool bInVertex = false;
+	bool bVertexSeen = false;
+
+	for (size_t nBegin = 0, nEnd; (nEnd = text.find('\n', nBegin)) != std::string::npos; nBegin = nEnd + 1)
+	{
+		const std::string line = text.substr(nBegin, nEnd - nBegin);
+		char szWord[64], szType[64], szName[64];
+		long long nCount;
+
+		if (line.compare(0, 7, "format ") == 0)
+		{
+			bBinary = line.compare(0, 27, "format binary_little_endian") == 0;
+		}
+		else if (sscanf(line.c_str(), "element %63s %lld", szWord, &nCount) == 2)
+		{
+			// only the leading vertex element is read; anything after it is ignored
+			bInVertex = !bVertexSeen && strcmp(szWord, "vertex") == 0;
+			if (bInVertex)
+			{
+				nPoints = nCount;
+				bVertexSeen = true;
+			}
+			else if (!bVertexSeen)
+				return false;
+		}
+		else if (bInVertex && sscanf(line.c_str(), "property %63s %63s", szType, szName) == 2)
+		{
+			const int nTypeSize = PlyTypeSize(szType);
+			if (nTypeSize == 0)
+				return false;
+
+			const bool bFloat = !strcmp(szType, "float") || !strcmp(szType, "float32");
+			const bool bByte = nTypeSize == 1;
+			if (bFloat && !strcmp(szName, "x"))	iOffsetX = nStride;
+			else if (bFloat && !strcmp(szName, "y"))	iOffsetY = nStride;
+			else if (bFloat && !strcmp(szName, "z"))	iOffsetZ = nStride;
+			else if (bByte && (!strcmp(szName, "red") || !strcmp(szName, "r")))	iOffsetRed = nStride;
+			else if (bByte && (!strcmp(szName, "green") || !strcmp(szName, "g")))	iOffsetGreen = nStride;
+			else if (bByte && (!strcmp(szName, "blue") || !strcmp(szName, "b")))	iOffsetBlue = nStride;
+			nStride += nTypeSize;
+		}
+	}
+
+	if (iOffsetRed < 0 || iOffsetGreen < 0 || iOffsetBlue < 0)
+		iOffsetRed = iOffsetGreen = iOffsetBlue = -1;
+
+	return bBinary && bVertexSeen && nStride > 0;
+}
+
+bool MappedPointFile::ParsePcd(const char* pHeader, size_t nHeaderSize)
+{
+	const std::string text(pHeader, nHeaderSize);
+	std::string fields, sizes, types, counts;
+	bool bBinary = false;
+
+	for (size_t nBegin = 0, nEnd; (nEnd = text.find('\n', nBegin)) != std::string::npos; nBegin = nEnd + 1)
+	{
+		const std::string line = text.substr(nBegin, nEnd - nBegin);
+		long long nCount;
+
+		if (line.compare(0, 7, "FIELDS ") == 0)	fields = line.substr(7);
+		else if (line.compare(0, 5, "SIZE ") == 0)	sizes = line.substr(5);
+		else if (line.compare(0, 5, "TYPE ") == 0)	types = line.substr(5);
+		else if (line.compare(0, 6, "COUNT ") == 0)	counts = line.substr(6);
+		else if (sscanf(line.c_str(), "POINTS %lld", &nCount) == 1)	nPoints = nCount;
+		// binary_compressed cannot be read in place
+		else if (line.compare(0, 5, "DATA ") == 0)	bBinary = line.compare(5, std::string::npos, "binary") == 0 ||
+			line.compare(5, std::string::npos, "binary\r") == 0;
+	}
+	if (!bBinary || fields.empty())
+		return false;
+
+	// walk the four parallel lists
+	const char* pFields = fields.c_str();
+	const char* pSizes = sizes.c_str();
+	const char* pTypes = types.c_str();
+	const char* pCounts = counts.c_str();
+	char szField[64], szType[8];
+	int nFieldSize, nFieldCount, nRead;
+	while (sscanf(pFields, "%63s%n", szField, &nRead) == 1)
+	{
+		pFields += nRead;
+		if (sscanf(pSizes, "%d%n", &nFieldSize, &nRead) != 1)
+			return false;
+		pSizes += nRead;
+		if (sscanf(pTypes, "%7s%n", szType, &nRead) != 1)
+			return false;
+		pTypes += nRead;
+		// COUNT is optional and defaults to 1
+		if (sscanf(pCounts, "%d%n", &nFieldCount, &nRead) == 1)
+			pCounts += nRead;
+		else
+			nFieldCount = 1;
+
+		const bool bFloat = nFieldSize == 4 && szType[0] == 'F';
+		if (bFloat && !strcmp(szField, "x"))	iOffsetX = nStride;
+		else if (bFloat && !strcmp(szField, "y"))	iOffsetY = nStride;
+		else if (bFloat && !strcmp(szField, "z"))	iOffsetZ = nStride;
+		else if (nFieldSize == 4 && (!strcmp(szField, "rgb") || !strcmp(szField, "rgba")))
+		{
+			iOffsetRed = iOffsetGreen = iOffsetBlue = nStride;
+			bPackedColor = true;
+		}
+		nStride += nFieldSize * nFieldCount;
+	}
+
+	return nStride > 0;
+}
+
+int MappedPointFile::Unpack(INT64 nFirst, int nCount, float* pXYZ, unsigned int* pColor) const
+{
+	if (pData == NULL || nFirst < 0 || nFirst >= nPoints)
+		return 0;
+	if (nFirst + nCount > nPoints)
+		nCount = (int)(nPoints - nFirst);
+
+	const BYTE* pRecord = pRecords + nFirst * nStride;
+	for (int ii = 0; ii < nCount; ii++, pRecord += nStride, pXYZ += 3)
+	{
+		memcpy(&pXYZ[0], pRecord + iOffsetX, sizeof(float));
+		memcpy(&pXYZ[1], pRecord + iOffsetY, sizeof(float));
+		memcpy(&pXYZ[2], pRecord + iOffsetZ, sizeof(float));
+
+		// colors are bytes R, G, B, A in memory
+		if (iOffsetRed < 0)
+		{
+			pColor[ii] = 0xffffffff;
+		}
+		else if (bPackedColor)
+		{
+			unsigned int rgb;
+			memcpy(&rgb, pRecord + iOffsetRed, sizeof(rgb));
+			pColor[ii] = 0xff000000 | ((rgb >> 16) & 0xff) | (rgb & 0xff00) | ((rgb & 0xff) << 16);
+		}
+		else
+		{
+			pColor[ii] = 0xff000000 | pRecord[iOffsetRed] | (pRecord[iOffsetGreen] << 8) | (pRecord[iOffsetBlue] << 16);
+		}
+	}
+
+	return nCount;
+}
+
+void MappedPointFile::Prefetch(INT64 nFirst, INT64 nCount) const
+{
+	if (pData == NULL || nFirst < 0 || nFirst >= nPoints)
+		return;
+	if (nFirst + nCount > nPoints)
+		nCount = nPoints - nFirst;
+
+#ifdef _WIN32
+	// PrefetchVirtualMemory needs Windows 8; there the first touch reads the pages
+#else
+	const size_t nPageSize = (size_t)sysconf(_SC_PAGESIZE);
+	const size_t nBegin = (size_t)(pRecords - pData) + (size_t)(nFirst * nStride);
+	const size_t nAligned = nBegin & ~(nPageSize - 1);
+	madvise((void*)(pData + nAligned), nBegin - nAligned + (size_t)(nCount * nStride), MADV_WILLNEED);
+#endif
+}
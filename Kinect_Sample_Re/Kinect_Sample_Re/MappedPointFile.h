@@ -0,0 +1,53 @@
+#pragma once
+
+#include "KinectCompat.h"
+
+// Read-only view of a binary PLY or PCD point file (as written by
+// CloudWriter) through a memory mapping. Open() only maps the file and
+// parses its header, so it costs the same for a few MB as for many GB;
+// the pages of the points are read by the OS when Unpack() touches them.
+class MappedPointFile
+{
+public:
+	MappedPointFile();
+	~MappedPointFile();
+
+	bool Open(const char* szPath);
+	void Close();
+	bool IsOpen() const { return pData != NULL; }
+
+	// unpacks up to nCount points starting at nFirst into interleaved xyz and
+	// RGBA colors (white when the file has none); returns how many there were
+	int Unpack(INT64 nFirst, int nCount, float* pXYZ, unsigned int* pColor) const;
+
+	// hints the OS to start reading these points in the background
+	void Prefetch(INT64 nFirst, INT64 nCount) const;
+
+	INT64 nPoints;
+
+private:
+	bool ParsePly(const char* pHeader, size_t nHeaderSize);
+	bool ParsePcd(const char* pHeader, size_t nHeaderSize);
+
+	MappedPointFile(const MappedPointFile&);
+	MappedPointFile& operator=(const MappedPointFile&);
+
+	const BYTE* pData;
+	INT64 nSize;
+#ifdef _WIN32
+	HANDLE hFile;
+	HANDLE hMapping;
+#endif
+
+	// layout of one point record
+	const BYTE* pRecords;
+	int nStride;
+	int iOffsetX;
+	int iOffsetY;
+	int iOffsetZ;
+	// -1 without color; a PCD rgb field is packed in one float
+	int iOffsetRed;
+	int iOffsetGreen;
+	int iOffsetBlue;
+	bool bPackedColor;
+};
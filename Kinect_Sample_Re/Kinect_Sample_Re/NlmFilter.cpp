@@ -0,0 +1,369 @@
+#include <math.h>
+#include <string.h>
+#include "NlmFilter.h"
+#include "ParallelFor.h"
+#include "CpuFeatures.h"
+
+#ifdef KINECT_X86
+#include <emmintrin.h>
+#endif
+
+// weights below exp(-8) are dropped
+static const float fMaxDistance = 8.0f;
+// differences are clamped, so a patch sum always fits in 32 bits
+static const int nMaxDifference = 255;
+static const unsigned int nMaxSquare = nMaxDifference * nMaxDifference;
+
+// exp(-t) for t >= 0 as 2^(-t log2 e): exponent bits for the integer part,
+// a polynomial for the fraction (relative error below 1e-5)
+static inline float ExpNegative(float t)
+{
+	const float x = -t * 1.44269504f;
+	const float i = floorf(x);
+	const float f = x - i;
+	const float p = 1.0f + f * (0.6931472f + f * (0.2402265f + f * (0.0555041f + f * 0.0096181f)));
+	union { int n; float v; } scale;
+	scale.n = ((int)i + 127) << 23;
+	return p * scale.v;
+}
+
+#ifdef KINECT_X86
+static inline __m128 ExpNegative(__m128 t)
+{
+	const __m128 x = _mm_mul_ps(t, _mm_set1_ps(-1.44269504f));
+	__m128i i = _mm_cvttps_epi32(x);
+	// truncation rounds toward zero; make it floor for negative x
+	i = _mm_add_epi32(i, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(i), x)));
+	const __m128 f = _mm_sub_ps(x, _mm_cvtepi32_ps(i));
+
+	__m128 p = _mm_set1_ps(0.0096181f);
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.0555041f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.2402265f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.6931472f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f));
+
+	const __m128i scale = _mm_slli_epi32(_mm_add_epi32(i, _mm_set1_epi32(127)), 23);
+	return _mm_mul_ps(p, _mm_castsi128_ps(scale));
+}
+
+static inline __m128 LoadDepth4(const UINT16* p)
+{
+	const __m128i d = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+	return _mm_cvtepi32_ps(_mm_unpacklo_epi16(d, _mm_setzero_si128()));
+}
+#endif
+
+NlmFilter::NlmFilter() :
+nWidth(0),
+nHeight(0),
+iSearchRadius(0),
+iPatchRadius(0),
+fH(0)
+{
+}
+
+NlmFilter::~NlmFilter()
+{
+}
+
+void NlmFilter::Initialize(int nWidth, int nHeight, int iSearchRadius, int iPatchRadius, float fH)
+{
+	this->nWidth = nWidth;
+	this->nHeight = nHeight;
+	this->iSearchRadius = iSearchRadius;
+	this->iPatchRadius = iPatchRadius;
+	this->fH = fH;
+
+	invPatchWidth.resize(nWidth);
+	for (int xx = 0; xx < nWidth; xx++)
+	{
+		const int x0 = xx - iPatchRadius < 0 ? 0 : xx - iPatchRadius;
+		const int x1 = xx + iPatchRadius >= nWidth ? nWidth - 1 : xx + iPatchRadius;
+		invPatchWidth[xx] = 1.0f / (x1 - x0 + 1);
+	}
+	invPatchHeight.resize(nHeight);
+	for (int yy = 0; yy < nHeight; yy++)
+	{
+		const int y0 = yy - iPatchRadius < 0 ? 0 : yy - iPatchRadius;
+		const int y1 = yy + iPatchRadius >= nHeight ? nHeight - 1 : yy + iPatchRadius;
+		invPatchHeight[yy] = 1.0f / (y1 - y0 + 1);
+	}
+
+	// one band per thread; the integral image covers the patch rows above
+	// and below the band, the accumulators the search rows below it
+	const int nBands = ParallelThreadCount();
+	bands.resize(nBands);
+	for (int bb = 0; bb < nBands; bb++)
+	{
+		Band& band = bands[bb];
+		band.nBegin = nHeight * bb / nBands;
+		band.nEnd = nHeight * (bb + 1) / nBands;
+
+		const int nRows = band.nEnd - band.nBegin;
+		band.integral.resize((nRows + 2 * iPatchRadius + 1) * (nWidth + 1));
+		band.weightSum.resize((nRows + iSearchRadius) * nWidth);
+		band.depthSum.resize((nRows + iSearchRadius) * nWidth);
+	}
+}
+
+void NlmFilter::Filter(const UINT16* pSrc, UINT16* pDst)
+{
+	ParallelFor((int)bands.size(), [&](int nBegin, int nEnd)
+	{
+		for (int bb = nBegin; bb < nEnd; bb++)
+			AccumulateBand(bands[bb], pSrc);
+	});
+
+	// hand the rows each band reached below itself to their owners
+	for (size_t bb = 0; bb < bands.size(); bb++)
+	{
+		const Band& band = bands[bb];
+		for (int yy = band.nEnd; yy < band.nEnd + iSearchRadius && yy < nHeight; yy++)
+		{
+			const float* pWeightSrc = &band.weightSum[(yy - band.nBegin) * nWidth];
+			const float* pDepthSrc = &band.depthSum[(yy - band.nBegin) * nWidth];
+
+			size_t iOwner = bb + 1;
+			while (bands[iOwner].nEnd <= yy) iOwner++;
+			Band& owner = bands[iOwner];
+			float* pWeightDst = &owner.weightSum[(yy - owner.nBegin) * nWidth];
+			float* pDepthDst = &owner.depthSum[(yy - owner.nBegin) * nWidth];
+
+			for (int xx = 0; xx < nWidth; xx++)
+			{
+				pWeightDst[xx] += pWeightSrc[xx];
+				pDepthDst[xx] += pDepthSrc[xx];
+			}
+		}
+	}
+
+	ParallelFor((int)bands.size(), [&](int nBegin, int nEnd)
+	{
+		for (int bb = nBegin; bb < nEnd; bb++)
+		{
+			const Band& band = bands[bb];
+			for (int ii = 0; ii < (band.nEnd - band.nBegin) * nWidth; ii++)
+			{
+				const float w = band.weightSum[ii];
+				pDst[band.nBegin * nWidth + ii] = w > 0 ? (UINT16)(band.depthSum[ii] / w + 0.5f) : 0;
+			}
+		}
+	});
+}
+
+void NlmFilter::BuildIntegral(Band& band, const UINT16* pSrc, int dx, int dy, int ya, int yb)
+{
+	const int W = nWidth;
+	const int nStride = W + 1;
+	unsigned int* pIntegral = &band.integral[0];
+
+	// columns whose shifted pixel is inside the image
+	const int x0 = dx < 0 ? -dx : 0;
+	const int x1 = dx > 0 ? W - dx : W;
+
+	// unsigned arithmetic wraps, but box sums come out exact as long as they
+	// fit in 32 bits, which the clamping guarantees
+	memset(pIntegral, 0, sizeof(unsigned int)* nStride);
+	for (int yy = ya; yy < yb; yy++)
+	{
+		unsigned int* pRow = pIntegral + (yy - ya + 1) * nStride;
+		const unsigned int* pPrevRow = pRow - nStride;
+		unsigned int* pSquares = pRow + 1;
+		const UINT16* pSrcRow = pSrc + yy * W;
+		const int qy = yy + dy;
+		pRow[0] = 0;
+
+		// squared, clamped differences to the shifted row
+		int xx = 0;
+		if (qy < nHeight)
+		{
+			const UINT16* pShiftedRow = pSrc + qy * W + dx;
+			for (; xx < x0; xx++)
+				pSquares[xx] = nMaxSquare;
+
+#ifdef KINECT_X86
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i maxDifference = _mm_set1_epi16(nMaxDifference);
+			for (; xx + 8 <= x1; xx += 8)
+			{
+				const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrcRow + xx));
+				const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pShiftedRow + xx));
+				__m128i d = _mm_or_si128(_mm_subs_epu16(a, b), _mm_subs_epu16(b, a));
+				// min(d, 255), and 255 where either pixel has no depth
+				d = _mm_sub_epi16(d, _mm_subs_epu16(d, maxDifference));
+				const __m128i invalid = _mm_or_si128(_mm_cmpeq_epi16(a, zero), _mm_cmpeq_epi16(b, zero));
+				d = _mm_or_si128(_mm_andnot_si128(invalid, d), _mm_and_si128(invalid, maxDifference));
+				// 255^2 still fits in 16 bits
+				const __m128i square = _mm_mullo_epi16(d, d);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pSquares + xx), _mm_unpacklo_epi16(square, zero));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pSquares + xx + 4), _mm_unpackhi_epi16(square, zero));
+			}
+#endif
+
+			for (; xx < x1; xx++)
+			{
+				unsigned int nSquare = nMaxSquare;
+				if (pSrcRow[xx] != 0 && pShiftedRow[xx] != 0)
+				{
+					int nDifference = (int)pSrcRow[xx] - (int)pShiftedRow[xx];
+					if (nDifference < 0) nDifference = -nDifference;
+					if (nDifference < nMaxDifference)
+						nSquare = nDifference * nDifference;
+				}
+				pSquares[xx] = nSquare;
+			}
+		}
+		for (; xx < W; xx++)
+			pSquares[xx] = nMaxSquare;
+
+		// running row sum plus the row above
+		xx = 0;
+		unsigned int nRowSum = 0;
+#ifdef KINECT_X86
+		__m128i carry = _mm_setzero_si128();
+		for (; xx + 4 <= W; xx += 4)
+		{
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSquares + xx));
+			v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+			v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+			v = _mm_add_epi32(v, carry);
+			carry = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 3));
+			const __m128i above = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pPrevRow + xx + 1));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pRow + xx + 1), _mm_add_epi32(v, above));
+		}
+		nRowSum = (unsigned int)_mm_cvtsi128_si32(carry);
+#endif
+		for (; xx < W; xx++)
+		{
+			nRowSum += pSquares[xx];
+			pRow[xx + 1] = pPrevRow[xx + 1] + nRowSum;
+		}
+	}
+}
+
+void NlmFilter::AccumulateBand(Band& band, const UINT16* pSrc)
+{
+	const int P = iPatchRadius;
+	const int S = iSearchRadius;
+	const int W = nWidth;
+	const int H = nHeight;
+	const int nStride = W + 1;
+
+	// rows covered by the patches of this band
+	const int ya = band.nBegin - P < 0 ? 0 : band.nBegin - P;
+	const int yb = band.nEnd + P > H ? H : band.nEnd + P;
+
+	const unsigned int* pIntegral = &band.integral[0];
+	float* pWeightSum = &band.weightSum[0];
+	float* pDepthSum = &band.depthSum[0];
+
+	// the pixel itself, with weight 1
+	memset(pWeightSum, 0, sizeof(float)* band.weightSum.size());
+	memset(pDepthSum, 0, sizeof(float)* band.depthSum.size());
+	for (int yy = band.nBegin; yy < band.nEnd; yy++)
+	{
+		for (int xx = 0; xx < W; xx++)
+		{
+			const int ii = (yy - band.nBegin) * W + xx;
+			const UINT16 d = pSrc[yy * W + xx];
+			pWeightSum[ii] = d != 0 ? 1.0f : 0.0f;
+			pDepthSum[ii] = d;
+		}
+	}
+
+	// the patch distance between p and q = p + d is also the one between q
+	// and p, so only half of the offsets are visited and each weight goes
+	// to both pixels
+	for (int dy = 0; dy <= S; dy++)
+	{
+		for (int dx = -S; dx <= S; dx++)
+		{
+			if (dy == 0 && dx <= 0) continue;
+
+			BuildIntegral(band, pSrc, dx, dy, ya, yb);
+
+			const int x0 = dx < 0 ? -dx : 0;
+			const int x1 = dx > 0 ? W - dx : W;
+			for (int yy = band.nBegin; yy < band.nEnd && yy + dy < H; yy++)
+			{
+				const int r0 = (yy - P < 0 ? 0 : yy - P) - ya;
+				const int r1 = (yy + P >= H ? H - 1 : yy + P) - ya + 1;
+				const unsigned int* pTop = pIntegral + r0 * nStride;
+				const unsigned int* pBottom = pIntegral + r1 * nStride;
+				const UINT16* pSrcRow = pSrc + yy * W;
+				const UINT16* pShiftedRow = pSrc + (yy + dy) * W + dx;
+				const float fRowScale = invPatchHeight[yy] / (fH * fH);
+				float* pWeightRow = pWeightSum + (yy - band.nBegin) * W;
+				float* pDepthRow = pDepthSum + (yy - band.nBegin) * W;
+				float* pWeightRowQ = pWeightSum + (yy + dy - band.nBegin) * W + dx;
+				float* pDepthRowQ = pDepthSum + (yy + dy - band.nBegin) * W + dx;
+
+				int xx = x0;
+
+#ifdef KINECT_X86
+				// interior: full patch width, 4 pixels at a time; for dy == 0
+				// the q lanes overlap the p lanes, which is fine as long as
+				// every update is a load/add/store in program order
+				const int xa = x0 > P ? x0 : P;
+				const int xe = x1 < W - P ? x1 : W - P;
+				const __m128 scale = _mm_set1_ps(fRowScale / (2 * P + 1));
+				const __m128 maxDistance = _mm_set1_ps(fMaxDistance);
+				const __m128 zero = _mm_setzero_ps();
+				for (; xx < xa; xx++)
+					AccumulatePixel(xx, P, pTop, pBottom, pSrcRow, pShiftedRow, fRowScale, pWeightRow, pDepthRow, pWeightRowQ, pDepthRowQ);
+				for (; xx + 4 <= xe; xx += 4)
+				{
+					const __m128i top1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pTop + xx + P + 1));
+					const __m128i bottom1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pBottom + xx + P + 1));
+					const __m128i top0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pTop + xx - P));
+					const __m128i bottom0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pBottom + xx - P));
+					const __m128i distance = _mm_add_epi32(_mm_sub_epi32(bottom1, top1), _mm_sub_epi32(top0, bottom0));
+					const __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(distance), scale);
+
+					const __m128 a = LoadDepth4(pSrcRow + xx);
+					const __m128 b = LoadDepth4(pShiftedRow + xx);
+					const __m128 mask = _mm_and_ps(
+						_mm_and_ps(_mm_cmpgt_ps(a, zero), _mm_cmpgt_ps(b, zero)),
+						_mm_cmplt_ps(t, maxDistance));
+					if (_mm_movemask_ps(mask) == 0) continue;
+					const __m128 w = _mm_and_ps(ExpNegative(t), mask);
+
+					_mm_storeu_ps(pWeightRow + xx, _mm_add_ps(_mm_loadu_ps(pWeightRow + xx), w));
+					_mm_storeu_ps(pDepthRow + xx, _mm_add_ps(_mm_loadu_ps(pDepthRow + xx), _mm_mul_ps(w, b)));
+					_mm_storeu_ps(pWeightRowQ + xx, _mm_add_ps(_mm_loadu_ps(pWeightRowQ + xx), w));
+					_mm_storeu_ps(pDepthRowQ + xx, _mm_add_ps(_mm_loadu_ps(pDepthRowQ + xx), _mm_mul_ps(w, a)));
+				}
+#endif
+
+				for (; xx < x1; xx++)
+					AccumulatePixel(xx, P, pTop, pBottom, pSrcRow, pShiftedRow, fRowScale, pWeightRow, pDepthRow, pWeightRowQ, pDepthRowQ);
+			}
+		}
+	}
+}
+
+void NlmFilter::AccumulatePixel(
+	int xx, int P,
+	const unsigned int* pTop, const unsigned int* pBottom,
+	const UINT16* pSrcRow, const UINT16* pShiftedRow,
+	float fRowScale,
+	float* pWeightRow, float* pDepthRow,
+	float* pWeightRowQ, float* pDepthRowQ) const
+{
+	const UINT16 a = pSrcRow[xx];
+	const UINT16 b = pShiftedRow[xx];
+	if (a == 0 || b == 0) return;
+
+	const int c0 = xx - P < 0 ? 0 : xx - P;
+	const int c1 = (xx + P >= nWidth ? nWidth - 1 : xx + P) + 1;
+	const unsigned int nDistance = pBottom[c1] - pTop[c1] - pBottom[c0] + pTop[c0];
+
+	const float t = nDistance * invPatchWidth[xx] * fRowScale;
+	if (t >= fMaxDistance) return;
+
+	const float w = ExpNegative(t);
+	pWeightRow[xx] += w;
+	pDepthRow[xx] += w * b;
+	pWeightRowQ[xx] += w;
+	pDepthRowQ[xx] += w * a;
+}
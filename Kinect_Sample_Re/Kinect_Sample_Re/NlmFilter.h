@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include "KinectCompat.h"
+
+// Non-local means denoising of a depth image [mm], in the integral image
+// formulation (Darbon et al. 2008): for every search offset, the squared
+// differences between the image and its shifted copy are summed into an
+// integral image, so each patch distance is four lookups and the cost does
+// not depend on the patch size. Patch distances are symmetric, so only half
+// of the offsets are visited. Pixels without depth (0) stay 0 and never
+// contribute. The image is split into row bands processed in parallel,
+// each with its own integral image and accumulators.
+class NlmFilter
+{
+public:
+	NlmFilter();
+	~NlmFilter();
+
+	void Initialize(int nWidth, int nHeight, int iSearchRadius = 3, int iPatchRadius = 2, float fH = 12.0f);
+
+	// pSrc and pDst must not overlap
+	void Filter(const UINT16* pSrc, UINT16* pDst);
+
+	int nWidth;
+	int nHeight;
+	int iSearchRadius;
+	int iPatchRadius;
+	// filtering strength [mm]: patches differing by about fH per pixel get
+	// weight exp(-1)
+	float fH;
+
+private:
+	struct Band
+	{
+		int nBegin;
+		int nEnd;
+		std::vector<unsigned int> integral;
+		std::vector<float> weightSum;
+		std::vector<float> depthSum;
+	};
+
+	void BuildIntegral(Band& band, const UINT16* pSrc, int dx, int dy, int ya, int yb);
+	void AccumulateBand(Band& band, const UINT16* pSrc);
+	void AccumulatePixel(
+		int xx, int P,
+		const unsigned int* pTop, const unsigned int* pBottom,
+		const UINT16* pSrcRow, const UINT16* pShiftedRow,
+		float fRowScale,
+		float* pWeightRow, float* pDepthRow,
+		float* pWeightRowQ, float* pDepthRowQ) const;
+
+	NlmFilter(const NlmFilter&);
+	NlmFilter& operator=(const NlmFilter&);
+
+	std::vector<Band> bands;
+
+	// 1 / patch width (height) at each column (row); patches are clipped
+	// at the image border
+	std::vector<float> invPatchWidth;
+	std::vector<float> invPatchHeight;
+};
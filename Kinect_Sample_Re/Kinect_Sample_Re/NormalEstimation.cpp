@@ -0,0 +1,163 @@
+#include <math.h>
+#include <string.h>
+#include "NormalEstimation.h"
+#include "ParallelFor.h"
+
+// rows per integral image; keeps the sums small enough for floats and the
+// image in cache
+static const int nChunkRows = 64;
+// sums of the horizontal (x, y, z) and vertical (x, y, z) differences
+static const int nChannels = 6;
+
+NormalEstimator::NormalEstimator() :
+iWindowRadius(4),
+fMaxDepthChange(0.02f)
+{
+}
+
+NormalEstimator::~NormalEstimator()
+{
+}
+
+void NormalEstimator::Initialize(int iWindowRadius, float fMaxDepthChange)
+{
+	this->iWindowRadius = iWindowRadius;
+	this->fMaxDepthChange = fMaxDepthChange;
+}
+
+void NormalEstimator::Compute(const PointCloud& cloud, NormalMap& normals)
+{
+	normals.Reshape(cloud.nWidth, cloud.nHeight);
+
+	// there are no points outside the extent
+	const PixelRect rect = cloud.extent;
+	if (rect.Empty())
+		return;
+
+	const int nBands = ParallelThreadCount();
+	if ((int)integrals.size() < nBands)
+		integrals.resize(nBands);
+
+	ParallelFor(nBands, [&](int nBegin, int nEnd)
+	{
+		for (int bb = nBegin; bb < nEnd; bb++)
+		{
+			const int nTop = rect.nTop + rect.Height() * bb / nBands;
+			const int nBottom = rect.nTop + rect.Height() * (bb + 1) / nBands;
+			for (int yy = nTop; yy < nBottom; yy += nChunkRows)
+				EstimateRows(cloud, rect, yy, yy + nChunkRows < nBottom ? yy + nChunkRows : nBottom, integrals[bb], normals);
+		}
+	});
+}
+
+void NormalEstimator::EstimateRows(
+	const PointCloud& cloud,
+	const PixelRect& rect,
+	int nBegin, int nEnd,
+	std::vector<float>& integral,
+	NormalMap& normals) const
+{
+	const int W = cloud.nWidth;
+	const int R = iWindowRadius;
+	const float* pX = cloud.pX;
+	const float* pY = cloud.pY;
+	const float* pZ = cloud.pZ;
+
+	// the integral image covers the window rows above and below the chunk
+	const int ya = nBegin - R > rect.nTop ? nBegin - R : rect.nTop;
+	const int yb = nEnd + R < rect.nBottom ? nEnd + R : rect.nBottom;
+	const int nCols = rect.Width();
+	const int nStride = (nCols + 1) * nChannels;
+	if ((int)integral.size() < (yb - ya + 1) * nStride)
+		integral.resize((yb - ya + 1) * nStride);
+	float* pIntegral = &integral[0];
+
+	memset(pIntegral, 0, sizeof(float)* nStride);
+	for (int yy = ya; yy < yb; yy++)
+	{
+		float* pRow = pIntegral + (yy - ya + 1) * nStride;
+		const float* pPrevRow = pRow - nStride;
+		const bool bVertical = yy > rect.nTop && yy + 1 < rect.nBottom;
+		float sum[nChannels] = { 0, 0, 0, 0, 0, 0 };
+
+		memset(pRow, 0, sizeof(float)* nChannels);
+		for (int xx = rect.nLeft; xx < rect.nRight; xx++)
+		{
+			const int idx = yy * W + xx;
+
+			// central differences, unless a neighbor is missing or behind a
+			// jump; selected by a 0/1 factor rather than a branch, since
+			// misses are frequent along object borders
+			if (xx > rect.nLeft && xx + 1 < rect.nRight)
+			{
+				const float Za = pZ[idx - 1];
+				const float Zb = pZ[idx + 1];
+				const float fKeep = Za > 0 && Zb > 0 && fabsf(Zb - Za) <= fMaxDepthChange * (Za + Zb) ? 1.0f : 0.0f;
+				sum[0] += fKeep * (pX[idx + 1] - pX[idx - 1]);
+				sum[1] += fKeep * (pY[idx + 1] - pY[idx - 1]);
+				sum[2] += fKeep * (Zb - Za);
+			}
+			if (bVertical)
+			{
+				const float Za = pZ[idx - W];
+				const float Zb = pZ[idx + W];
+				const float fKeep = Za > 0 && Zb > 0 && fabsf(Zb - Za) <= fMaxDepthChange * (Za + Zb) ? 1.0f : 0.0f;
+				sum[3] += fKeep * (pX[idx + W] - pX[idx - W]);
+				sum[4] += fKeep * (pY[idx + W] - pY[idx - W]);
+				sum[5] += fKeep * (Zb - Za);
+			}
+
+			float* pEntry = pRow + (xx - rect.nLeft + 1) * nChannels;
+			const float* pAbove = pPrevRow + (xx - rect.nLeft + 1) * nChannels;
+			for (int ch = 0; ch < nChannels; ch++)
+				pEntry[ch] = pAbove[ch] + sum[ch];
+		}
+	}
+
+	for (int yy = nBegin; yy < nEnd; yy++)
+	{
+		// window rows, clipped to the integral image
+		const int r0 = (yy - R > ya ? yy - R : ya) - ya;
+		const int r1 = (yy + R + 1 < yb ? yy + R + 1 : yb) - ya;
+		const float* pTop = pIntegral + r0 * nStride;
+		const float* pBottom = pIntegral + r1 * nStride;
+
+		for (int xx = rect.nLeft; xx < rect.nRight; xx++)
+		{
+			const int idx = yy * W + xx;
+			const float Z = pZ[idx];
+			if (Z <= 0)
+				continue;
+
+			const int c0 = (xx - R > rect.nLeft ? xx - R : rect.nLeft) - rect.nLeft;
+			const int c1 = (xx + R + 1 < rect.nRight ? xx + R + 1 : rect.nRight) - rect.nLeft;
+			float g[nChannels];
+			for (int ch = 0; ch < nChannels; ch++)
+			{
+				g[ch] = pBottom[c1 * nChannels + ch] - pTop[c1 * nChannels + ch]
+					- pBottom[c0 * nChannels + ch] + pTop[c0 * nChannels + ch];
+			}
+
+			// horizontal x vertical gradient; either sign is a normal
+			float nx = g[1] * g[5] - g[2] * g[4];
+			float ny = g[2] * g[3] - g[0] * g[5];
+			float nz = g[0] * g[4] - g[1] * g[3];
+			const float fLength2 = nx * nx + ny * ny + nz * nz;
+			if (fLength2 < 1e-24f)
+			{
+				normals.pX[idx] = 0;
+				normals.pY[idx] = 0;
+				normals.pZ[idx] = 0;
+				continue;
+			}
+
+			// toward the sensor at the origin
+			float fScale = 1.0f / sqrtf(fLength2);
+			if (nx * pX[idx] + ny * pY[idx] + nz * Z > 0)
+				fScale = -fScale;
+			normals.pX[idx] = nx * fScale;
+			normals.pY[idx] = ny * fScale;
+			normals.pZ[idx] = nz * fScale;
+		}
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+#include "PointCloud.h"
+
+// Normals of an organized cloud from integral images of its 3D gradients
+// (the "average 3D gradient" method of Holzer et al. 2012): the horizontal
+// and vertical central differences of the points are summed into integral
+// images, so the mean gradients over a window are four lookups each and the
+// cost per normal does not depend on the window size. The normal is the
+// cross product of the two mean gradients, turned toward the sensor.
+// Differences across a depth jump (more than fMaxDepthChange of the depth)
+// are left out, so normals do not bend around object borders. The rows are
+// split into bands processed in parallel, each band in chunks with its own
+// integral image.
+class NormalEstimator
+{
+public:
+	NormalEstimator();
+	~NormalEstimator();
+
+	void Initialize(int iWindowRadius = 4, float fMaxDepthChange = 0.02f);
+
+	// normals of every point of cloud; only cloud.extent is visited
+	void Compute(const PointCloud& cloud, NormalMap& normals);
+
+	// the window is (2 * iWindowRadius + 1) pixels square
+	int iWindowRadius;
+	// relative to the depth of the two points of a difference
+	float fMaxDepthChange;
+
+private:
+	void EstimateRows(
+		const PointCloud& cloud,
+		const PixelRect& rect,
+		int nBegin, int nEnd,
+		std::vector<float>& integral,
+		NormalMap& normals) const;
+
+	NormalEstimator(const NormalEstimator&);
+	NormalEstimator& operator=(const NormalEstimator&);
+
+	// one integral image per band
+	std::vector<std::vector<float> > integrals;
+};
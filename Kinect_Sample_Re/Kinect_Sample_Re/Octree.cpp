@@ -0,0 +1,423 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "Octree.h"
+#include "ParallelFor.h"
+
+// 10 bits per axis: a 30-bit Morton code, sorted by digits of 10 bits
+static const int nLevels = 10;
+static const int nRadixBits = 10;
+static const int nRadixSize = 1 << nRadixBits;
+static const int nSmallBucket = 64;
+// deepest traversal: 7 siblings left on every level, plus the current node
+static const int nMaxStack = 8 * (nLevels + 1);
+
+// spreads the low 10 bits of v to every third bit
+static inline unsigned int SpreadBits(unsigned int v)
+{
+	v = (v | (v << 16)) & 0x030000FF;
+	v = (v | (v << 8)) & 0x0300F00F;
+	v = (v | (v << 4)) & 0x030C30C3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+
+struct BoxTest
+{
+	float fMin[3];
+	float fMax[3];
+
+	int Classify(const float fCenter[3], float fHalfSize) const
+	{
+		int iResult = 2;
+		for (int aa = 0; aa < 3; aa++)
+		{
+			if (fCenter[aa] + fHalfSize < fMin[aa] || fCenter[aa] - fHalfSize > fMax[aa])
+				return 0;
+			if (fCenter[aa] - fHalfSize < fMin[aa] || fCenter[aa] + fHalfSize > fMax[aa])
+				iResult = 1;
+		}
+		return iResult;
+	}
+
+	bool Contains(float x, float y, float z) const
+	{
+		return x >= fMin[0] && x <= fMax[0] && y >= fMin[1] && y <= fMax[1] && z >= fMin[2] && z <= fMax[2];
+	}
+};
+
+struct SphereTest
+{
+	float fCenter[3];
+	float fRadius2;
+
+	int Classify(const float fNodeCenter[3], float fHalfSize) const
+	{
+		// squared distance to the nearest and to the farthest point of the cube
+		float fNear2 = 0;
+		float fFar2 = 0;
+		for (int aa = 0; aa < 3; aa++)
+		{
+			const float d = fabsf(fCenter[aa] - fNodeCenter[aa]);
+			const float fNear = d > fHalfSize ? d - fHalfSize : 0.0f;
+			const float fFar = d + fHalfSize;
+			fNear2 += fNear * fNear;
+			fFar2 += fFar * fFar;
+		}
+		if (fNear2 > fRadius2)
+			return 0;
+		return fFar2 <= fRadius2 ? 2 : 1;
+	}
+
+	bool Contains(float x, float y, float z) const
+	{
+		const float dx = x - fCenter[0];
+		const float dy = y - fCenter[1];
+		const float dz = z - fCenter[2];
+		return dx * dx + dy * dy + dz * dz <= fRadius2;
+	}
+};
+
+struct FrustumTest
+{
+	const float (*planes)[4];
+	int nPlanes;
+
+	int Classify(const float fCenter[3], float fHalfSize) const
+	{
+		int iResult = 2;
+		for (int pp = 0; pp < nPlanes; pp++)
+		{
+			const float* p = planes[pp];
+			// signed distance of the center, and how far the cube reaches along
+			// the plane normal (both scaled by the normal's length)
+			const float s = p[0] * fCenter[0] + p[1] * fCenter[1] + p[2] * fCenter[2] + p[3];
+			const float r = fHalfSize * (fabsf(p[0]) + fabsf(p[1]) + fabsf(p[2]));
+			if (s < -r)
+				return 0;
+			if (s < r)
+				iResult = 1;
+		}
+		return iResult;
+	}
+
+	bool Contains(float x, float y, float z) const
+	{
+		for (int pp = 0; pp < nPlanes; pp++)
+		{
+			const float* p = planes[pp];
+			if (p[0] * x + p[1] * y + p[2] * z + p[3] < 0)
+				return false;
+		}
+		return true;
+	}
+};
+
+// sorts n codes, with their points, on the lower two digits; the result
+// ends up back in pCodes, pOrder
+static void SortBucket(unsigned int* pCodes, int* pOrder, unsigned int* pCodesScratch, int* pOrderScratch, int n, int offsets[2][nRadixSize])
+{
+	if (n < 2)
+		return;
+
+	// small buckets: insertion sort, cheaper than clearing the histograms
+	if (n <= nSmallBucket)
+	{
+		for (int ii = 1; ii < n; ii++)
+		{
+			const unsigned int code = pCodes[ii];
+			const int idx = pOrder[ii];
+			int jj = ii;
+			for (; jj > 0 && pCodes[jj - 1] > code; jj--)
+			{
+				pCodes[jj] = pCodes[jj - 1];
+				pOrder[jj] = pOrder[jj - 1];
+			}
+			pCodes[jj] = code;
+			pOrder[jj] = idx;
+		}
+		return;
+	}
+
+	memset(offsets, 0, sizeof(int) * 2 * nRadixSize);
+	for (int ii = 0; ii < n; ii++)
+	{
+		offsets[0][pCodes[ii] & (nRadixSize - 1)]++;
+		offsets[1][(pCodes[ii] >> nRadixBits) & (nRadixSize - 1)]++;
+	}
+	for (int pass = 0; pass < 2; pass++)
+	{
+		int nSum = 0;
+		for (int dd = 0; dd < nRadixSize; dd++)
+		{
+			const int nCount = offsets[pass][dd];
+			offsets[pass][dd] = nSum;
+			nSum += nCount;
+		}
+	}
+
+	for (int ii = 0; ii < n; ii++)
+	{
+		const int iOut = offsets[0][pCodes[ii] & (nRadixSize - 1)]++;
+		pCodesScratch[iOut] = pCodes[ii];
+		pOrderScratch[iOut] = pOrder[ii];
+	}
+	for (int ii = 0; ii < n; ii++)
+	{
+		const int iOut = offsets[1][(pCodesScratch[ii] >> nRadixBits) & (nRadixSize - 1)]++;
+		pCodes[iOut] = pCodesScratch[ii];
+		pOrder[iOut] = pOrderScratch[ii];
+	}
+}
+
+Octree::Octree() :
+nPoints(0),
+pPoints(NULL)
+{
+}
+
+Octree::~Octree()
+{
+}
+
+void Octree::Clear()
+{
+	nPoints = 0;
+	pPoints = NULL;
+	nodes.clear();
+}
+
+void Octree::Build(const PointList& points, int nMaxLeafPoints)
+{
+	Clear();
+	if (points.nCount == 0)
+		return;
+
+	nPoints = points.nCount;
+	pPoints = &points;
+	if ((int)order.size() < nPoints)
+	{
+		order.resize(nPoints);
+		codes.resize(nPoints);
+		orderScratch.resize(nPoints);
+		codesScratch.resize(nPoints);
+	}
+
+	// bounding box, per band, then merged
+	const int nBands = ParallelThreadCount();
+	if ((int)bandBounds.size() < 6 * nBands)
+		bandBounds.resize(6 * nBands);
+	ParallelFor(nBands, [&](int nBegin, int nEnd)
+	{
+		for (int bb = nBegin; bb < nEnd; bb++)
+		{
+			float* pBounds = &bandBounds[6 * bb];
+			pBounds[0] = pBounds[1] = pBounds[2] = 1e30f;
+			pBounds[3] = pBounds[4] = pBounds[5] = -1e30f;
+			const int nFirst = (int)((long long)nPoints * bb / nBands);
+			const int nLast = (int)((long long)nPoints * (bb + 1) / nBands);
+			for (int ii = nFirst; ii < nLast; ii++)
+			{
+				pBounds[0] = std::min(pBounds[0], points.pX[ii]);
+				pBounds[1] = std::min(pBounds[1], points.pY[ii]);
+				pBounds[2] = std::min(pBounds[2], points.pZ[ii]);
+				pBounds[3] = std::max(pBounds[3], points.pX[ii]);
+				pBounds[4] = std::max(pBounds[4], points.pY[ii]);
+				pBounds[5] = std::max(pBounds[5], points.pZ[ii]);
+			}
+		}
+	});
+
+	float fMin[3] = { 1e30f, 1e30f, 1e30f };
+	float fMax[3] = { -1e30f, -1e30f, -1e30f };
+	for (int bb = 0; bb < nBands; bb++)
+	{
+		for (int aa = 0; aa < 3; aa++)
+		{
+			fMin[aa] = std::min(fMin[aa], bandBounds[6 * bb + aa]);
+			fMax[aa] = std::max(fMax[aa], bandBounds[6 * bb + 3 + aa]);
+		}
+	}
+
+	// the root cube, a little larger so no point lies on its far faces
+	Node root;
+	float fHalfSize = 0.5e-3f;
+	for (int aa = 0; aa < 3; aa++)
+	{
+		root.fCenter[aa] = 0.5f * (fMin[aa] + fMax[aa]);
+		fHalfSize = std::max(fHalfSize, 0.5f * (fMax[aa] - fMin[aa]));
+	}
+	root.fHalfSize = fHalfSize * 1.001f;
+	root.iFirstChild = 0;
+	root.nChildren = 0;
+	root.nBegin = 0;
+	root.nEnd = nPoints;
+
+	// cell codes
+	const float fScale = (1 << nLevels) / (2 * root.fHalfSize);
+	const float fOrigin[3] = {
+		root.fCenter[0] - root.fHalfSize,
+		root.fCenter[1] - root.fHalfSize,
+		root.fCenter[2] - root.fHalfSize };
+	const int nMaxCell = (1 << nLevels) - 1;
+	ParallelFor(nPoints, [&](int nBegin, int nEnd)
+	{
+		for (int ii = nBegin; ii < nEnd; ii++)
+		{
+			const int x = std::min(nMaxCell, std::max(0, (int)((points.pX[ii] - fOrigin[0]) * fScale)));
+			const int y = std::min(nMaxCell, std::max(0, (int)((points.pY[ii] - fOrigin[1]) * fScale)));
+			const int z = std::min(nMaxCell, std::max(0, (int)((points.pZ[ii] - fOrigin[2]) * fScale)));
+			codes[ii] = SpreadBits(x) | (SpreadBits(y) << 1) | (SpreadBits(z) << 2);
+			order[ii] = ii;
+		}
+	});
+
+	// radix sort: one pass on the highest digit splits the points into
+	// buckets of a coarse grid, which are small enough to be sorted on the
+	// lower two digits in cache, each on its own
+	histogram.assign(nRadixSize + 1, 0);
+	for (int ii = 0; ii < nPoints; ii++)
+		histogram[(codes[ii] >> (2 * nRadixBits)) + 1]++;
+	for (int dd = 0; dd < nRadixSize; dd++)
+		histogram[dd + 1] += histogram[dd];
+
+	// histogram[dd] is where bucket dd begins
+	bucketNext.assign(histogram.begin(), histogram.end() - 1);
+	for (int ii = 0; ii < nPoints; ii++)
+	{
+		const unsigned int code = codes[ii];
+		const int iOut = bucketNext[code >> (2 * nRadixBits)]++;
+		codesScratch[iOut] = code;
+		orderScratch[iOut] = order[ii];
+	}
+
+	ParallelFor(nRadixSize, [&](int nBegin, int nEnd)
+	{
+		int offsets[2][nRadixSize];
+		for (int dd = nBegin; dd < nEnd; dd++)
+		{
+			const int nFirst = histogram[dd];
+			const int nLast = histogram[dd + 1];
+			SortBucket(&codesScratch[0] + nFirst, &orderScratch[0] + nFirst,
+				&codes[0] + nFirst, &order[0] + nFirst, nLast - nFirst, offsets);
+		}
+	});
+	codes.swap(codesScratch);
+	order.swap(orderScratch);
+
+	nodes.push_back(root);
+	Split(0, 0, nMaxLeafPoints);
+}
+
+void Octree::Split(int iNode, int nLevel, int nMaxLeafPoints)
+{
+	const int nBegin = nodes[iNode].nBegin;
+	const int nEnd = nodes[iNode].nEnd;
+	if (nEnd - nBegin <= nMaxLeafPoints || nLevel == nLevels)
+		return;
+
+	// the octant of a child is the next 3 bits below the ones its parent's
+	// points share: x in the lowest, z in the highest
+	const int nShift = 3 * (nLevels - 1 - nLevel);
+	const unsigned int nPrefix = codes[nBegin] & ~((8u << nShift) - 1);
+	const unsigned int* pCodes = &codes[0];
+
+	int nChildBegin[9];
+	nChildBegin[0] = nBegin;
+	for (int oo = 1; oo < 8; oo++)
+		nChildBegin[oo] = (int)(std::lower_bound(pCodes + nChildBegin[oo - 1], pCodes + nEnd, nPrefix | ((unsigned int)oo << nShift)) - pCodes);
+	nChildBegin[8] = nEnd;
+
+	// children are consecutive, and nodes may move while they are added
+	const int iFirstChild = (int)nodes.size();
+	const float fChildHalfSize = 0.5f * nodes[iNode].fHalfSize;
+	float fCenter[3];
+	memcpy(fCenter, nodes[iNode].fCenter, sizeof(fCenter));
+
+	for (int oo = 0; oo < 8; oo++)
+	{
+		if (nChildBegin[oo] == nChildBegin[oo + 1])
+			continue;
+
+		Node child;
+		child.fCenter[0] = fCenter[0] + (oo & 1 ? fChildHalfSize : -fChildHalfSize);
+		child.fCenter[1] = fCenter[1] + (oo & 2 ? fChildHalfSize : -fChildHalfSize);
+		child.fCenter[2] = fCenter[2] + (oo & 4 ? fChildHalfSize : -fChildHalfSize);
+		child.fHalfSize = fChildHalfSize;
+		child.iFirstChild = 0;
+		child.nChildren = 0;
+		child.nBegin = nChildBegin[oo];
+		child.nEnd = nChildBegin[oo + 1];
+		nodes.push_back(child);
+	}
+
+	const int nChildren = (int)nodes.size() - iFirstChild;
+	nodes[iNode].iFirstChild = iFirstChild;
+	nodes[iNode].nChildren = nChildren;
+	for (int cc = 0; cc < nChildren; cc++)
+		Split(iFirstChild + cc, nLevel + 1, nMaxLeafPoints);
+}
+
+template<class Test>
+void Octree::Query(const Test& test, std::vector<int>& result) const
+{
+	result.clear();
+	if (nodes.empty())
+		return;
+
+	int stack[nMaxStack];
+	int nStack = 0;
+	stack[nStack++] = 0;
+
+	while (nStack > 0)
+	{
+		const Node& node = nodes[stack[--nStack]];
+		const int iClass = test.Classify(node.fCenter, node.fHalfSize);
+		if (iClass == 0)
+			continue;
+
+		if (iClass == 2)
+		{
+			result.insert(result.end(), order.begin() + node.nBegin, order.begin() + node.nEnd);
+		}
+		else if (node.nChildren > 0)
+		{
+			for (int cc = node.nChildren - 1; cc >= 0; cc--)
+				stack[nStack++] = node.iFirstChild + cc;
+		}
+		else
+		{
+			const PointList& points = *pPoints;
+			for (int ii = node.nBegin; ii < node.nEnd; ii++)
+			{
+				const int idx = order[ii];
+				if (test.Contains(points.pX[idx], points.pY[idx], points.pZ[idx]))
+					result.push_back(idx);
+			}
+		}
+	}
+}
+
+void Octree::QueryBox(const float fMin[3], const float fMax[3], std::vector<int>& result) const
+{
+	BoxTest test;
+	memcpy(test.fMin, fMin, sizeof(test.fMin));
+	memcpy(test.fMax, fMax, sizeof(test.fMax));
+	Query(test, result);
+}
+
+void Octree::QuerySphere(const float fCenter[3], float fRadius, std::vector<int>& result) const
+{
+	SphereTest test;
+	memcpy(test.fCenter, fCenter, sizeof(test.fCenter));
+	test.fRadius2 = fRadius * fRadius;
+	Query(test, result);
+}
+
+void Octree::QueryFrustum(const float planes[][4], int nPlanes, std::vector<int>& result) const
+{
+	FrustumTest test;
+	test.planes = planes;
+	test.nPlanes = nPlanes;
+	Query(test, result);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+#include "PointCloud.h"
+
+// Octree over a PointList for region queries. The points are sorted by the
+// Morton code of their cell in a 1024^3 grid over their bounding cube, so
+// every node owns a contiguous range of the sorted order and the children
+// of a node are found by binary search in its range. A node is split while
+// it holds more than nMaxLeafPoints points.
+//
+// The tree is rebuilt from every frame's points, but the codes, the sort
+// buffers and the node pool keep their capacity, so once warmed up a build
+// allocates nothing and costs two passes over the points plus the sort.
+// Queries return positions in the PointList; nodes entirely inside the
+// region are taken whole, only the points of nodes crossing its border are
+// tested one by one.
+class Octree
+{
+public:
+	Octree();
+	~Octree();
+
+	// points must stay as they are while the tree is queried
+	void Build(const PointList& points, int nMaxLeafPoints = 64);
+	void Clear();
+
+	// points with fMin <= p <= fMax
+	void QueryBox(const float fMin[3], const float fMax[3], std::vector<int>& result) const;
+	// points within fRadius of fCenter
+	void QuerySphere(const float fCenter[3], float fRadius, std::vector<int>& result) const;
+	// points with a x + b y + c z + d >= 0 for all nPlanes planes (a, b, c, d)
+	void QueryFrustum(const float planes[][4], int nPlanes, std::vector<int>& result) const;
+
+	int nPoints;
+
+private:
+	// a cube and the range [nBegin, nEnd) of order it holds; the children
+	// are nChildren consecutive nodes from iFirstChild, none for a leaf
+	struct Node
+	{
+		float fCenter[3];
+		float fHalfSize;
+		int iFirstChild;
+		int nChildren;
+		int nBegin;
+		int nEnd;
+	};
+
+	void Split(int iNode, int nLevel, int nMaxLeafPoints);
+	// test.Classify(fCenter, fHalfSize) of a node: 0 outside, 1 crossing,
+	// 2 inside the region; test.Contains(x, y, z) for the points of
+	// crossing leaves
+	template<class Test>
+	void Query(const Test& test, std::vector<int>& result) const;
+
+	Octree(const Octree&);
+	Octree& operator=(const Octree&);
+
+	const PointList* pPoints;
+	std::vector<Node> nodes;
+
+	// point positions sorted by code, with the codes
+	std::vector<int> order;
+	std::vector<unsigned int> codes;
+	std::vector<int> orderScratch;
+	std::vector<unsigned int> codesScratch;
+	// start of every bucket of the first sort pass, and its fill level
+	std::vector<int> histogram;
+	std::vector<int> bucketNext;
+	// min and max corner of every band's points
+	std::vector<float> bandBounds;
+};
@@ -0,0 +1,175 @@
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <algorithm>
+#include "ParallelFor.h"
+#include "FrameArena.h"
+
+// persistent workers shared by every ParallelFor call. A call posts a job
+// of ranges and works through them itself; idle workers take ranges of the
+// posted jobs, spread over them when several threads (e.g. the capture
+// threads of a rig of sensors) call at the same time, so the calls run side
+// by side instead of taking turns.
+class WorkerPool
+{
+public:
+	WorkerPool(int nThreads);
+
+	void Run(int nCount, RangeCallback pCallback, const void* pBody);
+
+	const int nThreads;
+
+private:
+	struct Job
+	{
+		RangeCallback pCallback;
+		const void* pBody;
+		int nCount;
+		int nNextRange;
+		int nDoneRanges;
+		// heap allocations of the workers on this job, charged to the
+		// caller so that its ThreadHeapAllocationCount() covers the whole call
+		long long nWorkerAllocations;
+	};
+
+	// under mutex: the next range of pJob, which leaves jobs with its last one
+	int TakeRange(Job* pJob);
+	void RunRange(Job* pJob, int iRange, bool bWorker);
+	void Work(int iThread);
+
+	std::mutex mutex;
+	std::condition_variable startCondition;
+	std::condition_variable doneCondition;
+	// posted jobs with ranges left
+	std::vector<Job*> jobs;
+
+	std::vector<std::thread> workers;
+};
+
+static inline int RangeBegin(int nCount, int iThread, int nThreads)
+{
+	return (int)((long long)nCount * iThread / nThreads);
+}
+
+WorkerPool::WorkerPool(int nThreads) :
+nThreads(nThreads)
+{
+	// so that posting does not allocate
+	jobs.reserve(64);
+	for (int ii = 1; ii < nThreads; ii++)
+		workers.push_back(std::thread(&WorkerPool::Work, this, ii));
+}
+
+int WorkerPool::TakeRange(Job* pJob)
+{
+	const int iRange = pJob->nNextRange++;
+	if (pJob->nNextRange == nThreads)
+		jobs.erase(std::find(jobs.begin(), jobs.end(), pJob));
+	return iRange;
+}
+
+void WorkerPool::RunRange(Job* pJob, int iRange, bool bWorker)
+{
+	const int nBegin = RangeBegin(pJob->nCount, iRange, nThreads);
+	const int nEnd = RangeBegin(pJob->nCount, iRange + 1, nThreads);
+	const long long nAllocationsBefore = ThreadHeapAllocationCount();
+	if (nBegin < nEnd)
+		pJob->pCallback(pJob->pBody, nBegin, nEnd);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (bWorker)
+		pJob->nWorkerAllocations += ThreadHeapAllocationCount() - nAllocationsBefore;
+	if (++pJob->nDoneRanges == nThreads)
+		doneCondition.notify_all();
+}
+
+void WorkerPool::Run(int nCount, RangeCallback pCallback, const void* pBody)
+{
+	// one range per thread, as when the call has the pool to itself
+	Job job;
+	job.pCallback = pCallback;
+	job.pBody = pBody;
+	job.nCount = nCount;
+	job.nNextRange = 0;
+	job.nDoneRanges = 0;
+	job.nWorkerAllocations = 0;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(&job);
+	}
+	startCondition.notify_all();
+
+	// the caller works on its own job until no range is left to take
+	for (;;)
+	{
+		int iRange;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (job.nNextRange == nThreads)
+				break;
+			iRange = TakeRange(&job);
+		}
+		RunRange(&job, iRange, false);
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (job.nDoneRanges < nThreads)
+		doneCondition.wait(lock);
+	AddThreadHeapAllocations(job.nWorkerAllocations);
+}
+
+void WorkerPool::Work(int iThread)
+{
+	for (;;)
+	{
+		Job* pJob;
+		int iRange;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (jobs.empty())
+				startCondition.wait(lock);
+			// workers spread over the jobs posted at the same time
+			pJob = jobs[iThread % jobs.size()];
+			iRange = TakeRange(pJob);
+		}
+		RunRange(pJob, iRange, true);
+	}
+}
+
+// created on first use and never destroyed: the workers stay blocked until
+// the process exits, which avoids joining threads during static destruction
+static WorkerPool* pPool = NULL;
+static std::mutex poolMutex;
+
+static WorkerPool& GetPool()
+{
+	std::lock_guard<std::mutex> lock(poolMutex);
+	if (pPool == NULL)
+	{
+		int nThreads = (int)std::thread::hardware_concurrency();
+		if (nThreads < 1) nThreads = 1;
+		pPool = new WorkerPool(nThreads);
+	}
+	return *pPool;
+}
+
+void ParallelForRanges(int nCount, RangeCallback pCallback, const void* pBody)
+{
+	if (nCount <= 0)
+		return;
+
+	WorkerPool& pool = GetPool();
+	if (pool.nThreads == 1 || nCount == 1)
+	{
+		pCallback(pBody, 0, nCount);
+		return;
+	}
+
+	pool.Run(nCount, pCallback, pBody);
+}
+
+int ParallelThreadCount()
+{
+	return GetPool().nThreads;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+// body(nBegin, nEnd) through a plain function pointer, so a lambda is
+// passed by reference instead of being copied into a std::function (which
+// allocates for all but the smallest captures, on every call)
+typedef void(*RangeCallback)(const void* pBody, int nBegin, int nEnd);
+
+void ParallelForRanges(int nCount, RangeCallback pCallback, const void* pBody);
+
+template<class Body>
+void InvokeRange(const void* pBody, int nBegin, int nEnd)
+{
+	(*static_cast<const Body*>(pBody))(nBegin, nEnd);
+}
+
+// Splits [0, nCount) into contiguous ranges and runs body(nBegin, nEnd) on
+// each, using the calling thread plus a pool of workers that is started on
+// first use and kept for the lifetime of the process. Returns when every
+// range is done. Calls from different threads run side by side, sharing the
+// workers between them; body must not call ParallelFor itself.
+template<class Body>
+void ParallelFor(int nCount, const Body& body)
+{
+	ParallelForRanges(nCount, &InvokeRange<Body>, &body);
+}
+
+// number of ranges ParallelFor splits into (workers + calling thread)
+int ParallelThreadCount();
@@ -0,0 +1,26 @@
+#pragma once
+
+// pixels nLeft <= col < nRight, nTop <= row < nBottom of an image
+struct PixelRect
+{
+	int nLeft;
+	int nTop;
+	int nRight;
+	int nBottom;
+
+	static PixelRect Full(int nWidth, int nHeight)
+	{
+		PixelRect rect = { 0, 0, nWidth, nHeight };
+		return rect;
+	}
+
+	bool Empty() const { return nLeft >= nRight || nTop >= nBottom; }
+	int Width() const { return nRight - nLeft; }
+	int Height() const { return nBottom - nTop; }
+
+	bool Contains(const PixelRect& rect) const
+	{
+		return rect.Empty() ||
+			(rect.nLeft >= nLeft && rect.nRight <= nRight && rect.nTop >= nTop && rect.nBottom <= nBottom);
+	}
+};
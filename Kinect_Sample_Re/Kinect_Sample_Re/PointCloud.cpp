@@ -0,0 +1,193 @@
+#include <string.h>
+#include "PointCloud.h"
+#include "AlignedMemory.h"
+
+PointList::PointList() :
+nCount(0),
+nCapacity(0),
+pX(NULL),
+pY(NULL),
+pZ(NULL),
+pColor(NULL),
+pIndex(NULL),
+pArena(NULL)
+{
+}
+
+PointList::~PointList()
+{
+	Free();
+}
+
+// a plane from the arena, or from the heap without one
+template<class T>
+static T* AllocatePlane(int nCount, FrameArena* pArena)
+{
+	return pArena != NULL ? pArena->AllocateArray<T>(nCount) : AlignedAllocArray<T>(nCount);
+}
+
+void PointList::Free()
+{
+	// arena storage goes with the arena
+	if (pArena == NULL)
+	{
+		AlignedFree(pX);
+		AlignedFree(pY);
+		AlignedFree(pZ);
+		AlignedFree(pColor);
+		AlignedFree(pIndex);
+	}
+	pX = pY = pZ = NULL;
+	pColor = NULL;
+	pIndex = NULL;
+	pArena = NULL;
+}
+
+void PointList::Allocate(int nCapacity, FrameArena* pArena)
+{
+	Free();
+
+	this->pArena = pArena;
+	this->nCount = 0;
+	this->nCapacity = nCapacity;
+	pX = AllocatePlane<float>(nCapacity, pArena);
+	pY = AllocatePlane<float>(nCapacity, pArena);
+	pZ = AllocatePlane<float>(nCapacity, pArena);
+	pColor = AllocatePlane<unsigned int>(nCapacity, pArena);
+	pIndex = AllocatePlane<int>(nCapacity, pArena);
+}
+
+size_t PointList::ArenaFootprint(int nCapacity)
+{
+	return 5 * FrameArena::Footprint(sizeof(float)* nCapacity);
+}
+
+PointCloud::PointCloud() :
+nWidth(0),
+nHeight(0),
+nCount(0),
+nCapacity(0),
+pX(NULL),
+pY(NULL),
+pZ(NULL),
+pColor(NULL),
+pArena(NULL)
+{
+	extent = PixelRect::Full(0, 0);
+}
+
+PointCloud::~PointCloud()
+{
+	Free();
+}
+
+void PointCloud::Free()
+{
+	if (pArena == NULL)
+	{
+		AlignedFree(pX);
+		AlignedFree(pY);
+		AlignedFree(pZ);
+		AlignedFree(pColor);
+	}
+	pX = pY = pZ = NULL;
+	pColor = NULL;
+	pArena = NULL;
+}
+
+void PointCloud::Allocate(int nWidth, int nHeight, FrameArena* pArena)
+{
+	Free();
+
+	this->pArena = pArena;
+	this->nWidth = nWidth;
+	this->nHeight = nHeight;
+	this->nCount = nWidth * nHeight;
+	this->nCapacity = nCount;
+	pX = AllocatePlane<float>(nCount, pArena);
+	pY = AllocatePlane<float>(nCount, pArena);
+	pZ = AllocatePlane<float>(nCount, pArena);
+	pColor = AllocatePlane<unsigned int>(nCount, pArena);
+
+	// arena memory starts zeroed
+	if (pArena == NULL)
+	{
+		memset(pX, 0, sizeof(float)* nCount);
+		memset(pY, 0, sizeof(float)* nCount);
+		memset(pZ, 0, sizeof(float)* nCount);
+		memset(pColor, 0, sizeof(unsigned int)* nCount);
+	}
+	extent = PixelRect::Full(0, 0);
+
+	valid.Allocate(nCount, pArena);
+}
+
+size_t PointCloud::ArenaFootprint(int nWidth, int nHeight)
+{
+	return 4 * FrameArena::Footprint(sizeof(float)* nWidth * nHeight) + PointList::ArenaFootprint(nWidth * nHeight);
+}
+
+bool PointCloud::Reshape(int nWidth, int nHeight)
+{
+	if (nWidth * nHeight > nCapacity)
+		return false;
+
+	// whatever the old shape left is in the wrong place now
+	if (nWidth != this->nWidth || nHeight != this->nHeight)
+		extent = PixelRect::Full(nWidth, nHeight);
+
+	this->nWidth = nWidth;
+	this->nHeight = nHeight;
+	this->nCount = nWidth * nHeight;
+	valid.nCount = 0;
+	return true;
+}
+
+void PointCloud::ClearRect(const PixelRect& rect)
+{
+	if (rect.Empty())
+		return;
+
+	for (int rr = rect.nTop; rr < rect.nBottom; rr++)
+	{
+		const int idx = rr * nWidth + rect.nLeft;
+		memset(pX + idx, 0, sizeof(float)* rect.Width());
+		memset(pY + idx, 0, sizeof(float)* rect.Width());
+		memset(pZ + idx, 0, sizeof(float)* rect.Width());
+		memset(pColor + idx, 0, sizeof(unsigned int)* rect.Width());
+	}
+}
+
+NormalMap::NormalMap() :
+nWidth(0),
+nHeight(0),
+nCapacity(0),
+pX(NULL),
+pY(NULL),
+pZ(NULL)
+{
+}
+
+NormalMap::~NormalMap()
+{
+	AlignedFree(pX);
+	AlignedFree(pY);
+	AlignedFree(pZ);
+}
+
+void NormalMap::Reshape(int nWidth, int nHeight)
+{
+	this->nWidth = nWidth;
+	this->nHeight = nHeight;
+	if (nWidth * nHeight <= nCapacity)
+		return;
+
+	AlignedFree(pX);
+	AlignedFree(pY);
+	AlignedFree(pZ);
+
+	nCapacity = nWidth * nHeight;
+	pX = AlignedAllocArray<float>(nCapacity);
+	pY = AlignedAllocArray<float>(nCapacity);
+	pZ = AlignedAllocArray<float>(nCapacity);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "PixelRect.h"
+#include "FrameArena.h"
+
+// Points stored as separate, 64-byte aligned planes (structure of arrays).
+// Colors are packed RGBA, i.e. bytes R, G, B, A in memory.
+
+// a list of points, e.g. the valid points of an organized cloud
+// together with the pixel each one came from
+struct PointList
+{
+	PointList();
+	~PointList();
+
+	// from pArena when given, which then owns the storage
+	void Allocate(int nCapacity, FrameArena* pArena = NULL);
+
+	// what Allocate(nCapacity, pArena) takes from the arena
+	static size_t ArenaFootprint(int nCapacity);
+
+	int nCount;
+	int nCapacity;
+
+	float* pX;
+	float* pY;
+	float* pZ;
+	unsigned int* pColor;
+	int* pIndex;
+
+private:
+	void Free();
+
+	FrameArena* pArena;
+
+	PointList(const PointList&);
+	PointList& operator=(const PointList&);
+};
+
+// organized cloud with one entry per pixel (Z == 0 where invalid),
+// plus the compacted list of its valid points
+class PointCloud
+{
+public:
+	PointCloud();
+	~PointCloud();
+
+	// from pArena when given, which then owns the storage (zeroed either way)
+	void Allocate(int nWidth, int nHeight, FrameArena* pArena = NULL);
+	static size_t ArenaFootprint(int nWidth, int nHeight);
+	// changes the organized size within the allocated storage
+	bool Reshape(int nWidth, int nHeight);
+	// zeroes the organized entries of rect
+	void ClearRect(const PixelRect& rect);
+
+	int nWidth;
+	int nHeight;
+	int nCount;
+	int nCapacity;
+
+	float* pX;
+	float* pY;
+	float* pZ;
+	unsigned int* pColor;
+
+	// the organized entries outside it are all zero
+	PixelRect extent;
+
+	PointList valid;
+
+private:
+	void Free();
+
+	FrameArena* pArena;
+
+	PointCloud(const PointCloud&);
+	PointCloud& operator=(const PointCloud&);
+};
+
+// unit normals of an organized cloud, one per pixel, in separate planes;
+// only meaningful where the cloud has a point, (0, 0, 0) where none could
+// be estimated
+struct NormalMap
+{
+	NormalMap();
+	~NormalMap();
+
+	// grows the planes when needed; the contents are not kept
+	void Reshape(int nWidth, int nHeight);
+
+	int nWidth;
+	int nHeight;
+	int nCapacity;
+
+	float* pX;
+	float* pY;
+	float* pZ;
+
+private:
+	NormalMap(const NormalMap&);
+	NormalMap& operator=(const NormalMap&);
+};
@@ -0,0 +1,466 @@
+#include <math.h>
+#include <string.h>
+#include "PointRenderer.h"
+#include "CpuFeatures.h"
+
+#ifdef KINECT_X86
+#include <emmintrin.h>
+#endif
+
+// SoA planes -> interleaved X, Y, Z, color records; record ii is point
+// pOrder[ii] when reordering
+static void InterleavePoints(const PointList& points, const int* pOrder, PointVertex* pDst)
+{
+	int ii = 0;
+
+	if (pOrder != NULL)
+	{
+		for (; ii < points.nCount; ii++)
+		{
+			const int idx = pOrder[ii];
+			pDst[ii].X = points.pX[idx];
+			pDst[ii].Y = points.pY[idx];
+			pDst[ii].Z = points.pZ[idx];
+			pDst[ii].color = points.pColor[idx];
+		}
+		return;
+	}
+
+#ifdef KINECT_X86
+	// transpose 4 points at a time; the color bits ride along as floats
+	for (; ii + 4 <= points.nCount; ii += 4)
+	{
+		__m128 x = _mm_loadu_ps(points.pX + ii);
+		__m128 y = _mm_loadu_ps(points.pY + ii);
+		__m128 z = _mm_loadu_ps(points.pZ + ii);
+		__m128 c = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(points.pColor + ii)));
+		_MM_TRANSPOSE4_PS(x, y, z, c);
+
+		float* pOut = &pDst[ii].X;
+		_mm_storeu_ps(pOut, x);
+		_mm_storeu_ps(pOut + 4, y);
+		_mm_storeu_ps(pOut + 8, z);
+		_mm_storeu_ps(pOut + 12, c);
+	}
+#endif
+
+	for (; ii < points.nCount; ii++)
+	{
+		pDst[ii].X = points.pX[ii];
+		pDst[ii].Y = points.pY[ii];
+		pDst[ii].Z = points.pZ[ii];
+		pDst[ii].color = points.pColor[ii];
+	}
+}
+
+// InterleavePoints with diffuse lighting from a light at the sensor; points
+// without a pixel (pIndex < 0) or without a normal keep their color
+static void InterleaveLitPoints(const PointList& points, const int* pOrder, const NormalMap& normals, PointVertex* pDst)
+{
+	const float fAmbient = 0.25f;
+
+	for (int ii = 0; ii < points.nCount; ii++)
+	{
+		const int iSrc = pOrder != NULL ? pOrder[ii] : ii;
+		const float X = points.pX[iSrc];
+		const float Y = points.pY[iSrc];
+		const float Z = points.pZ[iSrc];
+		unsigned int color = points.pColor[iSrc];
+
+		const int idx = points.pIndex[iSrc];
+		if (idx >= 0)
+		{
+			// the normals face the sensor, so -N.P is the cosine to the light
+			const float fDot = -(normals.pX[idx] * X + normals.pY[idx] * Y + normals.pZ[idx] * Z);
+			const float fLength2 = X * X + Y * Y + Z * Z;
+			if (fDot != 0 && fLength2 > 0)
+			{
+				const float fDiffuse = fDot > 0 ? fDot / sqrtf(fLength2) : 0.0f;
+				const unsigned int nShade = (unsigned int)((fAmbient + (1.0f - fAmbient) * fDiffuse) * 256.0f);
+				color = (color & 0xff000000) |
+					((((color >> 16) & 0xff) * nShade >> 8) << 16) |
+					((((color >> 8) & 0xff) * nShade >> 8) << 8) |
+					((color & 0xff) * nShade >> 8);
+			}
+		}
+
+		pDst[ii].X = X;
+		pDst[ii].Y = Y;
+		pDst[ii].Z = Z;
+		pDst[ii].color = color;
+	}
+}
+
+PointRenderer::PointRenderer() :
+nPoints(0),
+nDrawnPoints(0),
+nDrawnTiles(0),
+bInitialized(false),
+bPersistent(false),
+nBuffer(0),
+nCapacity(0),
+pMapped(NULL),
+iWriteRegion(0),
+iDrawRegion(0),
+bCompactVertices(false),
+bTiled(false)
+{
+	memset(&gl, 0, sizeof(gl));
+	for (int ii = 0; ii < nRegions; ii++)
+		fences[ii] = NULL;
+}
+
+PointRenderer::~PointRenderer()
+{
+	// the GL context is usually gone by now; Release() must be called before
+}
+
+bool PointRenderer::Initialize()
+{
+	if (!LoadGLBufferApi(gl))
+		return false;
+
+	bPersistent = gl.bPersistentMapping;
+	bInitialized = true;
+	return true;
+}
+
+void PointRenderer::Release()
+{
+	if (!bInitialized)
+		return;
+
+	for (int ii = 0; ii < nRegions; ii++)
+	{
+		if (fences[ii] != NULL)	gl.DeleteSync(fences[ii]);
+		fences[ii] = NULL;
+	}
+
+	if (nBuffer != 0)
+	{
+		if (pMapped != NULL)
+		{
+			gl.BindBuffer(GL_ARRAY_BUFFER, nBuffer);
+			gl.UnmapBuffer(GL_ARRAY_BUFFER);
+			gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+		gl.DeleteBuffers(1, &nBuffer);
+	}
+
+	nBuffer = 0;
+	nCapacity = 0;
+	nPoints = 0;
+	pMapped = NULL;
+	bInitialized = false;
+}
+
+void PointRenderer::Reserve(int nCapacity)
+{
+	if (nCapacity <= this->nCapacity && nBuffer != 0)
+		return;
+
+	// buffer storage is immutable, so growing means a new buffer
+	const bool bWasInitialized = bInitialized;
+	Release();
+	bInitialized = bWasInitialized;
+
+	this->nCapacity = nCapacity;
+	gl.GenBuffers(1, &nBuffer);
+	gl.BindBuffer(GL_ARRAY_BUFFER, nBuffer);
+
+	if (bPersistent)
+	{
+		const ptrdiff_t nSize = (ptrdiff_t)sizeof(PointVertex)* nCapacity * nRegions;
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		gl.BufferStorage(GL_ARRAY_BUFFER, nSize, NULL, flags);
+		pMapped = static_cast<PointVertex*>(gl.MapBufferRange(GL_ARRAY_BUFFER, 0, nSize, flags));
+		if (pMapped == NULL)
+		{
+			// fall back to orphaning
+			gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+			gl.DeleteBuffers(1, &nBuffer);
+			bPersistent = false;
+			gl.GenBuffers(1, &nBuffer);
+			gl.BindBuffer(GL_ARRAY_BUFFER, nBuffer);
+		}
+	}
+
+	if (!bPersistent)
+		gl.BufferData(GL_ARRAY_BUFFER, (ptrdiff_t)sizeof(PointVertex)* nCapacity, NULL, GL_STREAM_DRAW);
+
+	gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+	iWriteRegion = 0;
+	iDrawRegion = 0;
+}
+
+PointVertex* PointRenderer::BeginWrite(int nCount)
+{
+	Reserve(nCount);
+
+	if (bPersistent)
+	{
+		// wait until the GPU is done with the region drawn nRegions frames ago
+		iWriteRegion = (iDrawRegion + 1) % nRegions;
+		if (fences[iWriteRegion] != NULL)
+		{
+			gl.ClientWaitSync(fences[iWriteRegion], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ULL);
+			gl.DeleteSync(fences[iWriteRegion]);
+			fences[iWriteRegion] = NULL;
+		}
+		return pMapped + (size_t)iWriteRegion * nCapacity;
+	}
+
+	// orphan the old storage so the driver never stalls on a pending draw
+	const ptrdiff_t nSize = (ptrdiff_t)sizeof(PointVertex)* nCapacity;
+	gl.BindBuffer(GL_ARRAY_BUFFER, nBuffer);
+	gl.BufferData(GL_ARRAY_BUFFER, nSize, NULL, GL_STREAM_DRAW);
+	void* p = gl.bMapBufferRange ?
+		gl.MapBufferRange(GL_ARRAY_BUFFER, 0, nSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT) :
+		gl.MapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
+	return static_cast<PointVertex*>(p);
+}
+
+void PointRenderer::EndWrite()
+{
+	if (bPersistent)
+	{
+		iDrawRegion = iWriteRegion;
+		return;
+	}
+
+	gl.UnmapBuffer(GL_ARRAY_BUFFER);
+	gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void PointRenderer::Upload(const PointList& points, const NormalMap* pNormals, const PointTiles* pTiles)
+{
+	if (!bInitialized)
+		return;
+
+	nPoints = 0;
+	bCompactVertices = false;
+	bTiled = pTiles != NULL && (int)pTiles->order.size() == points.nCount;
+	if (points.nCount == 0)
+		return;
+
+	PointVertex* pVertices = BeginWrite(points.nCount);
+	if (pVertices == NULL)
+	{
+		EndWrite();
+		return;
+	}
+
+	const int* pOrder = bTiled ? &pTiles->order[0] : NULL;
+	if (pNormals != NULL)
+		InterleaveLitPoints(points, pOrder, *pNormals, pVertices);
+	else
+		InterleavePoints(points, pOrder, pVertices);
+	EndWrite();
+	nPoints = points.nCount;
+
+	if (bTiled)
+		tiles.assign(pTiles->tiles.begin(), pTiles->tiles.end());
+}
+
+void PointRenderer::Upload(const CompactPointList& points, const PointTiles* pTiles)
+{
+	if (!bInitialized)
+		return;
+
+	nPoints = 0;
+	bCompactVertices = true;
+	bTiled = pTiles != NULL && (int)pTiles->order.size() == points.nCount;
+	if (points.nCount == 0)
+		return;
+
+	// the capacity counts PointVertex records
+	const int nVertices = (int)(((size_t)points.nCount * sizeof(CompactPoint) + sizeof(PointVertex) - 1) / sizeof(PointVertex));
+	PointVertex* pVertices = BeginWrite(nVertices);
+	if (pVertices == NULL)
+	{
+		EndWrite();
+		return;
+	}
+
+	memcpy(pVertices, points.pPoints, sizeof(CompactPoint)* (size_t)points.nCount);
+	EndWrite();
+	nPoints = points.nCount;
+
+	if (bTiled)
+		tiles.assign(pTiles->tiles.begin(), pTiles->tiles.end());
+}
+
+void PointRenderer::Draw(const GridMesh* pMesh)
+{
+	if (!bInitialized || nPoints == 0)
+		return;
+
+	const size_t nOffset = bPersistent ? sizeof(PointVertex)* (size_t)iDrawRegion * nCapacity : 0;
+	const char* pBase = reinterpret_cast<const char*>(nOffset);
+
+	gl.BindBuffer(GL_ARRAY_BUFFER, nBuffer);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	if (bCompactVertices)
+	{
+		glVertexPointer(3, GL_SHORT, sizeof(CompactPoint), pBase);
+		glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(CompactPoint), pBase + offsetof(CompactPoint, color));
+		glMatrixMode(GL_MODELVIEW);
+		glPushMatrix();
+		glScalef(fCompactPointScale, fCompactPointScale, fCompactPointScale);
+	}
+	else
+	{
+		glVertexPointer(3, GL_FLOAT, sizeof(PointVertex), pBase);
+		glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(PointVertex), pBase + offsetof(PointVertex, color));
+	}
+
+	// the indices stay in client memory; they change with every frame anyway
+	nDrawnPoints = nPoints;
+	nDrawnTiles = 0;
+	if (pMesh != NULL)
+	{
+		if (!pMesh->strip.empty())
+			glDrawElements(GL_TRIANGLE_STRIP, (GLsizei)pMesh->strip.size(), GL_UNSIGNED_INT, &pMesh->strip[0]);
+	}
+	else if (bTiled)
+		DrawTiles();
+	else
+		glDrawArrays(GL_POINTS, 0, nPoints);
+
+	if (bCompactVertices)
+		glPopMatrix();
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (bPersistent)
+	{
+		if (fences[iDrawRegion] != NULL)	gl.DeleteSync(fences[iDrawRegion]);
+		fences[iDrawRegion] = gl.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+}
+
+void PointRenderer::DrawTiles()
+{
+	GLfloat modelview[16];
+	GLfloat projection[16];
+	GLint viewport[4];
+	GLfloat fPointSize = 1;
+	glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+	glGetFloatv(GL_PROJECTION_MATRIX, projection);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetFloatv(GL_POINT_SIZE, &fPointSize);
+
+	// the tile boxes are in meters, not in the units of compact vertices
+	if (bCompactVertices)
+	{
+		for (int kk = 0; kk < 12; kk++)
+			modelview[kk] /= fCompactPointScale;
+	}
+
+	// clip = projection modelview, column-major
+	GLfloat clip[16];
+	for (int cc = 0; cc < 4; cc++)
+	for (int rr = 0; rr < 4; rr++)
+		clip[cc * 4 + rr] = projection[rr] * modelview[cc * 4] + projection[4 + rr] * modelview[cc * 4 + 1] +
+			projection[8 + rr] * modelview[cc * 4 + 2] + projection[12 + rr] * modelview[cc * 4 + 3];
+
+	// the frustum planes, row 3 +/- rows 0, 1, 2 of clip
+	float planes[6][4];
+	for (int kk = 0; kk < 4; kk++)
+	{
+		const float x = clip[kk * 4];
+		const float y = clip[kk * 4 + 1];
+		const float z = clip[kk * 4 + 2];
+		const float w = clip[kk * 4 + 3];
+		planes[0][kk] = w + x;
+		planes[1][kk] = w - x;
+		planes[2][kk] = w + y;
+		planes[3][kk] = w - y;
+		planes[4][kk] = w + z;
+		planes[5][kk] = w - z;
+	}
+
+	// screen area a point covers
+	const float fPointArea = fPointSize * fPointSize;
+	const float fHalfWidth = 0.5f * viewport[2];
+	const float fHalfHeight = 0.5f * viewport[3];
+
+	drawFirst.clear();
+	drawCount.clear();
+	nDrawnPoints = 0;
+
+	for (size_t tt = 0; tt < tiles.size(); tt++)
+	{
+		const PointTile& tile = tiles[tt];
+		if (tile.nLodCount[0] == 0)
+			continue;
+
+		// culled when the box is entirely behind one plane
+		bool bVisible = true;
+		for (int pp = 0; pp < 6 && bVisible; pp++)
+		{
+			const float* p = planes[pp];
+			const float fReach =
+				p[0] * (p[0] > 0 ? tile.fMax[0] : tile.fMin[0]) +
+				p[1] * (p[1] > 0 ? tile.fMax[1] : tile.fMin[1]) +
+				p[2] * (p[2] > 0 ? tile.fMax[2] : tile.fMin[2]) + p[3];
+			bVisible = fReach >= 0;
+		}
+		if (!bVisible)
+			continue;
+
+		// screen rectangle of the box, clamped to the viewport; a box reaching
+		// behind the eye is drawn in full
+		float fMinX = 1e30f, fMinY = 1e30f, fMaxX = -1e30f, fMaxY = -1e30f;
+		bool bInFront = true;
+		for (int cc = 0; cc < 8; cc++)
+		{
+			const float X = cc & 1 ? tile.fMax[0] : tile.fMin[0];
+			const float Y = cc & 2 ? tile.fMax[1] : tile.fMin[1];
+			const float Z = cc & 4 ? tile.fMax[2] : tile.fMin[2];
+			const float w = clip[3] * X + clip[7] * Y + clip[11] * Z + clip[15];
+			bInFront = w > 1e-6f;
+			if (!bInFront)
+				break;
+			const float sx = (clip[0] * X + clip[4] * Y + clip[8] * Z + clip[12]) / w;
+			const float sy = (clip[1] * X + clip[5] * Y + clip[9] * Z + clip[13]) / w;
+			if (sx < fMinX) fMinX = sx;
+			if (sx > fMaxX) fMaxX = sx;
+			if (sy < fMinY) fMinY = sy;
+			if (sy > fMaxY) fMaxY = sy;
+		}
+
+		int iLevel = 0;
+		if (bInFront)
+		{
+			fMinX = fMinX < -1.0f ? -1.0f : fMinX;
+			fMinY = fMinY < -1.0f ? -1.0f : fMinY;
+			fMaxX = fMaxX > 1.0f ? 1.0f : fMaxX;
+			fMaxY = fMaxY > 1.0f ? 1.0f : fMaxY;
+			const float fArea = (fMaxX - fMinX) * fHalfWidth * (fMaxY - fMinY) * fHalfHeight;
+
+			// the coarsest level that still covers the tile
+			iLevel = nLodLevels - 1;
+			while (iLevel > 0 && tile.nLodCount[iLevel] * fPointArea < fArea)
+				iLevel--;
+		}
+
+		drawFirst.push_back(tile.nFirst);
+		drawCount.push_back(tile.nLodCount[iLevel]);
+		nDrawnPoints += tile.nLodCount[iLevel];
+	}
+
+	nDrawnTiles = (int)drawFirst.size();
+	if (nDrawnTiles == 0)
+		return;
+
+	if (gl.MultiDrawArrays != NULL)
+		gl.MultiDrawArrays(GL_POINTS, &drawFirst[0], &drawCount[0], nDrawnTiles);
+	else
+	{
+		for (int tt = 0; tt < nDrawnTiles; tt++)
+			glDrawArrays(GL_POINTS, drawFirst[tt], drawCount[tt]);
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "GLExtensions.h"
+#include "PointCloud.h"
+#include "GridMesh.h"
+#include "PointTiles.h"
+#include "CompactPoints.h"
+#include <vector>
+
+// interleaved vertex as uploaded to the GPU
+struct PointVertex
+{
+	float X;
+	float Y;
+	float Z;
+	unsigned int color;
+};
+
+// Draws a PointList with one glDrawArrays(GL_POINTS) from a vertex buffer,
+// or a GridMesh over it with one glDrawElements(GL_TRIANGLE_STRIP).
+// Uploads go to a persistently mapped ring of buffer regions when the
+// driver has ARB_buffer_storage, and to an orphaned buffer otherwise.
+// Uses the fixed-function pipeline, so the current modelview/projection
+// matrices (trackball, translation) apply as with glBegin/glEnd.
+//
+// Points uploaded with their tiles are stored in tile order and drawn tile
+// by tile: tiles outside the view frustum are skipped, and the others are
+// drawn at the coarsest level of detail whose points, at the current point
+// size, still cover the tile's bounding box on screen.
+//
+// Compact points are copied to the buffer as they are, 12 bytes a point,
+// and drawn as GL_SHORT vertices under a scaling to meters.
+class PointRenderer
+{
+public:
+	PointRenderer();
+	~PointRenderer();
+
+	// needs a current GL context
+	bool Initialize();
+	void Release();
+
+	// with pNormals (of the organized cloud the points came from), the
+	// colors are lit by a light at the sensor; pTiles must be the tiles of
+	// points
+	void Upload(const PointList& points, const NormalMap* pNormals = NULL, const PointTiles* pTiles = NULL);
+	// points packed by PackPoints, in tile order when pTiles is given
+	void Upload(const CompactPointList& points, const PointTiles* pTiles = NULL);
+	// pMesh must index the points last uploaded, which must not be tiled
+	void Draw(const GridMesh* pMesh = NULL);
+
+	int nPoints;
+	// of the last Draw()
+	int nDrawnPoints;
+	int nDrawnTiles;
+
+private:
+	static const int nRegions = 3;
+
+	void Reserve(int nCapacity);
+	PointVertex* BeginWrite(int nCount);
+	void EndWrite();
+	void DrawTiles();
+
+	PointRenderer(const PointRenderer&);
+	PointRenderer& operator=(const PointRenderer&);
+
+	GLBufferApi gl;
+	bool bInitialized;
+	bool bPersistent;
+
+	GLuint nBuffer;
+	int nCapacity;
+
+	// persistent mapping: one region per frame in flight
+	PointVertex* pMapped;
+	GLsyncHandle fences[nRegions];
+	int iWriteRegion;
+	int iDrawRegion;
+
+	// the buffer holds CompactPoint records
+	bool bCompactVertices;
+
+	// tiles of the uploaded points, and the ranges of the last draw
+	bool bTiled;
+	std::vector<PointTile> tiles;
+	std::vector<GLint> drawFirst;
+	std::vector<GLsizei> drawCount;
+};
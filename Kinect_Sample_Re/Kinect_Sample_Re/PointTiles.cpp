@@ -0,0 +1,121 @@
+#include <algorithm>
+#include "PointTiles.h"
+#include "ParallelFor.h"
+
+// level of a pixel by the low bits of (row | col): the stride of the
+// coarsest lattice it lies on, capped at the coarsest level
+static const int lodLevel[8] = { 3, 0, 1, 0, 2, 0, 1, 0 };
+
+PointTiles::PointTiles() :
+nTilesX(0),
+nTilesY(0)
+{
+}
+
+PointTiler::PointTiler()
+{
+}
+
+PointTiler::~PointTiler()
+{
+}
+
+void PointTiler::Build(const PointCloud& cloud, PointTiles& tiles)
+{
+	const int T = PointTiles::nTileSize;
+	const int W = cloud.nWidth;
+	const PointList& valid = cloud.valid;
+
+	tiles.nTilesX = (cloud.nWidth + T - 1) / T;
+	tiles.nTilesY = (cloud.nHeight + T - 1) / T;
+	tiles.tiles.resize(tiles.nTilesX * tiles.nTilesY);
+	tiles.order.resize(valid.nCount);
+
+	const int nBands = ParallelThreadCount();
+	if ((int)bandCounts.size() < nBands)
+		bandCounts.resize(nBands);
+
+	ParallelFor(nBands, [&](int nBegin, int nEnd)
+	{
+		for (int bb = nBegin; bb < nEnd; bb++)
+		{
+			std::vector<int>& counts = bandCounts[bb];
+			counts.resize(tiles.nTilesX * nLodLevels);
+
+			const int nRowBegin = tiles.nTilesY * bb / nBands;
+			const int nRowEnd = tiles.nTilesY * (bb + 1) / nBands;
+			for (int ty = nRowBegin; ty < nRowEnd; ty++)
+			{
+				PointTile* pTiles = &tiles.tiles[ty * tiles.nTilesX];
+				for (int tx = 0; tx < tiles.nTilesX; tx++)
+				{
+					pTiles[tx].fMin[0] = pTiles[tx].fMin[1] = pTiles[tx].fMin[2] = 1e30f;
+					pTiles[tx].fMax[0] = pTiles[tx].fMax[1] = pTiles[tx].fMax[2] = -1e30f;
+				}
+				std::fill(counts.begin(), counts.end(), 0);
+
+				// the points of the row of tiles
+				const int nFirstPixel = ty * T * W;
+				const int nLastPixel = std::min(cloud.nHeight, (ty + 1) * T) * W;
+				const int nFirst = (int)(std::lower_bound(valid.pIndex, valid.pIndex + valid.nCount, nFirstPixel) - valid.pIndex);
+				const int nLast = (int)(std::lower_bound(valid.pIndex + nFirst, valid.pIndex + valid.nCount, nLastPixel) - valid.pIndex);
+
+				// count per tile and level, coarsest level first; rows are
+				// followed along instead of dividing every pixel index
+				int r = ty * T;
+				int nRowStart = r * W;
+				for (int ii = nFirst; ii < nLast; ii++)
+				{
+					const int idx = valid.pIndex[ii];
+					while (idx >= nRowStart + W)
+					{
+						r++;
+						nRowStart += W;
+					}
+					const int c = idx - nRowStart;
+					const int tx = c / T;
+					counts[tx * nLodLevels + nLodLevels - 1 - lodLevel[(r | c) & 7]]++;
+
+					PointTile& tile = pTiles[tx];
+					tile.fMin[0] = std::min(tile.fMin[0], valid.pX[ii]);
+					tile.fMin[1] = std::min(tile.fMin[1], valid.pY[ii]);
+					tile.fMin[2] = std::min(tile.fMin[2], valid.pZ[ii]);
+					tile.fMax[0] = std::max(tile.fMax[0], valid.pX[ii]);
+					tile.fMax[1] = std::max(tile.fMax[1], valid.pY[ii]);
+					tile.fMax[2] = std::max(tile.fMax[2], valid.pZ[ii]);
+				}
+
+				// the row keeps its range, in tile order
+				int nOffset = nFirst;
+				for (int tx = 0; tx < tiles.nTilesX; tx++)
+				{
+					int* pCounts = &counts[tx * nLodLevels];
+					pTiles[tx].nFirst = nOffset;
+					int nSum = 0;
+					for (int kk = 0; kk < nLodLevels; kk++)
+					{
+						const int nCount = pCounts[kk];
+						pCounts[kk] = nOffset;
+						nOffset += nCount;
+						nSum += nCount;
+						pTiles[tx].nLodCount[nLodLevels - 1 - kk] = nSum;
+					}
+				}
+
+				r = ty * T;
+				nRowStart = r * W;
+				for (int ii = nFirst; ii < nLast; ii++)
+				{
+					const int idx = valid.pIndex[ii];
+					while (idx >= nRowStart + W)
+					{
+						r++;
+						nRowStart += W;
+					}
+					const int c = idx - nRowStart;
+					tiles.order[counts[(c / T) * nLodLevels + nLodLevels - 1 - lodLevel[(r | c) & 7]]++] = ii;
+				}
+			}
+		}
+	});
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include "PointCloud.h"
+
+// level l holds the points whose pixel lies on the lattice of stride 2^l
+const int nLodLevels = 4;
+
+// the points of one square of the pixel grid, and their bounding box
+struct PointTile
+{
+	float fMin[3];
+	float fMax[3];
+	// from nFirst in tile order; the first nLodCount[l] are the ones of
+	// level l and above, so nLodCount[0] is all of them
+	int nFirst;
+	int nLodCount[nLodLevels];
+};
+
+// The valid points of an organized cloud grouped by tiles of nTileSize^2
+// pixels, for culling and level of detail when drawing. Within a tile the
+// points are ordered from the coarsest level down, so drawing a tile at a
+// lower resolution is drawing a prefix of its points.
+struct PointTiles
+{
+	static const int nTileSize = 32;
+
+	PointTiles();
+
+	int nTilesX;
+	int nTilesY;
+	// row-major, empty ones included
+	std::vector<PointTile> tiles;
+	// position in the point list of every point, in tile order
+	std::vector<int> order;
+};
+
+// Builds the tiles of cloud.valid, which lists the valid pixels in pixel
+// order; a row of tiles is then a contiguous range of it, so the rows are
+// sorted into tile order in parallel, each by counting.
+class PointTiler
+{
+public:
+	PointTiler();
+	~PointTiler();
+
+	void Build(const PointCloud& cloud, PointTiles& tiles);
+
+private:
+	PointTiler(const PointTiler&);
+	PointTiler& operator=(const PointTiler&);
+
+	// points per tile and level of a row of tiles, per band
+	std::vector<std::vector<int> > bandCounts;
+};
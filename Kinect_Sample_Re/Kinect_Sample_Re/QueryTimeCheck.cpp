@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include "QueryTimeCheck.h"
+
+#ifdef TIME_CHECK_
+
+#include <atomic>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <chrono>
+#endif
+
+// log-linear buckets: 8 per power of two of nanoseconds, so a reported
+// percentile is within ~12% of the true value
+static const int nSubBits = 3;
+static const int nBuckets = 64 << nSubBits;
+
+// zero-initialized before any thread can record
+struct TimeHistogram
+{
+	std::atomic<unsigned int> counts[nBuckets];
+	std::atomic<unsigned long long> nMax;
+};
+
+static TimeHistogram histograms[TIME_STAGE_COUNT];
+static std::atomic<long long> tIntervalStart;
+
+static const char* szStageNames[TIME_STAGE_COUNT] =
+{
+	"acquire",
+	"memcpy",
+	"threshold",
+	"filter",
+	"mapping",
+	"back-projection",
+	"color conversion",
+	"normals",
+	"mesh",
+	"tracking",
+	"voxel grid",
+	"fusion",
+	"octree",
+	"tiles",
+	"pack",
+	"merge",
+	"draw",
+	"select"
+};
+
+TimeTicks TimeCheckNow()
+{
+#ifdef _WIN32
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return counter.QuadPart;
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static unsigned long long TicksToNanoseconds(TimeTicks nTicks)
+{
+	if (nTicks < 0)
+		return 0;
+#ifdef _WIN32
+	static long long nFrequency = 0;
+	if (nFrequency == 0)
+	{
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency(&frequency);
+		nFrequency = frequency.QuadPart;
+	}
+	// split to keep the product in range
+	return (unsigned long long)(nTicks / nFrequency) * 1000000000ULL +
+		(unsigned long long)(nTicks % nFrequency) * 1000000000ULL / nFrequency;
+#else
+	return (unsigned long long)nTicks;
+#endif
+}
+
+static int BucketIndex(unsigned long long n)
+{
+	if (n < (1u << nSubBits))
+		return (int)n;
+
+	int iExponent = 0;
+	for (int iStep = 32; iStep > 0; iStep >>= 1)
+	{
+		if (n >> (iExponent + iStep))
+			iExponent += iStep;
+	}
+	return ((iExponent - nSubBits + 1) << nSubBits) + (int)((n >> (iExponent - nSubBits)) & ((1u << nSubBits) - 1));
+}
+
+// middle of the bucket, in nanoseconds
+static double BucketValue(int iBucket)
+{
+	if (iBucket < (1 << nSubBits))
+		return iBucket;
+
+	const int iShift = (iBucket >> nSubBits) - 1;
+	const double fLower = (double)(((1ULL << nSubBits) + (iBucket & ((1 << nSubBits) - 1))) << iShift);
+	return fLower + (double)(1ULL << iShift) * 0.5;
+}
+
+void TimeCheckRecord(TimeStage stage, TimeTicks nTicks)
+{
+	TimeHistogram& histogram = histograms[stage];
+	const unsigned long long nNanoseconds = TicksToNanoseconds(nTicks);
+
+	// the first sample starts the interval the rates are measured over
+	if (tIntervalStart.load(std::memory_order_relaxed) == 0)
+	{
+		long long tZero = 0;
+		tIntervalStart.compare_exchange_strong(tZero, TimeCheckNow());
+	}
+
+	histogram.counts[BucketIndex(nNanoseconds)].fetch_add(1, std::memory_order_relaxed);
+
+	unsigned long long nMax = histogram.nMax.load(std::memory_order_relaxed);
+	while (nNanoseconds > nMax &&
+		!histogram.nMax.compare_exchange_weak(nMax, nNanoseconds, std::memory_order_relaxed))
+		;
+}
+
+void TimeCheckReport(std::string& report, bool bReset)
+{
+	const TimeTicks tNow = TimeCheckNow();
+	long long tStart = tIntervalStart.load();
+	if (tStart == 0)
+		tStart = tNow;
+	const double fSeconds = (double)TicksToNanoseconds(tNow - tStart) * 1e-9;
+
+	report.clear();
+	for (int ss = 0; ss < TIME_STAGE_COUNT; ss++)
+	{
+		TimeHistogram& histogram = histograms[ss];
+
+		// a snapshot; samples recorded meanwhile may or may not be in it
+		unsigned int counts[nBuckets];
+		unsigned long long nTotal = 0;
+		for (int bb = 0; bb < nBuckets; bb++)
+		{
+			counts[bb] = histogram.counts[bb].load(std::memory_order_relaxed);
+			nTotal += counts[bb];
+		}
+		if (nTotal == 0)
+			continue;
+
+		double fP50 = 0.0, fP99 = 0.0;
+		unsigned long long nSum = 0;
+		for (int bb = 0; bb < nBuckets; bb++)
+		{
+			if (counts[bb] == 0)
+				continue;
+			if (nSum * 2 < nTotal && (nSum + counts[bb]) * 2 >= nTotal)
+				fP50 = BucketValue(bb);
+			if (nSum * 100 < nTotal * 99 && (nSum + counts[bb]) * 100 >= nTotal * 99)
+				fP99 = BucketValue(bb);
+			nSum += counts[bb];
+		}
+
+		// a bucket's middle can lie above the largest sample in it
+		const double fMax = (double)histogram.nMax.load(std::memory_order_relaxed);
+		if (fP50 > fMax)	fP50 = fMax;
+		if (fP99 > fMax)	fP99 = fMax;
+
+		char szLine[256];
+		sprintf(szLine, "%-17s p50 %7.2f ms  p99 %7.2f ms  max %7.2f ms  %6.1f/s\n",
+			szStageNames[ss], fP50 * 1e-6, fP99 * 1e-6, fMax * 1e-6,
+			fSeconds > 0.0 ? nTotal / fSeconds : 0.0);
+		report += szLine;
+	}
+	if (report.empty())
+		report = "No timing samples yet\n";
+
+	if (bReset)
+	{
+		for (int ss = 0; ss < TIME_STAGE_COUNT; ss++)
+		{
+			for (int bb = 0; bb < nBuckets; bb++)
+				histograms[ss].counts[bb].store(0, std::memory_order_relaxed);
+			histograms[ss].nMax.store(0, std::memory_order_relaxed);
+		}
+		tIntervalStart = tNow;
+	}
+}
+
+#else
+
+void TimeCheckReport(std::string& report, bool bReset)
+{
+	report = "Timing is compiled out (TIME_CHECK_)\n";
+}
+
+#endif
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+
+// Per-stage timing of the capture and render pipeline.
+//
+//	TIME_SCOPE(TIME_THRESHOLD);		times the rest of the enclosing block
+//	TIME_START(tStart); ... TIME_STOP(tStart, TIME_ACQUIRE);
+//
+// Samples go into one lock-free histogram per stage, so the capture and
+// GLUT threads can record concurrently; TimeCheckReport() summarizes them.
+// Comment out TIME_CHECK_ to compile every timer out.
+#define TIME_CHECK_
+
+enum TimeStage
+{
+	TIME_ACQUIRE,
+	TIME_MEMCPY,			// processed points into the vertex buffer
+	TIME_THRESHOLD,
+	TIME_FILTER,
+	TIME_MAPPING,			// coordinate mapper calls
+	TIME_BACKPROJECTION,
+	TIME_COLOR_CONVERSION,
+	TIME_NORMALS,
+	TIME_MESH,
+	TIME_TRACKING,
+	TIME_VOXEL_GRID,
+	TIME_FUSION,
+	TIME_OCTREE,
+	TIME_TILES,				// tile order for culling/level of detail
+	TIME_PACK,				// compact points
+	TIME_MERGE,				// clouds of the sensors of a rig into the world frame
+	TIME_DRAW,				// CPU side of the draw calls
+	TIME_SELECT,			// octree queries of the selection
+	TIME_STAGE_COUNT
+};
+
+// p50/p99/max and rate of every stage with samples since the last reset,
+// one line per stage
+void TimeCheckReport(std::string& report, bool bReset);
+
+#ifdef TIME_CHECK_
+
+typedef long long TimeTicks;
+
+TimeTicks TimeCheckNow();
+void TimeCheckRecord(TimeStage stage, TimeTicks nTicks);
+
+class ScopedTimeCheck
+{
+public:
+	ScopedTimeCheck(TimeStage stage) : stage(stage), nStart(TimeCheckNow()) {}
+	~ScopedTimeCheck() { TimeCheckRecord(stage, TimeCheckNow() - nStart); }
+
+private:
+	ScopedTimeCheck(const ScopedTimeCheck&);
+	ScopedTimeCheck& operator=(const ScopedTimeCheck&);
+
+	TimeStage stage;
+	TimeTicks nStart;
+};
+
+#define TIME_CHECK_CONCAT2(a, b) a##b
+#define TIME_CHECK_CONCAT(a, b) TIME_CHECK_CONCAT2(a, b)
+#define TIME_SCOPE(stage) ScopedTimeCheck TIME_CHECK_CONCAT(timeCheck, __LINE__)(stage)
+#define TIME_START(name) const TimeTicks name = TimeCheckNow()
+#define TIME_STOP(name, stage) TimeCheckRecord(stage, TimeCheckNow() - name)
+
+#else
+
+#define TIME_SCOPE(stage)
+#define TIME_START(name)
+#define TIME_STOP(name, stage)
+
+#endif
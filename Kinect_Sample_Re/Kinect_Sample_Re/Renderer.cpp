@@ -5,7 +5,11 @@ void InitializeWindow()
 	// bind textures
 	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 	glEnable(GL_DEPTH_TEST);
+	glPointSize(dispPointSize);
 	reshape(width, height);
+
+	if (!pointRenderer.Initialize())
+		cerr << "Vertex buffers are not supported." << endl;
 }
 
 void InitializeTextureInfo()
@@ -20,9 +24,7 @@ void InitializeTextureInfo()
 			dispTextureCoordinates.at<Vec2f>(rr, cc) =
 				Vec2f(static_cast<float>(cc) / width, static_cast<float>(rr) / height);
 		}
-	}
-
-	hMutex = CreateMutex(NULL, TRUE, NULL);*/
+	}*/
 }
 
 void InitializeWindow(int argc, char* argv[])
@@ -89,124 +91,325 @@ void idle() {
 	static GLuint currentClock = glutGet(GLUT_ELAPSED_TIME);
 	static GLfloat deltaT;
 
+	// sleep until a capture thread publishes a frame; the timeout keeps
+	// mouse and keyboard events flowing while none arrives
+	if (!rig.WaitForFrame(idleWaitMs))
+		return;
+
 	currentClock = glutGet(GLUT_ELAPSED_TIME);
 	deltaT = currentClock - previousClock;
-	if (deltaT < 1000.0 / 20.0) { return; }
-	else { previousClock = currentClock; }
+	previousClock = currentClock;
 
-	//char buff[256];
-	//sprintf_s(buff, "Frame Rate = %f", 1000.0 / deltaT);
-	//frameRate = buff;
+	char buff[256];
+	sprintf_s(buff, "Frame Rate = %f", deltaT > 0 ? 1000.0 / deltaT : 0.0);
+	frameRate = buff;
 
 	glutPostRedisplay();
 }
 
-void display()
+bool Reader(const char* szPath)
 {
-	// load data from kinect
-	//WaitForSingleObject(hMutex, INFINITE);
-	if (recheck)
+	// only maps the file; points are read block by block as they are drawn
+	if (!pointFile.Open(szPath))
+		return false;
+
+	if (vertex == NULL)	vertex = new Vertex[READ_SIZE * BLOCK];
+	if (vertexColor == NULL)	vertexColor = new unsigned int[READ_SIZE * BLOCK];
+	iViewBlock = 0;
+	iLoadedBlock = -1;
+
+	printf("%s: %lld points in %lld blocks\n", szPath, (long long)pointFile.nPoints,
+		(long long)((pointFile.nPoints + READ_SIZE - 1) / READ_SIZE));
+	return true;
+}
+
+void DrawObj()
+{
+	// unpack the visible blocks only when the view moved to other ones
+	if (iLoadedBlock != iViewBlock)
 	{
-		kinect.Update();
+		nLoadedPoints = 0;
+		for (int bb = 0; bb < BLOCK; bb++)
+		{
+			const int nCount = pointFile.Unpack((iViewBlock + bb) * READ_SIZE, READ_SIZE,
+				&vertex[nLoadedPoints].X, &vertexColor[nLoadedPoints]);
+			if (nCount == 0)
+				break;
+			nLoadedPoints += nCount;
+		}
+		iLoadedBlock = iViewBlock;
 
-		//ReleaseMutex(hMutex);
-		//Add_Accumulated(kinect.mCameraSpacePoint, kinect.mColor, dispString);
+		// the next page is the likely next request
+		pointFile.Prefetch((iViewBlock + BLOCK) * READ_SIZE, BLOCK * READ_SIZE);
+	}
 
-		// clear buffers
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	if (nLoadedPoints == 0)
+		return;
 
-		// set matrix
-		glMatrixMode(GL_MODELVIEW);
-		glLoadIdentity();
-		glPushMatrix();
-		glTranslatef(t[0], t[1], t[2] - 1.0f);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glVertexPointer(3, GL_FLOAT, sizeof(Vertex), vertex);
+	glColorPointer(4, GL_UNSIGNED_BYTE, 0, vertexColor);
 
-		GLfloat m[4][4];
-		build_rotmatrix(m, quat);
-		glMultMatrixf(&m[0][0]);
-		draw_center();
+	glDrawArrays(GL_POINTS, 0, nLoadedPoints);
 
-		glMatrixMode(GL_MODELVIEW);
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+}
 
-		// Draw Point ///////////
+void MultiplyMatrices(const GLfloat a[16], const GLfloat b[16], GLfloat out[16])
+{
+	// column-major, out = a b
+	for (int cc = 0; cc < 4; cc++)
+	for (int rr = 0; rr < 4; rr++)
+		out[cc * 4 + rr] = a[rr] * b[cc * 4] + a[4 + rr] * b[cc * 4 + 1] + a[8 + rr] * b[cc * 4 + 2] + a[12 + rr] * b[cc * 4 + 3];
+}
 
-		GLfloat r, g, b;
+void SelectRect()
+{
+	const float fWindowWidth = (float)glutGet(GLUT_WINDOW_WIDTH);
+	const float fWindowHeight = (float)glutGet(GLUT_WINDOW_HEIGHT);
+	const int x0 = min(selectRect[0], selectRect[2]);
+	const int x1 = max(selectRect[0], selectRect[2]);
+	const int y0 = min(selectRect[1], selectRect[3]);
+	const int y1 = max(selectRect[1], selectRect[3]);
+
+	// a click is no rectangle
+	bSelection = x1 - x0 >= 2 && y1 - y0 >= 2;
+	selectBounds[0] = 2.0f * x0 / fWindowWidth - 1.0f;
+	selectBounds[1] = 2.0f * x1 / fWindowWidth - 1.0f;
+	selectBounds[2] = 1.0f - 2.0f * y1 / fWindowHeight;
+	selectBounds[3] = 1.0f - 2.0f * y0 / fWindowHeight;
+	MultiplyMatrices(projectionMatrix, viewMatrix, selectClip);
+
+	SelectPoints();
+
+	char buff[256];
+	sprintf_s(buff, "Selected %d points", (int)selectedPoints.size());
+	dispString = buff;
+}
 
-		glBegin(GL_POINTS);
-		glPointSize(10);
-		for (register int j = 0; j < kinect.nColorHeight;j++)
+void SelectPoints()
+{
+	TIME_SCOPE(TIME_SELECT);
+	selectedPoints.clear();
+	selectedVertices.clear();
+
+	// the octree indexes the points of one sensor, not the merged ones
+	const CloudFrame& frame = kinect.frames.Front();
+	if (!bSelection || !frame.bIndexed || rig.SensorCount() > 1)
+		return;
+
+	// the points are drawn moved by the frame's pose
+	GLfloat clip[16];
+	if (frame.bTracked)
+	{
+		GLfloat pose[16];
+		frame.pose.ToGL(pose);
+		MultiplyMatrices(selectClip, pose, clip);
+	}
+	else
+		memcpy(clip, selectClip, sizeof(clip));
+
+	// a point p is inside when its clip coordinates (x, y, z, w) = clip p
+	// have left w <= x <= right w, bottom w <= y <= top w and -w <= z <= w;
+	// row kk of clip is (clip[kk], clip[4 + kk], clip[8 + kk], clip[12 + kk])
+	float planes[6][4];
+	for (int kk = 0; kk < 4; kk++)
+	{
+		const float x = clip[kk * 4];
+		const float y = clip[kk * 4 + 1];
+		const float z = clip[kk * 4 + 2];
+		const float w = clip[kk * 4 + 3];
+		planes[0][kk] = x - selectBounds[0] * w;
+		planes[1][kk] = selectBounds[1] * w - x;
+		planes[2][kk] = y - selectBounds[2] * w;
+		planes[3][kk] = selectBounds[3] * w - y;
+		planes[4][kk] = z + w;
+		planes[5][kk] = w - z;
+	}
+	frame.octree.QueryFrustum(planes, 6, selectedPoints);
+
+	const PointList& points = frame.Points();
+	selectedVertices.resize(3 * selectedPoints.size());
+	for (size_t ii = 0; ii < selectedPoints.size(); ii++)
+	{
+		const int idx = selectedPoints[ii];
+		selectedVertices[3 * ii] = points.pX[idx];
+		selectedVertices[3 * ii + 1] = points.pY[idx];
+		selectedVertices[3 * ii + 2] = points.pZ[idx];
+	}
+}
+
+void DrawSelection()
+{
+	if (selectedVertices.empty())
+		return;
+
+	// on top of the same points drawn before
+	glPointSize(2 * dispPointSize);
+	glDepthFunc(GL_LEQUAL);
+	glColor3f(1.0f, 1.0f, 0.0f);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, &selectedVertices[0]);
+	glDrawArrays(GL_POINTS, 0, (GLsizei)(selectedVertices.size() / 3));
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDepthFunc(GL_LESS);
+	glPointSize(dispPointSize);
+}
+
+void display()
+{
+	// pick up the latest frame from the capture thread, unless paused;
+	// upload only when it published a new one
+	if (rig.SensorCount() > 1)
+	{
+		// the latest frames of all sensors, merged in the world frame
+		if (recheck && rig.Update())
 		{
-			for (register int i = 0; i < kinect.nColorWidth; i++)
-			{
-				r = kinect.pColorData[(j * 1920) * 3 + i * 3 + 0];
-				r /= 255;
-				g = kinect.pColorData[(j * 1920) * 3 + i * 3 + 1];
-				g /= 255;
-				b = kinect.pColorData[(j * 1920) * 3 + i * 3 + 2];
-				b /= 255;
-				glColor3f(r,g,b);
-				glVertex3f(kinect.cp.index[j][i].X, kinect.cp.index[j][i].Y, kinect.cp.index[j][i].Z);
-			}
+			TIME_SCOPE(TIME_MEMCPY);
+			pointRenderer.Upload(rig.merged);
 		}
+	}
+	else if (recheck && kinect.frames.Update())
+	{
+		TIME_SCOPE(TIME_MEMCPY);
+		const CloudFrame& frame = kinect.frames.Front();
+		if (frame.bCompact)
+			pointRenderer.Upload(frame.compact, frame.bTiled ? &frame.tiles : NULL);
+		else
+			pointRenderer.Upload(frame.Points(),
+				frame.bNormals && kinect.oNormals ? &frame.normals : NULL,
+				frame.bTiled ? &frame.tiles : NULL);
+		if (bSelection)
+			SelectPoints();
+	}
 
-		glEnd();
+	// clear buffers
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		/////////////////////////
-
-		// Draw 2D Text
-		glColor3f(1.0f, 1.0f, 1.0f);
-		glMatrixMode(GL_PROJECTION);
-		glPushMatrix();
-		glLoadIdentity();
-		gluOrtho2D(0.0, width, 0.0, height);
-		glMatrixMode(GL_MODELVIEW);
-		glPushMatrix();
-		glLoadIdentity();
-
-		// show text info
-		//if(dispString.empty()) dispString = dispStringInit;
-		/*int currHeight = height - 40;
-		glRasterPos2i(10, currHeight);
-		const char ch
-		glutBitmapCharacter(GLUT_BITMAP_9_BY_15, ch)*/
-		/*for(int cc = 0; cc < dispString.length(); cc++)
-		{
-		const char ch = dispString[cc];
-		if(ch == 10 || ch == 13)
+	// set matrix
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	glPushMatrix();
+	glTranslatef(t[0], t[1], t[2] - 1.0f);
+
+	GLfloat m[4][4];
+	build_rotmatrix(m, quat);
+	glMultMatrixf(&m[0][0]);
+	glGetFloatv(GL_MODELVIEW_MATRIX, viewMatrix);
+	glGetFloatv(GL_PROJECTION_MATRIX, projectionMatrix);
+	draw_center();
+
+	glMatrixMode(GL_MODELVIEW);
+
+	// Draw Point ///////////
+
+	{
+		TIME_SCOPE(TIME_DRAW);
+		if (pointFile.IsOpen())
+			DrawObj();
+		else if (rig.SensorCount() > 1)
+			pointRenderer.Draw();
+		else
 		{
-		currHeight -= 40;
-		glRasterPos2i(10, currHeight);
+			// a tracked frame is placed where the sensor was
+			const CloudFrame& frame = kinect.frames.Front();
+			glPushMatrix();
+			if (frame.bTracked)
+			{
+				GLfloat pose[16];
+				frame.pose.ToGL(pose);
+				glMultMatrixf(pose);
+			}
+			pointRenderer.Draw(frame.bMeshed ? &frame.mesh : NULL);
+			DrawSelection();
+			glPopMatrix();
 		}
-		else glutBitmapCharacter(GLUT_BITMAP_9_BY_15, ch);
-		} */
+	}
 
-		// show frame rate
-		/*currHeight -= 40;
-		glRasterPos2i(10, currHeight);
-		for(int cc = 0; cc < frameRate.length(); cc++)
-		{
-		const char ch = frameRate[cc];
-		glutBitmapCharacter(GLUT_BITMAP_9_BY_15, ch);
-		}*/
+	/////////////////////////
 
-		glMatrixMode(GL_MODELVIEW);
-		glPopMatrix();
-		glMatrixMode(GL_PROJECTION);
-		glPopMatrix();
+	// Draw 2D Text
+	glColor3f(1.0f, 1.0f, 1.0f);
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	gluOrtho2D(0.0, width, 0.0, height);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
 
-		glutSwapBuffers();
+	// the selection rectangle being dragged
+	if (bDraggingSelection)
+	{
+		const float fScaleX = (float)width / glutGet(GLUT_WINDOW_WIDTH);
+		const float fScaleY = (float)height / glutGet(GLUT_WINDOW_HEIGHT);
+		glDisable(GL_DEPTH_TEST);
+		glColor3f(1.0f, 1.0f, 0.0f);
+		glBegin(GL_LINE_LOOP);
+		glVertex2f(selectRect[0] * fScaleX, height - selectRect[1] * fScaleY);
+		glVertex2f(selectRect[2] * fScaleX, height - selectRect[1] * fScaleY);
+		glVertex2f(selectRect[2] * fScaleX, height - selectRect[3] * fScaleY);
+		glVertex2f(selectRect[0] * fScaleX, height - selectRect[3] * fScaleY);
+		glEnd();
+		glEnable(GL_DEPTH_TEST);
 	}
 
-	else
-		glutPostRedisplay();
+	// show text info
+	//if(dispString.empty()) dispString = dispStringInit;
+	/*int currHeight = height - 40;
+	glRasterPos2i(10, currHeight);
+	const char ch
+	glutBitmapCharacter(GLUT_BITMAP_9_BY_15, ch)*/
+	/*for(int cc = 0; cc < dispString.length(); cc++)
+	{
+	const char ch = dispString[cc];
+	if(ch == 10 || ch == 13)
+	{
+	currHeight -= 40;
+	glRasterPos2i(10, currHeight);
+	}
+	else glutBitmapCharacter(GLUT_BITMAP_9_BY_15, ch);
+	} */
 
+	// show frame rate
+	/*currHeight -= 40;
+	glRasterPos2i(10, currHeight);
+	for(int cc = 0; cc < frameRate.length(); cc++)
+	{
+	const char ch = frameRate[cc];
+	glutBitmapCharacter(GLUT_BITMAP_9_BY_15, ch);
+	}*/
+
+	glMatrixMode(GL_MODELVIEW);
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+
+	glutSwapBuffers();
 }
 
 void close()
 {
+	rig.Stop();
+	cloudWriter.Stop();
+	pointRenderer.Release();
+	pointFile.Close();
+	if (vertex != NULL)	delete[] vertex;
+	if (vertexColor != NULL)	delete[] vertexColor;
+	vertex = NULL;
+	vertexColor = NULL;
 	glDeleteTextures(1, &dispBindIndex);
 	glutLeaveMainLoop();
-	CloseHandle(hMutex);
+}
+
+// the options apply to every sensor of the rig alike
+template<class Toggle>
+void ToggleSensors(const Toggle& toggle)
+{
+	for (int ss = 0; ss < rig.SensorCount(); ss++)
+		toggle(rig.Sensor(ss));
 }
 
 void keyboard(unsigned char key, int x, int y)
@@ -225,28 +428,185 @@ void keyboard(unsigned char key, int x, int y)
 
 	else if (key == 'd')
 	{
-		kinect.Toggle_ThresholdDepthMode();
+		ToggleSensors([](KinectBasic& sensor) { sensor.Toggle_ThresholdDepthMode(); });
 	}
 
 	else if (key == 'i')
 	{
-		kinect.Toggle_ThresholdInfraredMode();
+		ToggleSensors([](KinectBasic& sensor) { sensor.Toggle_ThresholdInfraredMode(); });
+	}
+	else if (key == 'm')
+	{
+		ToggleSensors([](KinectBasic& sensor) { sensor.Toggle_CloudMode(); });
+	}
+
+	else if (key == 'n')
+	{
+		ToggleSensors([](KinectBasic& sensor) { sensor.Toggle_NonlocalMeansFilter(dispString); });
+	}
+
+	else if (key == 'l')
+	{
+		ToggleSensors([](KinectBasic& sensor) { sensor.Toggle_Normals(dispString); });
+	}
+
+	else if (key == 'g')
+	{
+		ToggleSensors([](KinectBasic& sensor) { sensor.Toggle_Mesh(dispString); });
 	}
+
+	else if (key == 'k')
+	{
+		ToggleSensors([](KinectBasic& sensor) { sensor.Toggle_Tracking(dispString); });
+	}
+
+	else if (key == 'v')
+	{
+		ToggleSensors([](KinectBasic& sensor) { sensor.Toggle_VoxelGrid(dispString); });
+	}
+
+	else if (key == '+' || key == '-')
+	{
+		const float fScale = key == '+' ? 1.25f : 0.8f;
+		ToggleSensors([fScale](KinectBasic& sensor) { sensor.Scale_VoxelLeafSize(fScale, dispString); });
+	}
+
+	else if (key == 'a')
+	{
+		ToggleSensors([](KinectBasic& sensor) { sensor.Toggle_AccumulateMode(dispString); });
+	}
+
+	else if (key == 'f')
+	{
+		ToggleSensors([](KinectBasic& sensor) { sensor.Toggle_LevelOfDetail(dispString); });
+	}
+
+	else if (key == 'z')
+	{
+		ToggleSensors([](KinectBasic& sensor) { sensor.Toggle_CompactPoints(dispString); });
+	}
+
+	else if (key == 'b')
+	{
+		ToggleSensors([](KinectBasic& sensor) { sensor.Toggle_SelectMode(dispString); });
+		if (!kinect.oSelect)
+		{
+			bSelection = false;
+			SelectPoints();
+		}
+	}
+
+	else if (key == 'c')
+	{
+		bSelection = false;
+		SelectPoints();
+		dispString = "Selection cleared";
+	}
+
+	else if (key == 's' || key == 'S')
+	{
+		// snapshot what is on screen, with the mesh if one is shown (PLY
+		// only); the file is written in the background
+		const CloudFrame& frame = kinect.frames.Front();
+		const bool bMerged = rig.SensorCount() > 1;
+		const CloudFileFormat format = key == 's' ? CLOUD_FILE_PLY : CLOUD_FILE_PCD;
+		char szPath[256];
+		sprintf_s(szPath, "cloud_%04d.%s", iSaveIndex, format == CLOUD_FILE_PLY ? "ply" : "pcd");
+
+		const GridMesh* pMesh = frame.bMeshed && !bMerged ? &frame.mesh : NULL;
+		char buff[1024];
+		bool bQueued;
+		if (bMerged)
+			bQueued = cloudWriter.Save(rig.merged, szPath, format);
+		else if (frame.bCompact)
+			bQueued = cloudWriter.Save(frame.compact, szPath, format, pMesh);
+		else
+			bQueued = cloudWriter.Save(frame.Points(), szPath, format, pMesh);
+		if (bQueued)
+		{
+			iSaveIndex++;
+			sprintf_s(buff, "Saving %s", szPath);
+		}
+		else
+			sprintf_s(buff, "Save busy, try again");
+		dispString = buff;
+	}
+
+	else if (key == 'w')
+	{
+		// the capture thread writes to the recorder, so swap it while stopped
+		capture.Stop();
+		char buff[1024];
+		if (kinect.pRecorder != NULL)
+		{
+			kinect.StopRecording();
+			sprintf_s(buff, "Recording stopped");
+		}
+		else
+		{
+			char szPath[256];
+			sprintf_s(szPath, "recording_%04d.kfz", iRecordIndex);
+			if (SUCCEEDED(kinect.StartRecording(szPath)))
+			{
+				iRecordIndex++;
+				sprintf_s(buff, "Recording %s", szPath);
+			}
+			else
+				sprintf_s(buff, "Cannot record %s", szPath);
+		}
+		dispString = buff;
+		capture.Start();
+	}
+
+	else if (key == 't')
+	{
+		// latency of every pipeline stage since the last report
+		string report;
+		TimeCheckReport(report, true);
+		printf("%s%s, drawn %d of %d points in %d tiles\n", report.c_str(), frameRate.c_str(),
+			pointRenderer.nDrawnPoints, pointRenderer.nPoints, pointRenderer.nDrawnTiles);
+		for (int ss = 0; ss < rig.SensorCount(); ss++)
+		{
+			KinectBasic& sensor = rig.Sensor(ss);
+			if (rig.SensorCount() > 1)
+				printf("sensor %d: ", ss);
+			printf("frame buffers %d MB (%s), %d heap allocations processing the last frame\n",
+				(int)(sensor.arena.nUsed >> 20), sensor.arena.bLargePages ? "large pages" : "small pages",
+				sensor.frames.Front().nHeapAllocations);
+		}
+	}
+
+	else if (key == '[' || key == ']')
+	{
+		// page through a point file opened with -view
+		const INT64 nBlocks = (pointFile.nPoints + READ_SIZE - 1) / READ_SIZE;
+		iViewBlock += key == ']' ? BLOCK : -BLOCK;
+		if (iViewBlock > nBlocks - BLOCK)	iViewBlock = nBlocks - BLOCK;
+		if (iViewBlock < 0)	iViewBlock = 0;
+	}
+
 	else if (key == 'p')
 	{
-		kinect.Toggle_PickBodyIndex(dispString);
+		ToggleSensors([](KinectBasic& sensor) { sensor.Toggle_PickBodyIndex(dispString); });
 	}
 
 	else if (key >= '0' && key <= '9')
 	{
-		kinect.Set_PickedBodyIndex(key, dispString);
+		ToggleSensors([key](KinectBasic& sensor) { sensor.Set_PickedBodyIndex(key, dispString); });
 	}
 
 	else if (key == 'q')
 	{
-		HRESULT hr = E_FAIL;
-		while (!SUCCEEDED(hr))
-			kinect.InitializeDefaultSensor();
+		// reconnects the live sensor; a replay keeps its source, and a
+		// point file has none
+		if (bReplaying || pointFile.IsOpen())
+			dispString = "Reconnect is for the live sensor only";
+		else
+		{
+			capture.Stop();
+			dispString = SUCCEEDED(OpenDefaultSensor()) ? "Sensor reconnected" : "No sensor found";
+			capture.Start();
+		}
 	}
 
 	else if (key == '`')
@@ -272,6 +632,14 @@ void motion(int x, int y)
 	float gain;
 	gain = 2.0; /* trackball gain */
 
+	if (bDraggingSelection)
+	{
+		selectRect[2] = x;
+		selectRect[3] = y;
+		glutPostRedisplay();
+		return;
+	}
+
 	if (drag_state == GLUT_DOWN)
 	{
 		if (button_state == GLUT_LEFT_BUTTON)
@@ -294,7 +662,7 @@ void motion(int x, int y)
 		{
 
 		}
-		//glutPostRedisplay();
+		glutPostRedisplay();
 	}
 
 	rot_x = x;
@@ -307,6 +675,29 @@ void motion(int x, int y)
 
 void mouse(int button, int state, int x, int y)
 {
+	// in select mode the left button drags a selection rectangle instead of
+	// turning the view
+	if (button == GLUT_LEFT_BUTTON && (kinect.oSelect || bDraggingSelection))
+	{
+		selectRect[2] = x;
+		selectRect[3] = y;
+		if (state == GLUT_DOWN)
+		{
+			bDraggingSelection = true;
+			selectRect[0] = x;
+			selectRect[1] = y;
+		}
+		else if (bDraggingSelection)
+		{
+			bDraggingSelection = false;
+			SelectRect();
+		}
+		drag_state = state;
+		button_state = button;
+		glutPostRedisplay();
+		return;
+	}
+
 	if (state == GLUT_DOWN)
 	{
 		if (button == GLUT_LEFT_BUTTON)
@@ -327,6 +718,7 @@ void mouse(int button, int state, int x, int y)
 		{
 			const float sign = (static_cast<float>(button)-3.5f) * 2.0f;
 			t[2] -= sign * height * 0.00015f;
+			glutPostRedisplay();
 		}
 	}
 
@@ -527,17 +919,94 @@ void build_rotmatrix(float m[4][4], float q[4])
 	m[3][3] = 1.0f;
 }
 
+HRESULT OpenDefaultSensor()
+{
+	HRESULT hr = E_FAIL;
+	for (int ii = 0; ii < sensorAttempts && FAILED(hr); ii++)
+	{
+		if (ii > 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(sensorRetryMs));
+		hr = kinect.InitializeDefaultSensor();
+	}
+	return hr;
+}
+
 int main(int argc, char* argv[])
 {
 	recheck = true;
 	oM = false;
+
+	// -replay <file> [-fast] [-start <frame>]: play a recording instead of the sensor;
+	//	every further -replay adds a sensor of the rig, processed in parallel
+	//	and drawn/saved merged with the others
+	// -extrinsic <rx> <ry> <rz> <tx> <ty> <tz>: places the sensor of the last
+	//	-replay in the world of the rig, by a rotation vector [rad] then a
+	//	translation [m]
+	// -record <file>: record every processed frame (.kfz: compressed)
+	// -view <file>: show a saved .ply/.pcd point file instead of frames
+	// -fps <rate>: cap the display rate
+	vector<const char*> replayPaths;
+	vector<RigidTransform> extrinsics(1, RigidTransform::Identity());
+	float fRateCap = 0.0f;
+	const char* szViewPath = NULL;
+	const char* szRecordPath = NULL;
+	bool bRealTime = true;
+	int nStartFrame = 0;
+	for (int ii = 1; ii < argc; ii++)
+	{
+		if (strcmp(argv[ii], "-replay") == 0 && ii + 1 < argc)
+		{
+			replayPaths.push_back(argv[++ii]);
+			extrinsics.resize(replayPaths.size(), RigidTransform::Identity());
+		}
+		else if (strcmp(argv[ii], "-extrinsic") == 0 && ii + 6 < argc)
+		{
+			extrinsics.back() = RigidTransform::FromTwist(atof(argv[ii + 1]), atof(argv[ii + 2]), atof(argv[ii + 3]),
+				atof(argv[ii + 4]), atof(argv[ii + 5]), atof(argv[ii + 6]));
+			ii += 6;
+		}
+		else if (strcmp(argv[ii], "-record") == 0 && ii + 1 < argc)	szRecordPath = argv[++ii];
+		else if (strcmp(argv[ii], "-view") == 0 && ii + 1 < argc)	szViewPath = argv[++ii];
+		else if (strcmp(argv[ii], "-fast") == 0)	bRealTime = false;
+		else if (strcmp(argv[ii], "-fps") == 0 && ii + 1 < argc)	fRateCap = (float)atof(argv[++ii]);
+		else if (strcmp(argv[ii], "-start") == 0 && ii + 1 < argc)	nStartFrame = atoi(argv[++ii]);
+	}
+
 	HRESULT hr = E_FAIL;
-	while (!SUCCEEDED(hr))
-		hr = kinect.InitializeDefaultSensor();
+	if (szViewPath != NULL)
+	{
+		if (!Reader(szViewPath))
+			return 1;
+	}
+	else if (!replayPaths.empty())
+	{
+		bReplaying = true;
+		hr = kinect.InitializeReplay(replayPaths[0], bRealTime, nStartFrame);
+		for (size_t ss = 1; ss < replayPaths.size() && SUCCEEDED(hr); ss++)
+			hr = rig.AddReplay(replayPaths[ss], bRealTime, nStartFrame);
+		if (FAILED(hr))
+			return 1;
+	}
+	else if (FAILED(OpenDefaultSensor()))
+	{
+		cerr << "No sensor, use -replay <file> or -view <file>" << endl;
+		return 1;
+	}
+
+	if (szRecordPath != NULL)
+		kinect.StartRecording(szRecordPath);
+
 	InitializeTextureInfo();
 	InitializeWindow(argc, argv);
-	kinect.Toggle_ThresholdDepthMode();
-	kinect.Toggle_ThresholdInfraredMode();
+	for (int ss = 0; ss < rig.SensorCount(); ss++)
+		rig.SetExtrinsic(ss, extrinsics[ss]);
+	rig.SetRateCap(fRateCap);
+	ToggleSensors([](KinectBasic& sensor) { sensor.Toggle_ThresholdDepthMode(); });
+	ToggleSensors([](KinectBasic& sensor) { sensor.Toggle_ThresholdInfraredMode(); });
+	if (szViewPath == NULL)
+		rig.Start();
 	glutMainLoop();
+	rig.Stop();
+	cloudWriter.Stop();
 	return 0;
 }
\ No newline at end of file
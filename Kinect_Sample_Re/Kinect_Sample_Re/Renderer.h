@@ -3,12 +3,21 @@
 #include <math.h>
 #include <iostream>
 #include <fstream>
-#include <gl\freeglut.h>		// OpenGL header files
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <GL/freeglut.h>		// OpenGL header files
 #include "KinectBasic.h"
+#include "CaptureThread.h"
+#include "SensorRig.h"
+#include "PointRenderer.h"
+#include "CloudWriter.h"
+#include "MappedPointFile.h"
 #include "QueryTimeCheck.h"
 #include <list>
-#define TIME_CHECK_
 #pragma warning(disable:4996)
+// saved point files are shown BLOCK blocks of READ_SIZE points at a time
 #define BLOCK 4
 #define READ_SIZE 110404
 
@@ -40,8 +49,7 @@ float quat[4] = {0};
 float t[3] = {0};
 
 Vertex *vertex;
-
-float vert[1080][1920][3];
+unsigned int *vertexColor;
 
 bool recheck;
 bool oM;
@@ -50,19 +58,55 @@ bool oM;
 int dispWindowIndex = 0;
 GLuint dispBindIndex = 0;
 const float dispPointSize = 2.0f;
+// longest idle() sleeps waiting for a frame before GLUT handles input again
+const int idleWaitMs = 10;
+// the default sensor is tried this often, this far apart, before giving up
+const int sensorAttempts = 5;
+const int sensorRetryMs = 200;
 
 // variables for display text
 string dispString = "";
-const string dispStringInit = "Depth Threshold: D\nInfrared Threshold: I\nNonlocal Means Filter: N\nPick BodyIndex: P\nAccumulate Mode: A\nSelect Mode: C,B(select)\nSave: S\nReset View: R\nQuit: ESC";
+const string dispStringInit = "Depth Threshold: D\nInfrared Threshold: I\nCloud Resolution (color/depth): M\nVoxel Grid: V, +/-\nNonlocal Means Filter: N\nNormals (lighting): L\nMesh: G\nTrack Pose (ICP): K\nPick BodyIndex: P\nAccumulate Mode: A\nCulling/LOD: F\nCompact Points: Z\nSelect Mode: B(select),C(clear)\nSave: S(ply), Shift+S(pcd)\nRecord (compressed): W\nPage Point File: [, ]\nTiming Report: T\nReset View: R\nQuit: ESC";
 string frameRate;
 
-HANDLE hMutex;
 KinectBasic kinect;
+CaptureThread capture(kinect);
+// kinect and the sensors added with more -replay files
+SensorRig rig(kinect, capture);
+PointRenderer pointRenderer;
+CloudWriter cloudWriter;
+int iSaveIndex = 0;
+int iRecordIndex = 0;
+// frames come from -replay files rather than the sensor
+bool bReplaying = false;
+
+// point file opened with -view, drawn instead of the sensor frames
+MappedPointFile pointFile;
+INT64 iViewBlock = 0;
+INT64 iLoadedBlock = -1;
+int nLoadedPoints = 0;
+
+// select mode: the points inside a rectangle dragged with the left button,
+// looked up again in every new frame until cleared
+bool bDraggingSelection = false;
+// corners in window coordinates while dragging
+int selectRect[4] = { 0 };
+bool bSelection = false;
+// left, right, bottom, top in normalized device coordinates, and the
+// projection times view it was dragged in
+float selectBounds[4];
+GLfloat selectClip[16];
+// of the last display
+GLfloat viewMatrix[16];
+GLfloat projectionMatrix[16];
+vector<int> selectedPoints;
+vector<float> selectedVertices;
 
 // functions for GUIs
 void InitializeTextureInfo();
 void InitializeWindow();
 void InitializeWindow(int argc, char* argv[]);
+HRESULT OpenDefaultSensor();
 
 // high-level functions for GUI
 void draw_center();
@@ -96,8 +140,12 @@ void axis_to_quat(float a[3], float phi, float q[4]);
 void normalize_quat(float q[4]);
 float tb_project_to_sphere(float, float, float);
 void build_rotmatrix(float m[4][4], float q[4]);
-void Reader();
+bool Reader(const char* szPath);
 void DrawObj();
+void MultiplyMatrices(const GLfloat a[16], const GLfloat b[16], GLfloat out[16]);
+void SelectRect();
+void SelectPoints();
+void DrawSelection();
 
 /*
  * (c) Copyright 1993, 1994, Silicon Graphics, Inc.
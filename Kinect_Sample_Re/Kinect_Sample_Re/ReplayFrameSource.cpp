@@ -0,0 +1,447 @@
+#include <string.h>
+#include <thread>
+#include "ReplayFrameSource.h"
+#include "KinectBasic.h"
+#include "FrameCodec.h"
+
+static const char szRecordingMagic[4] = { 'K', 'F', 'R', '1' };
+
+ReplayFrameSource::ReplayFrameSource(const char* szPath, bool bRealTime, bool bLoop) :
+bRealTime(bRealTime),
+bLoop(bLoop),
+pFile(NULL),
+nFirstFrameOffset(0),
+nFrameIndex(0),
+bCompressed(false),
+nTime(0),
+pDepthBuffer(NULL),
+pInfraredBuffer(NULL),
+pColorBuffer(NULL),
+pBodyIndexBuffer(NULL),
+bFrameLoaded(false),
+bFrameAcquired(false),
+nPlaybackStartTime(0),
+bRestartClock(false)
+{
+	memset(&header, 0, sizeof(header));
+	strncpy(this->szPath, szPath, sizeof(this->szPath) - 1);
+	this->szPath[sizeof(this->szPath) - 1] = 0;
+}
+
+ReplayFrameSource::~ReplayFrameSource()
+{
+	Close();
+}
+
+HRESULT ReplayFrameSource::Open()
+{
+	Close();
+
+	pFile = fopen(szPath, "rb");
+	if (pFile == NULL)
+	{
+		cerr << "Cannot open recording " << szPath << endl;
+		return E_FAIL;
+	}
+
+	char szMagic[4];
+	bCompressed = fread(szMagic, sizeof(szMagic), 1, pFile) == 1 &&
+		memcmp(szMagic, szCompressedRecordingMagic, sizeof(szMagic)) == 0;
+	fseek(pFile, 0, SEEK_SET);
+
+	if (bCompressed)
+	{
+		if (FAILED(OpenCompressed()))
+		{
+			cerr << "Damaged recording: " << szPath << endl;
+			Close();
+			return E_FAIL;
+		}
+	}
+	else if (fread(&header, sizeof(header), 1, pFile) != 1 ||
+		memcmp(header.szMagic, szRecordingMagic, sizeof(szRecordingMagic)) != 0)
+	{
+		cerr << "Not a recording: " << szPath << endl;
+		Close();
+		return E_FAIL;
+	}
+
+	if (header.nDepthWidth != KinectBasic::nDepthWidth || header.nDepthHeight != KinectBasic::nDepthHeight ||
+		header.nColorWidth != KinectBasic::nColorWidth || header.nColorHeight != KinectBasic::nColorHeight)
+	{
+		cerr << "Unsupported frame size in recording " << szPath << endl;
+		Close();
+		return E_FAIL;
+	}
+
+	nFirstFrameOffset = ftell(pFile);
+
+	const int nDepthCount = header.nDepthWidth * header.nDepthHeight;
+	const int nColorCount = header.nColorWidth * header.nColorHeight;
+	pDepthBuffer = new UINT16[nDepthCount];
+	pInfraredBuffer = new UINT16[nDepthCount];
+	pColorBuffer = new RGBQUAD[nColorCount];
+	pBodyIndexBuffer = new BYTE[nDepthCount];
+
+	// compressed recordings carry no color
+	if (bCompressed)
+		memset(pColorBuffer, 0xc0, sizeof(RGBQUAD)* nColorCount);
+
+	// recordings started before the sensor streamed may carry zeros
+	if (!header.intrinsics.IsValid())
+		header.intrinsics = SensorIntrinsics::Default();
+
+	return mapper.Initialize(
+		header.intrinsics,
+		header.nDepthWidth, header.nDepthHeight,
+		header.nColorWidth, header.nColorHeight);
+}
+
+void ReplayFrameSource::Close()
+{
+	if (pFile != NULL)	fclose(pFile);
+	pFile = NULL;
+
+	if (pDepthBuffer != NULL)	delete[] pDepthBuffer;
+	if (pInfraredBuffer != NULL)	delete[] pInfraredBuffer;
+	if (pColorBuffer != NULL)	delete[] pColorBuffer;
+	if (pBodyIndexBuffer != NULL)	delete[] pBodyIndexBuffer;
+	pDepthBuffer = NULL;
+	pInfraredBuffer = NULL;
+	pColorBuffer = NULL;
+	pBodyIndexBuffer = NULL;
+
+	bFrameLoaded = false;
+	bFrameAcquired = false;
+	nFrameIndex = 0;
+	frameIndex.clear();
+}
+
+HRESULT ReplayFrameSource::OpenCompressed()
+{
+	CompressedRecordingHeader compressedHeader;
+	if (fread(&compressedHeader, sizeof(compressedHeader), 1, pFile) != 1)
+		return E_FAIL;
+
+	memcpy(header.szMagic, compressedHeader.szMagic, sizeof(header.szMagic));
+	header.nDepthWidth = compressedHeader.nDepthWidth;
+	header.nDepthHeight = compressedHeader.nDepthHeight;
+	header.nColorWidth = compressedHeader.nColorWidth;
+	header.nColorHeight = compressedHeader.nColorHeight;
+	header.nFrameCount = compressedHeader.nFrameCount;
+	header.intrinsics = compressedHeader.intrinsics;
+
+	frameIndex.clear();
+	if (compressedHeader.nIndexOffset != 0)
+	{
+		frameIndex.resize(compressedHeader.nFrameCount);
+		if (compressedHeader.nFrameCount <= 0 ||
+			SeekFile(pFile, compressedHeader.nIndexOffset, SEEK_SET) != 0 ||
+			fread(frameIndex.data(), sizeof(CompressedFrameIndex), frameIndex.size(), pFile) != frameIndex.size())
+			return E_FAIL;
+	}
+	else
+	{
+		// not closed properly: rebuild the index from the complete frame records
+		SeekFile(pFile, 0, SEEK_END);
+		const INT64 nFileSize = TellFile(pFile);
+		INT64 nOffset = sizeof(compressedHeader);
+		CompressedFrameHeader frameHeader;
+		while (SeekFile(pFile, nOffset, SEEK_SET) == 0 &&
+			fread(&frameHeader, sizeof(frameHeader), 1, pFile) == 1)
+		{
+			const INT64 nSize = (INT64)frameHeader.nDepthSize + frameHeader.nInfraredSize + frameHeader.nBodyIndexSize;
+			if (nOffset + (INT64)sizeof(frameHeader) + nSize > nFileSize)
+				break;
+
+			CompressedFrameIndex entry;
+			entry.nTime = frameHeader.nTime;
+			entry.nOffset = nOffset;
+			frameIndex.push_back(entry);
+			nOffset += sizeof(frameHeader) + nSize;
+		}
+		header.nFrameCount = (INT32)frameIndex.size();
+	}
+
+	return frameIndex.empty() ? E_FAIL : S_OK;
+}
+
+HRESULT ReplayFrameSource::ReadCompressedFrame()
+{
+	const CompressedFrameIndex& entry = frameIndex[nFrameIndex];
+	CompressedFrameHeader frameHeader;
+	if (SeekFile(pFile, entry.nOffset, SEEK_SET) != 0 ||
+		fread(&frameHeader, sizeof(frameHeader), 1, pFile) != 1)
+		return E_FAIL;
+
+	const size_t nSize = (size_t)frameHeader.nDepthSize + frameHeader.nInfraredSize + frameHeader.nBodyIndexSize;
+	encoded.resize(nSize);
+	if (fread(encoded.data(), 1, nSize, pFile) != nSize)
+		return E_FAIL;
+
+	const BYTE* pEncoded = encoded.data();
+	if (!DecodePlane16(pEncoded, frameHeader.nDepthSize, header.nDepthWidth, header.nDepthHeight, pDepthBuffer))
+		return E_FAIL;
+	pEncoded += frameHeader.nDepthSize;
+	if (!DecodePlane16(pEncoded, frameHeader.nInfraredSize, header.nDepthWidth, header.nDepthHeight, pInfraredBuffer))
+		return E_FAIL;
+	pEncoded += frameHeader.nInfraredSize;
+	if (!DecodeRuns8(pEncoded, frameHeader.nBodyIndexSize, header.nDepthWidth * header.nDepthHeight, pBodyIndexBuffer))
+		return E_FAIL;
+
+	nTime = frameHeader.nTime;
+	return S_OK;
+}
+
+HRESULT ReplayFrameSource::Seek(int nFrame)
+{
+	if (pFile == NULL || nFrame < 0 || (header.nFrameCount > 0 && nFrame >= header.nFrameCount))
+		return E_INVALIDARG;
+
+	// compressed frames are located through the index when they are read
+	if (!bCompressed)
+	{
+		const size_t nDepthCount = header.nDepthWidth * header.nDepthHeight;
+		const size_t nColorCount = header.nColorWidth * header.nColorHeight;
+		const INT64 nRecordSize = sizeof(INT64) + nDepthCount * (2 * sizeof(UINT16) + sizeof(BYTE)) + nColorCount * sizeof(RGBQUAD);
+		if (SeekFile(pFile, nFirstFrameOffset + nRecordSize * nFrame, SEEK_SET) != 0)
+			return E_FAIL;
+	}
+
+	nFrameIndex = nFrame;
+	bFrameLoaded = false;
+	bFrameAcquired = false;
+	bRestartClock = true;
+	return S_OK;
+}
+
+HRESULT ReplayFrameSource::ReadNextFrame()
+{
+	const size_t nDepthCount = header.nDepthWidth * header.nDepthHeight;
+	const size_t nColorCount = header.nColorWidth * header.nColorHeight;
+
+	for (int nAttempt = 0; nAttempt < 2; nAttempt++)
+	{
+		bool bEnd = header.nFrameCount > 0 && nFrameIndex >= header.nFrameCount;
+		if (!bEnd && bCompressed)
+		{
+			bEnd = FAILED(ReadCompressedFrame());
+		}
+		else if (!bEnd)
+		{
+			bEnd = fread(&nTime, sizeof(nTime), 1, pFile) != 1 ||
+				fread(pDepthBuffer, sizeof(UINT16), nDepthCount, pFile) != nDepthCount ||
+				fread(pInfraredBuffer, sizeof(UINT16), nDepthCount, pFile) != nDepthCount ||
+				fread(pColorBuffer, sizeof(RGBQUAD), nColorCount, pFile) != nColorCount ||
+				fread(pBodyIndexBuffer, sizeof(BYTE), nDepthCount, pFile) != nDepthCount;
+		}
+
+		if (!bEnd)
+		{
+			if (nFrameIndex == 0 || bRestartClock)
+			{
+				nPlaybackStartTime = nTime;
+				tPlaybackStart = std::chrono::steady_clock::now();
+				bRestartClock = false;
+			}
+			nFrameIndex++;
+			return S_OK;
+		}
+
+		// end of recording: rewind once if looping
+		if (!bLoop || nFrameIndex == 0)
+			break;
+		if (!bCompressed)
+			fseek(pFile, nFirstFrameOffset, SEEK_SET);
+		nFrameIndex = 0;
+	}
+
+	return E_FAIL;
+}
+
+HRESULT ReplayFrameSource::WaitForFrame(int iTimeoutMs)
+{
+	if (pFile == NULL)
+		return E_FAIL;
+
+	if (!bFrameLoaded)
+	{
+		HRESULT hr = ReadNextFrame();
+		if (FAILED(hr))
+			return hr;
+		bFrameLoaded = true;
+	}
+
+	// sleep until the loaded frame is due
+	if (bRealTime)
+	{
+		const std::chrono::steady_clock::time_point tDue = tPlaybackStart +
+			std::chrono::microseconds((nTime - nPlaybackStartTime) / 10);
+		const std::chrono::steady_clock::time_point tTimeout =
+			std::chrono::steady_clock::now() + std::chrono::milliseconds(iTimeoutMs);
+		std::this_thread::sleep_until(tDue < tTimeout ? tDue : tTimeout);
+		if (std::chrono::steady_clock::now() < tDue)
+			return E_PENDING;
+	}
+
+	return S_OK;
+}
+
+HRESULT ReplayFrameSource::AcquireFrame(FrameData& frame)
+{
+	if (pFile == NULL)
+		return E_FAIL;
+
+	if (!bFrameLoaded)
+	{
+		HRESULT hr = ReadNextFrame();
+		if (FAILED(hr))
+			return hr;
+		bFrameLoaded = true;
+	}
+
+	// relative time is in 100ns units
+	if (bRealTime)
+	{
+		std::chrono::steady_clock::time_point tDue = tPlaybackStart +
+			std::chrono::microseconds((nTime - nPlaybackStartTime) / 10);
+		if (std::chrono::steady_clock::now() < tDue)
+			return E_PENDING;
+	}
+
+	frame.nTime = nTime;
+	frame.pDepth = pDepthBuffer;
+	frame.pInfrared = pInfraredBuffer;
+	frame.pColor = pColorBuffer;
+	frame.pBodyIndex = pBodyIndexBuffer;
+	bFrameAcquired = true;
+
+	return S_OK;
+}
+
+void ReplayFrameSource::ReleaseFrame()
+{
+	// a frame that was not due yet stays loaded
+	if (bFrameAcquired)
+		bFrameLoaded = false;
+	bFrameAcquired = false;
+}
+
+HRESULT ReplayFrameSource::MapColorFrameToCameraSpace(
+	UINT nDepthPointCount,
+	const UINT16* pDepthFrameData,
+	UINT nCameraPointCount,
+	CameraSpacePoint* pCameraSpacePoints)
+{
+	return mapper.MapColorFrameToCameraSpace(
+		nDepthPointCount,
+		pDepthFrameData,
+		nCameraPointCount,
+		pCameraSpacePoints);
+}
+
+HRESULT ReplayFrameSource::MapDepthFrameToColorSpace(
+	UINT nDepthPointCount,
+	const UINT16* pDepthFrameData,
+	UINT nColorPointCount,
+	ColorSpacePoint* pColorSpacePoints)
+{
+	return mapper.MapDepthFrameToColorSpace(
+		nDepthPointCount,
+		pDepthFrameData,
+		nColorPointCount,
+		pColorSpacePoints);
+}
+
+HRESULT ReplayFrameSource::GetDepthFrameToCameraSpaceTable(
+	UINT nTableEntryCount,
+	PointF* pTableEntries)
+{
+	return mapper.GetDepthFrameToCameraSpaceTable(nTableEntryCount, pTableEntries);
+}
+
+HRESULT ReplayFrameSource::GetSensorIntrinsics(SensorIntrinsics& intrinsics)
+{
+	if (pFile == NULL)
+		return E_FAIL;
+
+	intrinsics = header.intrinsics;
+	return S_OK;
+}
+
+RecordingWriter::RecordingWriter() :
+pFile(NULL)
+{
+	memset(&header, 0, sizeof(header));
+}
+
+RecordingWriter::~RecordingWriter()
+{
+	Close();
+}
+
+HRESULT RecordingWriter::Open(
+	const char* szPath,
+	int nDepthWidth, int nDepthHeight,
+	int nColorWidth, int nColorHeight,
+	const SensorIntrinsics& intrinsics)
+{
+	Close();
+
+	pFile = fopen(szPath, "wb");
+	if (pFile == NULL)
+	{
+		cerr << "Cannot create recording " << szPath << endl;
+		return E_FAIL;
+	}
+
+	memcpy(header.szMagic, szRecordingMagic, sizeof(szRecordingMagic));
+	header.nDepthWidth = nDepthWidth;
+	header.nDepthHeight = nDepthHeight;
+	header.nColorWidth = nColorWidth;
+	header.nColorHeight = nColorHeight;
+	header.nFrameCount = 0;
+	header.intrinsics = intrinsics;
+
+	// frame count is patched in Close(); 0 means "read until end of file"
+	if (fwrite(&header, sizeof(header), 1, pFile) != 1)
+	{
+		Close();
+		return E_FAIL;
+	}
+
+	return S_OK;
+}
+
+HRESULT RecordingWriter::Write(const FrameData& frame)
+{
+	if (pFile == NULL)
+		return E_FAIL;
+
+	const size_t nDepthCount = header.nDepthWidth * header.nDepthHeight;
+	const size_t nColorCount = header.nColorWidth * header.nColorHeight;
+
+	if (fwrite(&frame.nTime, sizeof(frame.nTime), 1, pFile) != 1 ||
+		fwrite(frame.pDepth, sizeof(UINT16), nDepthCount, pFile) != nDepthCount ||
+		fwrite(frame.pInfrared, sizeof(UINT16), nDepthCount, pFile) != nDepthCount ||
+		fwrite(frame.pColor, sizeof(RGBQUAD), nColorCount, pFile) != nColorCount ||
+		fwrite(frame.pBodyIndex, sizeof(BYTE), nDepthCount, pFile) != nDepthCount)
+	{
+		cerr << "Writing recording failed" << endl;
+		return E_FAIL;
+	}
+
+	header.nFrameCount++;
+	return S_OK;
+}
+
+void RecordingWriter::Close()
+{
+	if (pFile == NULL)
+		return;
+
+	fseek(pFile, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, pFile);
+	fclose(pFile);
+	pFile = NULL;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+#include "FrameSource.h"
+#include "CompressedRecording.h"
+
+// header of a raw recording (.kfr), followed by fixed-size frame records:
+// INT64 time, UINT16 depth[], UINT16 infrared[], RGBQUAD color[], BYTE bodyIndex[]
+struct RecordingHeader
+{
+	char szMagic[4];
+	INT32 nDepthWidth;
+	INT32 nDepthHeight;
+	INT32 nColorWidth;
+	INT32 nColorHeight;
+	INT32 nFrameCount;
+	SensorIntrinsics intrinsics;
+};
+
+// plays back a recording written by RecordingWriter or
+// CompressedRecordingWriter, either paced by the recorded timestamps or as
+// fast as frames are requested
+class ReplayFrameSource : public FrameSource
+{
+public:
+	ReplayFrameSource(const char* szPath, bool bRealTime, bool bLoop = true);
+	~ReplayFrameSource();
+
+	HRESULT Open();
+	void Close();
+
+	HRESULT WaitForFrame(int iTimeoutMs);
+	HRESULT AcquireFrame(FrameData& frame);
+	void ReleaseFrame();
+
+	HRESULT MapColorFrameToCameraSpace(
+		UINT nDepthPointCount,
+		const UINT16* pDepthFrameData,
+		UINT nCameraPointCount,
+		CameraSpacePoint* pCameraSpacePoints);
+
+	HRESULT MapDepthFrameToColorSpace(
+		UINT nDepthPointCount,
+		const UINT16* pDepthFrameData,
+		UINT nColorPointCount,
+		ColorSpacePoint* pColorSpacePoints);
+
+	HRESULT GetDepthFrameToCameraSpaceTable(
+		UINT nTableEntryCount,
+		PointF* pTableEntries);
+
+	HRESULT GetSensorIntrinsics(SensorIntrinsics& intrinsics);
+
+	// continue playback at the given frame (the first is 0)
+	HRESULT Seek(int nFrame);
+
+	// for compressed recordings only the sizes, frame count and intrinsics
+	RecordingHeader header;
+
+private:
+	HRESULT OpenCompressed();
+	HRESULT ReadNextFrame();
+	HRESULT ReadCompressedFrame();
+
+	char szPath[1024];
+	bool bRealTime;
+	bool bLoop;
+
+	FILE* pFile;
+	long nFirstFrameOffset;
+	int nFrameIndex;
+
+	// compressed recordings are read through their frame index
+	bool bCompressed;
+	std::vector<CompressedFrameIndex> frameIndex;
+	std::vector<BYTE> encoded;
+
+	INT64 nTime;
+	UINT16* pDepthBuffer;
+	UINT16* pInfraredBuffer;
+	RGBQUAD* pColorBuffer;
+	BYTE* pBodyIndexBuffer;
+	bool bFrameLoaded;
+	bool bFrameAcquired;
+
+	// wall clock of the first frame, for real-time pacing
+	INT64 nPlaybackStartTime;
+	std::chrono::steady_clock::time_point tPlaybackStart;
+	bool bRestartClock;
+
+	SoftwareMapper mapper;
+};
+
+// writes frames in the raw recording format read by ReplayFrameSource
+class RecordingWriter : public FrameRecorder
+{
+public:
+	RecordingWriter();
+	~RecordingWriter();
+
+	HRESULT Open(
+		const char* szPath,
+		int nDepthWidth, int nDepthHeight,
+		int nColorWidth, int nColorHeight,
+		const SensorIntrinsics& intrinsics);
+	HRESULT Write(const FrameData& frame);
+	void Close();
+
+private:
+	FILE* pFile;
+	RecordingHeader header;
+};
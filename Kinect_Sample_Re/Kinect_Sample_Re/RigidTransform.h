@@ -0,0 +1,94 @@
+#pragma once
+
+#include <math.h>
+
+// Rotation plus translation, p' = R p + t, R row-major.
+struct RigidTransform
+{
+	float R[9];
+	float t[3];
+
+	static RigidTransform Identity()
+	{
+		RigidTransform T = { { 1, 0, 0, 0, 1, 0, 0, 0, 1 }, { 0, 0, 0 } };
+		return T;
+	}
+
+	// rotation by the vector (rx, ry, rz) (axis times angle [rad]), then
+	// translation by (tx, ty, tz)
+	static RigidTransform FromTwist(double rx, double ry, double rz, double tx, double ty, double tz)
+	{
+		RigidTransform T = Identity();
+		const double fAngle = sqrt(rx * rx + ry * ry + rz * rz);
+		if (fAngle > 1e-12)
+		{
+			// Rodrigues' formula
+			const double kx = rx / fAngle, ky = ry / fAngle, kz = rz / fAngle;
+			const double c = cos(fAngle), s = sin(fAngle), v = 1.0 - c;
+			T.R[0] = (float)(c + kx * kx * v);
+			T.R[1] = (float)(kx * ky * v - kz * s);
+			T.R[2] = (float)(kx * kz * v + ky * s);
+			T.R[3] = (float)(ky * kx * v + kz * s);
+			T.R[4] = (float)(c + ky * ky * v);
+			T.R[5] = (float)(ky * kz * v - kx * s);
+			T.R[6] = (float)(kz * kx * v - ky * s);
+			T.R[7] = (float)(kz * ky * v + kx * s);
+			T.R[8] = (float)(c + kz * kz * v);
+		}
+		T.t[0] = (float)tx;
+		T.t[1] = (float)ty;
+		T.t[2] = (float)tz;
+		return T;
+	}
+
+	void Apply(float x, float y, float z, float& xOut, float& yOut, float& zOut) const
+	{
+		xOut = R[0] * x + R[1] * y + R[2] * z + t[0];
+		yOut = R[3] * x + R[4] * y + R[5] * z + t[1];
+		zOut = R[6] * x + R[7] * y + R[8] * z + t[2];
+	}
+
+	void Rotate(float x, float y, float z, float& xOut, float& yOut, float& zOut) const
+	{
+		xOut = R[0] * x + R[1] * y + R[2] * z;
+		yOut = R[3] * x + R[4] * y + R[5] * z;
+		zOut = R[6] * x + R[7] * y + R[8] * z;
+	}
+
+	// this after B: p' = this(B(p))
+	RigidTransform operator*(const RigidTransform& B) const
+	{
+		RigidTransform T;
+		for (int rr = 0; rr < 3; rr++)
+		{
+			for (int cc = 0; cc < 3; cc++)
+				T.R[rr * 3 + cc] = R[rr * 3] * B.R[cc] + R[rr * 3 + 1] * B.R[3 + cc] + R[rr * 3 + 2] * B.R[6 + cc];
+			T.t[rr] = R[rr * 3] * B.t[0] + R[rr * 3 + 1] * B.t[1] + R[rr * 3 + 2] * B.t[2] + t[rr];
+		}
+		return T;
+	}
+
+	RigidTransform Inverse() const
+	{
+		RigidTransform T;
+		for (int rr = 0; rr < 3; rr++)
+		for (int cc = 0; cc < 3; cc++)
+			T.R[rr * 3 + cc] = R[cc * 3 + rr];
+		for (int rr = 0; rr < 3; rr++)
+			T.t[rr] = -(T.R[rr * 3] * t[0] + T.R[rr * 3 + 1] * t[1] + T.R[rr * 3 + 2] * t[2]);
+		return T;
+	}
+
+	// column-major 4x4, for glMultMatrixf
+	void ToGL(float m[16]) const
+	{
+		for (int rr = 0; rr < 3; rr++)
+		{
+			for (int cc = 0; cc < 3; cc++)
+				m[cc * 4 + rr] = R[rr * 3 + cc];
+			m[12 + rr] = t[rr];
+			m[rr * 4 + 3] = 0;
+		}
+		m[15] = 1;
+	}
+};
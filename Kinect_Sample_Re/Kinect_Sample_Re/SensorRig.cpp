@@ -0,0 +1,111 @@
+#include "SensorRig.h"
+#include "CloudMerge.h"
+#include "QueryTimeCheck.h"
+
+SensorRig::SensorRig(KinectBasic& kinect, CaptureThread& capture)
+{
+	RigSensor sensor;
+	sensor.pKinect = &kinect;
+	sensor.pCapture = &capture;
+	sensor.extrinsic = RigidTransform::Identity();
+	sensor.bOwned = false;
+	sensors.push_back(sensor);
+	kinect.pacer.NotifyAlso(&pacer);
+}
+
+SensorRig::~SensorRig()
+{
+	Stop();
+	for (size_t ss = 0; ss < sensors.size(); ss++)
+	{
+		sensors[ss].pKinect->pacer.NotifyAlso(NULL);
+		if (!sensors[ss].bOwned)
+			continue;
+		delete sensors[ss].pCapture;
+		delete sensors[ss].pKinect;
+	}
+}
+
+HRESULT SensorRig::AddReplay(const char* szPath, bool bRealTime, int nStartFrame)
+{
+	KinectBasic* pKinect = new KinectBasic();
+	HRESULT hr = pKinect->InitializeReplay(szPath, bRealTime, nStartFrame);
+	if (FAILED(hr))
+	{
+		delete pKinect;
+		return hr;
+	}
+
+	RigSensor sensor;
+	sensor.pKinect = pKinect;
+	sensor.pCapture = new CaptureThread(*pKinect);
+	sensor.extrinsic = RigidTransform::Identity();
+	sensor.bOwned = true;
+	sensors.push_back(sensor);
+	pKinect->pacer.NotifyAlso(&pacer);
+	return S_OK;
+}
+
+void SensorRig::SetExtrinsic(int iSensor, const RigidTransform& extrinsic)
+{
+	sensors[iSensor].extrinsic = extrinsic;
+}
+
+int SensorRig::SensorCount() const
+{
+	return (int)sensors.size();
+}
+
+KinectBasic& SensorRig::Sensor(int iSensor)
+{
+	return *sensors[iSensor].pKinect;
+}
+
+void SensorRig::Start()
+{
+	for (size_t ss = 0; ss < sensors.size(); ss++)
+		sensors[ss].pCapture->Start();
+}
+
+void SensorRig::Stop()
+{
+	for (size_t ss = 0; ss < sensors.size(); ss++)
+		sensors[ss].pCapture->Stop();
+}
+
+bool SensorRig::WaitForFrame(int iTimeoutMs)
+{
+	return pacer.WaitForFrame(iTimeoutMs);
+}
+
+void SensorRig::SetRateCap(float fMaxRate)
+{
+	pacer.SetRateCap(fMaxRate);
+}
+
+bool SensorRig::Update()
+{
+	bool bUpdated = false;
+	for (size_t ss = 0; ss < sensors.size(); ss++)
+	{
+		if (sensors[ss].pKinect->frames.Update())
+			bUpdated = true;
+	}
+	if (!bUpdated)
+		return false;
+
+	TIME_SCOPE(TIME_MERGE);
+	// a sensor that has not published yet has no points
+	clouds.resize(sensors.size());
+	transforms.resize(sensors.size());
+	for (size_t ss = 0; ss < sensors.size(); ss++)
+	{
+		const CloudFrame& frame = sensors[ss].pKinect->frames.Front();
+		clouds[ss] = &frame.Points();
+		// a tracked sensor moved by its pose within its own start frame
+		transforms[ss] = frame.bTracked ? sensors[ss].extrinsic * frame.pose : sensors[ss].extrinsic;
+	}
+
+	MergeClouds(&clouds[0], &transforms[0], (int)sensors.size(), merged);
+	return true;
+}
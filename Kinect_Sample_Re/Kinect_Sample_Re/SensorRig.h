@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+#include "KinectBasic.h"
+#include "CaptureThread.h"
+#include "RigidTransform.h"
+
+// Several cameras processed side by side. Every sensor is a KinectBasic of
+// its own, run by its own capture thread, so the frames of the sensors are
+// processed in parallel rather than one after the other (their ParallelFor
+// stages share the workers instead of taking turns); its extrinsic
+// places its camera space in the world. The GLUT thread merges the latest
+// frame of every sensor into one world frame list, drawn and saved like
+// the points of a single sensor. The Kinect runtime opens one sensor per
+// machine, so the other sensors replay recordings (e.g. of the other
+// cameras of the rig).
+class SensorRig
+{
+public:
+	// kinect and capture, kept by the caller, are the first sensor
+	SensorRig(KinectBasic& kinect, CaptureThread& capture);
+	~SensorRig();
+
+	// another sensor, replaying szPath
+	HRESULT AddReplay(const char* szPath, bool bRealTime, int nStartFrame = 0);
+	// camera space of the sensor to world, identity until set
+	void SetExtrinsic(int iSensor, const RigidTransform& extrinsic);
+
+	int SensorCount() const;
+	KinectBasic& Sensor(int iSensor);
+
+	void Start();
+	void Stop();
+
+	// like FramePacer::WaitForFrame(), for a frame of any sensor
+	bool WaitForFrame(int iTimeoutMs);
+	// frames per second let through WaitForFrame(), 0 for no cap
+	void SetRateCap(float fMaxRate);
+	// picks up the latest frame of every sensor; true when one was new,
+	// merged then holds the points of all of them in the world frame
+	bool Update();
+
+	PointList merged;
+
+private:
+	struct RigSensor
+	{
+		KinectBasic* pKinect;
+		CaptureThread* pCapture;
+		RigidTransform extrinsic;
+		// made by AddReplay()
+		bool bOwned;
+	};
+
+	SensorRig(const SensorRig&);
+	SensorRig& operator=(const SensorRig&);
+
+	std::vector<RigSensor> sensors;
+	// notified by the pacer of every sensor
+	FramePacer pacer;
+	// of the last Update()
+	std::vector<const PointList*> clouds;
+	std::vector<RigidTransform> transforms;
+};
@@ -0,0 +1,184 @@
+#include <limits>
+#include <math.h>
+#include "SoftwareMapper.h"
+
+SensorIntrinsics SensorIntrinsics::Default()
+{
+	SensorIntrinsics intr;
+
+	// typical Kinect V2 depth camera
+	intr.fDepthFocalX = 365.456f;
+	intr.fDepthFocalY = 365.456f;
+	intr.fDepthPrincipalX = 254.878f;
+	intr.fDepthPrincipalY = 205.395f;
+
+	// calibrated color camera
+	//focal length [ 1063.018  1065.133 ] +/- [ 1.880  1.889 ]
+	//principal point [ 962.373  526.689 ] +/- [ 1.085  0.885 ]
+	//distortion [ 0.042369  -0.037696  -0.002894  0.000978 ] +/- [ 0.002178  0.009347  0.000238  0.000308 ]
+	intr.fColorFocalX = 1063.118f;
+	intr.fColorFocalY = 1065.233f;
+	intr.fColorPrincipalX = 962.473f;
+	intr.fColorPrincipalY = 526.789f;
+
+	intr.fBaselineX = 0.052f;
+
+	return intr;
+}
+
+SoftwareMapper::SoftwareMapper() :
+intrinsics(SensorIntrinsics::Default()),
+nDepthWidth(0),
+nDepthHeight(0),
+nColorWidth(0),
+nColorHeight(0),
+pRayX(NULL),
+pRayY(NULL)
+{
+}
+
+SoftwareMapper::~SoftwareMapper()
+{
+	if (pRayX != NULL)	delete[] pRayX;
+	if (pRayY != NULL)	delete[] pRayY;
+}
+
+HRESULT SoftwareMapper::Initialize(
+	const SensorIntrinsics& intrinsics,
+	int nDepthWidth, int nDepthHeight,
+	int nColorWidth, int nColorHeight)
+{
+	if (nDepthWidth <= 0 || nDepthHeight <= 0 || nColorWidth <= 0 || nColorHeight <= 0)
+		return E_INVALIDARG;
+
+	this->intrinsics = intrinsics;
+	this->nDepthWidth = nDepthWidth;
+	this->nDepthHeight = nDepthHeight;
+	this->nColorWidth = nColorWidth;
+	this->nColorHeight = nColorHeight;
+
+	if (pRayX != NULL)	delete[] pRayX;
+	if (pRayY != NULL)	delete[] pRayY;
+	pRayX = new float[nDepthWidth];
+	pRayY = new float[nDepthHeight];
+
+	for (int cc = 0; cc < nDepthWidth; cc++)
+		pRayX[cc] = (cc - intrinsics.fDepthPrincipalX) / intrinsics.fDepthFocalX;
+	for (int rr = 0; rr < nDepthHeight; rr++)
+		pRayY[rr] = -(rr - intrinsics.fDepthPrincipalY) / intrinsics.fDepthFocalY;
+
+	return S_OK;
+}
+
+HRESULT SoftwareMapper::MapColorFrameToCameraSpace(
+	UINT nDepthPointCount,
+	const UINT16* pDepthFrameData,
+	UINT nCameraPointCount,
+	CameraSpacePoint* pCameraSpacePoints) const
+{
+	if (pRayX == NULL)
+		return E_FAIL;
+	if (nDepthPointCount != (UINT)(nDepthWidth * nDepthHeight) ||
+		nCameraPointCount != (UINT)(nColorWidth * nColorHeight))
+		return E_INVALIDARG;
+
+	// unmapped pixels are -inf, as with the SDK mapper
+	const float fInvalid = -std::numeric_limits<float>::infinity();
+	for (UINT ii = 0; ii < nCameraPointCount; ii++)
+	{
+		pCameraSpacePoints[ii].X = fInvalid;
+		pCameraSpacePoints[ii].Y = fInvalid;
+		pCameraSpacePoints[ii].Z = fInvalid;
+	}
+
+	// one depth pixel covers about (color focal / depth focal)^2 color pixels
+	const int nSplat = (int)ceil(intrinsics.fColorFocalX / intrinsics.fDepthFocalX * 0.5f);
+
+	for (int rr = 0; rr < nDepthHeight; rr++)
+	{
+		const UINT16* pDepthRow = pDepthFrameData + rr * nDepthWidth;
+		for (int cc = 0; cc < nDepthWidth; cc++)
+		{
+			if (pDepthRow[cc] == 0) continue;
+
+			CameraSpacePoint point;
+			point.Z = pDepthRow[cc] * 0.001f;
+			point.X = pRayX[cc] * point.Z;
+			point.Y = pRayY[rr] * point.Z;
+
+			const int uc = (int)((point.X + intrinsics.fBaselineX) * intrinsics.fColorFocalX / point.Z + intrinsics.fColorPrincipalX + 0.5f);
+			const int vc = (int)(-point.Y * intrinsics.fColorFocalY / point.Z + intrinsics.fColorPrincipalY + 0.5f);
+
+			for (int vv = vc - nSplat; vv <= vc + nSplat; vv++)
+			{
+				if (vv < 0 || vv >= nColorHeight) continue;
+				CameraSpacePoint* pRow = pCameraSpacePoints + vv * nColorWidth;
+				for (int uu = uc - nSplat; uu <= uc + nSplat; uu++)
+				{
+					if (uu < 0 || uu >= nColorWidth) continue;
+					if (pRow[uu].Z <= 0 || point.Z < pRow[uu].Z)
+						pRow[uu] = point;
+				}
+			}
+		}
+	}
+
+	return S_OK;
+}
+
+HRESULT SoftwareMapper::MapDepthFrameToColorSpace(
+	UINT nDepthPointCount,
+	const UINT16* pDepthFrameData,
+	UINT nColorPointCount,
+	ColorSpacePoint* pColorSpacePoints) const
+{
+	if (pRayX == NULL)
+		return E_FAIL;
+	if (nDepthPointCount != (UINT)(nDepthWidth * nDepthHeight) || nColorPointCount != nDepthPointCount)
+		return E_INVALIDARG;
+
+	const float fInvalid = -std::numeric_limits<float>::infinity();
+	for (int rr = 0; rr < nDepthHeight; rr++)
+	{
+		const UINT16* pDepthRow = pDepthFrameData + rr * nDepthWidth;
+		ColorSpacePoint* pColorRow = pColorSpacePoints + rr * nDepthWidth;
+		for (int cc = 0; cc < nDepthWidth; cc++)
+		{
+			if (pDepthRow[cc] == 0)
+			{
+				pColorRow[cc].X = fInvalid;
+				pColorRow[cc].Y = fInvalid;
+				continue;
+			}
+
+			// X/Z, Y/Z of the ray, shifted into the color camera
+			const float fInvZ = 1000.0f / pDepthRow[cc];
+			pColorRow[cc].X = (pRayX[cc] + intrinsics.fBaselineX * fInvZ) * intrinsics.fColorFocalX + intrinsics.fColorPrincipalX;
+			pColorRow[cc].Y = -pRayY[rr] * intrinsics.fColorFocalY + intrinsics.fColorPrincipalY;
+		}
+	}
+
+	return S_OK;
+}
+
+HRESULT SoftwareMapper::GetDepthFrameToCameraSpaceTable(
+	UINT nTableEntryCount,
+	PointF* pTableEntries) const
+{
+	if (pRayX == NULL)
+		return E_FAIL;
+	if (nTableEntryCount != (UINT)(nDepthWidth * nDepthHeight))
+		return E_INVALIDARG;
+
+	for (int rr = 0; rr < nDepthHeight; rr++)
+	{
+		PointF* pRow = pTableEntries + rr * nDepthWidth;
+		for (int cc = 0; cc < nDepthWidth; cc++)
+		{
+			pRow[cc].X = pRayX[cc];
+			pRow[cc].Y = pRayY[rr];
+		}
+	}
+
+	return S_OK;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "KinectCompat.h"
+
+// pinhole parameters of the depth and color cameras
+struct SensorIntrinsics
+{
+	float fDepthFocalX;
+	float fDepthFocalY;
+	float fDepthPrincipalX;
+	float fDepthPrincipalY;
+
+	float fColorFocalX;
+	float fColorFocalY;
+	float fColorPrincipalX;
+	float fColorPrincipalY;
+
+	// translation from depth to color camera along X [m]
+	float fBaselineX;
+
+	static SensorIntrinsics Default();
+
+	// the Kinect runtime reports zeros until the sensor streams
+	bool IsValid() const
+	{
+		return fDepthFocalX > 0.0f && fDepthFocalY > 0.0f && fColorFocalX > 0.0f && fColorFocalY > 0.0f;
+	}
+};
+
+// Coordinate mapper working from intrinsics only, used when no sensor
+// (and hence no ICoordinateMapper) is available, e.g. for replayed frames.
+// It approximates the SDK mapper: depth pixels are back-projected and
+// splatted into the color image with a z-test, and registration of depth
+// to color is a plain reprojection without lens distortion.
+class SoftwareMapper
+{
+public:
+	SoftwareMapper();
+	~SoftwareMapper();
+
+	HRESULT Initialize(
+		const SensorIntrinsics& intrinsics,
+		int nDepthWidth, int nDepthHeight,
+		int nColorWidth, int nColorHeight);
+
+	HRESULT MapColorFrameToCameraSpace(
+		UINT nDepthPointCount,
+		const UINT16* pDepthFrameData,
+		UINT nCameraPointCount,
+		CameraSpacePoint* pCameraSpacePoints) const;
+
+	HRESULT MapDepthFrameToColorSpace(
+		UINT nDepthPointCount,
+		const UINT16* pDepthFrameData,
+		UINT nColorPointCount,
+		ColorSpacePoint* pColorSpacePoints) const;
+
+	HRESULT GetDepthFrameToCameraSpaceTable(
+		UINT nTableEntryCount,
+		PointF* pTableEntries) const;
+
+	SensorIntrinsics intrinsics;
+
+private:
+	int nDepthWidth;
+	int nDepthHeight;
+	int nColorWidth;
+	int nColorHeight;
+
+	// depth rays: X = pRayX[col] * Z, Y = pRayY[row] * Z
+	float* pRayX;
+	float* pRayY;
+};
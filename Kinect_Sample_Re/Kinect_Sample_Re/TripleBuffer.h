@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+
+// Lock-free single-producer/single-consumer triple buffer.
+// The producer fills Back() and calls Publish(); the consumer calls Update()
+// and reads Front(). Neither side ever waits: the producer always has a free
+// slot and the consumer always sees the most recently published one.
+template<class T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() :
+	iBack(0),
+	iFront(1),
+	iMiddle(2)
+	{
+	}
+
+	// producer side
+	T& Back()
+	{
+		return slots[iBack];
+	}
+
+	void Publish()
+	{
+		iBack = iMiddle.exchange(iBack | nDirtyFlag) & nIndexMask;
+	}
+
+	// consumer side; returns true when a newer slot became the front
+	bool Update()
+	{
+		if ((iMiddle.load() & nDirtyFlag) == 0)
+			return false;
+
+		iFront = iMiddle.exchange(iFront) & nIndexMask;
+		return true;
+	}
+
+	const T& Front() const
+	{
+		return slots[iFront];
+	}
+
+	T& Front()
+	{
+		return slots[iFront];
+	}
+
+	// every slot, for setting them up before either side runs
+	static const int nSlots = 3;
+
+	T& Slot(int iSlot)
+	{
+		return slots[iSlot];
+	}
+
+private:
+	static const int nIndexMask = 0x3;
+	static const int nDirtyFlag = 0x4;
+
+	TripleBuffer(const TripleBuffer&);
+	TripleBuffer& operator=(const TripleBuffer&);
+
+	T slots[nSlots];
+	int iBack;
+	int iFront;
+	std::atomic<int> iMiddle;
+};
@@ -0,0 +1,356 @@
+#include <atomic>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "TsdfVolume.h"
+#include "AlignedMemory.h"
+#include "ParallelFor.h"
+
+// weights saturate so the volume keeps adapting slowly
+static const int nMaxWeight = 64;
+static const float fDistanceScale = 32767.0f;
+// voxels at (almost) full truncation on both sides are not a surface
+static const int nTruncatedDistance = 32000;
+// corrections of the pinhole guess against the ray table; three settle
+// even the image corners, where the lens distortion is largest
+static const int nProjectSteps = 3;
+
+// depth pixel whose ray (X/Z, Y/Z) is closest to (x, y): the table is
+// inverted by Newton steps that use the pinhole focal lengths as slope, so a
+// pinhole table gives back the pinhole projection exactly
+static bool ProjectToPixel(
+	float x, float y,
+	const float* pRayX, const float* pRayY,
+	int nWidth, int nHeight,
+	const SensorIntrinsics& intrinsics,
+	int& u, int& v)
+{
+	float fu = x * intrinsics.fDepthFocalX + intrinsics.fDepthPrincipalX;
+	float fv = intrinsics.fDepthPrincipalY - y * intrinsics.fDepthFocalY;
+	for (int ii = 0; ii < nProjectSteps; ii++)
+	{
+		// well off the image: no step brings it back
+		if (fu < -nWidth || fu > 2 * nWidth || fv < -nHeight || fv > 2 * nHeight)
+			return false;
+
+		int cu = (int)floorf(fu + 0.5f);
+		int cv = (int)floorf(fv + 0.5f);
+		cu = cu < 0 ? 0 : (cu >= nWidth ? nWidth - 1 : cu);
+		cv = cv < 0 ? 0 : (cv >= nHeight ? nHeight - 1 : cv);
+		const int idx = cv * nWidth + cu;
+		fu = cu + (x - pRayX[idx]) * intrinsics.fDepthFocalX;
+		fv = cv - (y - pRayY[idx]) * intrinsics.fDepthFocalY;
+	}
+
+	u = (int)floorf(fu + 0.5f);
+	v = (int)floorf(fv + 0.5f);
+	return u >= 0 && u < nWidth && v >= 0 && v < nHeight;
+}
+
+TsdfVolume::TsdfVolume() :
+fVoxelSize(0),
+fTruncation(0),
+nFrames(0),
+nAllocatedBlocks(0),
+nMaxBlocks(0),
+nBlocksX(0),
+nBlocksY(0),
+nBlocksZ(0),
+fOriginX(0),
+fOriginY(0),
+fOriginZ(0),
+pBlockTable(NULL),
+pVoxels(NULL),
+pBlockCoords(NULL),
+bPoolFull(false)
+{
+}
+
+TsdfVolume::~TsdfVolume()
+{
+	if (pBlockTable != NULL)	delete[] pBlockTable;
+	if (pBlockCoords != NULL)	delete[] pBlockCoords;
+	AlignedFree(pVoxels);
+}
+
+void TsdfVolume::Initialize(
+	float fVoxelSize,
+	int nBlocksX, int nBlocksY, int nBlocksZ,
+	float fOriginX, float fOriginY, float fOriginZ,
+	int nMaxBlocks)
+{
+	this->fVoxelSize = fVoxelSize;
+	this->fTruncation = fVoxelSize * 5;
+	this->nBlocksX = nBlocksX;
+	this->nBlocksY = nBlocksY;
+	this->nBlocksZ = nBlocksZ;
+	this->fOriginX = fOriginX;
+	this->fOriginY = fOriginY;
+	this->fOriginZ = fOriginZ;
+	this->nMaxBlocks = nMaxBlocks;
+
+	if (pBlockTable != NULL)	delete[] pBlockTable;
+	if (pBlockCoords != NULL)	delete[] pBlockCoords;
+	AlignedFree(pVoxels);
+
+	const int nTableSize = nBlocksX * nBlocksY * nBlocksZ;
+	pBlockTable = new int[nTableSize];
+	memset(pBlockTable, 0xff, sizeof(int)* nTableSize);
+	pBlockCoords = new int[nMaxBlocks * 3];
+	pVoxels = AlignedAllocArray<TsdfVoxel>((size_t)nMaxBlocks * nBlockVoxels);
+
+	sliceBlocks.assign(nBlocksZ, std::vector<int>());
+	nAllocatedBlocks = 0;
+	nFrames = 0;
+	bPoolFull = false;
+}
+
+void TsdfVolume::Reset()
+{
+	for (int ii = 0; ii < nAllocatedBlocks; ii++)
+	{
+		const int* pCoord = pBlockCoords + ii * 3;
+		pBlockTable[pCoord[0] + nBlocksX * (pCoord[1] + nBlocksY * pCoord[2])] = -1;
+	}
+	for (size_t ii = 0; ii < sliceBlocks.size(); ii++)
+		sliceBlocks[ii].clear();
+
+	nAllocatedBlocks = 0;
+	nFrames = 0;
+	bPoolFull = false;
+}
+
+int TsdfVolume::AllocateBlock(int bx, int by, int bz)
+{
+	int& iBlock = pBlockTable[bx + nBlocksX * (by + nBlocksY * bz)];
+	if (iBlock >= 0)
+		return iBlock;
+
+	if (nAllocatedBlocks == nMaxBlocks)
+	{
+		if (!bPoolFull)
+			printf("TSDF block pool is full (%d blocks)\n", nMaxBlocks);
+		bPoolFull = true;
+		return -1;
+	}
+
+	iBlock = nAllocatedBlocks++;
+	pBlockCoords[iBlock * 3] = bx;
+	pBlockCoords[iBlock * 3 + 1] = by;
+	pBlockCoords[iBlock * 3 + 2] = bz;
+	memset(pVoxels + (size_t)iBlock * nBlockVoxels, 0, sizeof(TsdfVoxel)* nBlockVoxels);
+	sliceBlocks[bz].push_back(iBlock);
+
+	return iBlock;
+}
+
+void TsdfVolume::AllocateAlongRay(float X, float Y, float Z)
+{
+	// the truncation band is narrower than a block, so its two ends and
+	// the surface itself cover every block it passes through
+	const float fInvBlockSize = 1.0f / (fVoxelSize * nBlockSide);
+	for (int ss = -1; ss <= 1; ss++)
+	{
+		const float fScale = (Z + ss * fTruncation) / Z;
+		const int bx = (int)floorf((X * fScale - fOriginX) * fInvBlockSize);
+		const int by = (int)floorf((Y * fScale - fOriginY) * fInvBlockSize);
+		const int bz = (int)floorf((Z * fScale - fOriginZ) * fInvBlockSize);
+		if (bx < 0 || by < 0 || bz < 0 || bx >= nBlocksX || by >= nBlocksY || bz >= nBlocksZ)
+			continue;
+		AllocateBlock(bx, by, bz);
+	}
+}
+
+void TsdfVolume::Integrate(
+	const UINT16* pDepth,
+	const unsigned int* pColor,
+	int nWidth, int nHeight,
+	const float* pRayX, const float* pRayY,
+	const SensorIntrinsics& intrinsics)
+{
+	if (pBlockTable == NULL)
+		return;
+
+	// blocks around every observed surface point
+	for (int ii = 0; ii < nWidth * nHeight; ii++)
+	{
+		if (pDepth[ii] == 0) continue;
+		const float Z = pDepth[ii] * 0.001f;
+		AllocateAlongRay(pRayX[ii] * Z, pRayY[ii] * Z, Z);
+	}
+
+	// project every voxel of the allocated blocks into the depth image
+	ParallelFor(nBlocksZ, [&](int nBegin, int nEnd)
+	{
+		const float fInvTruncation = 1.0f / fTruncation;
+		for (int bz = nBegin; bz < nEnd; bz++)
+		{
+			const std::vector<int>& blocks = sliceBlocks[bz];
+			for (size_t bb = 0; bb < blocks.size(); bb++)
+			{
+				const int iBlock = blocks[bb];
+				const int* pCoord = pBlockCoords + iBlock * 3;
+				TsdfVoxel* pBlock = pVoxels + (size_t)iBlock * nBlockVoxels;
+
+				for (int lz = 0; lz < nBlockSide; lz++)
+				{
+					const float Z = fOriginZ + (pCoord[2] * nBlockSide + lz + 0.5f) * fVoxelSize;
+					if (Z <= 0) continue;
+					const float fInvZ = 1.0f / Z;
+
+					for (int ly = 0; ly < nBlockSide; ly++)
+					{
+						const float Y = fOriginY + (pCoord[1] * nBlockSide + ly + 0.5f) * fVoxelSize;
+						TsdfVoxel* pVoxel = pBlock + nBlockSide * (ly + nBlockSide * lz);
+
+						for (int lx = 0; lx < nBlockSide; lx++, pVoxel++)
+						{
+							const float X = fOriginX + (pCoord[0] * nBlockSide + lx + 0.5f) * fVoxelSize;
+							// distortion couples u and v, so both are found per voxel
+							int u, v;
+							if (!ProjectToPixel(X * fInvZ, Y * fInvZ, pRayX, pRayY, nWidth, nHeight, intrinsics, u, v))
+								continue;
+							const UINT16 nDepth = pDepth[v * nWidth + u];
+							if (nDepth == 0) continue;
+
+							// projective distance along the optical axis
+							const float fDistance = nDepth * 0.001f - Z;
+							if (fDistance < -fTruncation) continue;
+							const float fTsdf = fDistance > fTruncation ? 1.0f : fDistance * fInvTruncation;
+
+							const int w = pVoxel->nWeight;
+							const float fOld = pVoxel->nDistance / fDistanceScale;
+							pVoxel->nDistance = (short)((fOld * w + fTsdf) / (w + 1) * fDistanceScale);
+
+							// 0: no color in view for this pixel
+							const unsigned int newColor = pColor != NULL ? pColor[v * nWidth + u] : 0;
+							if (newColor != 0)
+							{
+								const unsigned int oldColor = w > 0 ? pVoxel->color : newColor;
+								unsigned int mixed = 0xff000000;
+								for (int ch = 0; ch < 24; ch += 8)
+									mixed |= ((((oldColor >> ch) & 0xff) * w + ((newColor >> ch) & 0xff)) / (w + 1)) << ch;
+								pVoxel->color = mixed;
+							}
+
+							if (w < nMaxWeight) pVoxel->nWeight = (unsigned short)(w + 1);
+						}
+					}
+				}
+			}
+		}
+	});
+
+	nFrames++;
+}
+
+bool TsdfVolume::FindVoxel(int vx, int vy, int vz, const TsdfVoxel*& pVoxel) const
+{
+	if (vx < 0 || vy < 0 || vz < 0)
+		return false;
+
+	const int bx = vx / nBlockSide;
+	const int by = vy / nBlockSide;
+	const int bz = vz / nBlockSide;
+	if (bx >= nBlocksX || by >= nBlocksY || bz >= nBlocksZ)
+		return false;
+
+	const int iBlock = pBlockTable[bx + nBlocksX * (by + nBlocksY * bz)];
+	if (iBlock < 0)
+		return false;
+
+	const int lx = vx - bx * nBlockSide;
+	const int ly = vy - by * nBlockSide;
+	const int lz = vz - bz * nBlockSide;
+	pVoxel = pVoxels + (size_t)iBlock * nBlockVoxels + lx + nBlockSide * (ly + nBlockSide * lz);
+	return pVoxel->nWeight > 0;
+}
+
+int TsdfVolume::ExtractBlock(int iBlock, float* pX, float* pY, float* pZ, unsigned int* pColor) const
+{
+	static const int neighbours[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+
+	const int* pCoord = pBlockCoords + iBlock * 3;
+	const TsdfVoxel* pBlock = pVoxels + (size_t)iBlock * nBlockVoxels;
+	int nCount = 0;
+
+	for (int lz = 0; lz < nBlockSide; lz++)
+	for (int ly = 0; ly < nBlockSide; ly++)
+	for (int lx = 0; lx < nBlockSide; lx++)
+	{
+		const TsdfVoxel& a = pBlock[lx + nBlockSide * (ly + nBlockSide * lz)];
+		if (a.nWeight == 0) continue;
+
+		const int vx = pCoord[0] * nBlockSide + lx;
+		const int vy = pCoord[1] * nBlockSide + ly;
+		const int vz = pCoord[2] * nBlockSide + lz;
+
+		for (int nn = 0; nn < 3; nn++)
+		{
+			const TsdfVoxel* pB;
+			if (!FindVoxel(vx + neighbours[nn][0], vy + neighbours[nn][1], vz + neighbours[nn][2], pB))
+				continue;
+
+			const int da = a.nDistance;
+			const int db = pB->nDistance;
+			if ((da >= 0) == (db >= 0)) continue;
+			if (abs(da) >= nTruncatedDistance && abs(db) >= nTruncatedDistance) continue;
+
+			const float t = (float)da / (float)(da - db);
+			pX[nCount] = fOriginX + (vx + 0.5f + t * neighbours[nn][0]) * fVoxelSize;
+			pY[nCount] = fOriginY + (vy + 0.5f + t * neighbours[nn][1]) * fVoxelSize;
+			pZ[nCount] = fOriginZ + (vz + 0.5f + t * neighbours[nn][2]) * fVoxelSize;
+			pColor[nCount] = t < 0.5f ? a.color : pB->color;
+			nCount++;
+		}
+	}
+
+	return nCount;
+}
+
+void TsdfVolume::ExtractSurface(PointList& out)
+{
+	for (;;)
+	{
+		std::atomic<int> nCount(0);
+
+		ParallelFor(nBlocksZ, [&](int nBegin, int nEnd)
+		{
+			// at most 3 crossings per voxel
+			float pX[nBlockVoxels * 3];
+			float pY[nBlockVoxels * 3];
+			float pZ[nBlockVoxels * 3];
+			unsigned int pColor[nBlockVoxels * 3];
+
+			for (int bz = nBegin; bz < nEnd; bz++)
+			{
+				const std::vector<int>& blocks = sliceBlocks[bz];
+				for (size_t bb = 0; bb < blocks.size(); bb++)
+				{
+					const int nBlockCount = ExtractBlock(blocks[bb], pX, pY, pZ, pColor);
+					if (nBlockCount == 0) continue;
+
+					const int nOffset = nCount.fetch_add(nBlockCount);
+					if (nOffset + nBlockCount > out.nCapacity) continue;
+
+					memcpy(out.pX + nOffset, pX, sizeof(float)* nBlockCount);
+					memcpy(out.pY + nOffset, pY, sizeof(float)* nBlockCount);
+					memcpy(out.pZ + nOffset, pZ, sizeof(float)* nBlockCount);
+					memcpy(out.pColor + nOffset, pColor, sizeof(unsigned int)* nBlockCount);
+					for (int ii = 0; ii < nBlockCount; ii++)
+						out.pIndex[nOffset + ii] = -1;
+				}
+			}
+		});
+
+		if (nCount <= out.nCapacity)
+		{
+			out.nCount = nCount;
+			return;
+		}
+
+		// grow with some headroom and extract again
+		out.Allocate(nCount + nCount / 2);
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+#include "KinectCompat.h"
+#include "SoftwareMapper.h"
+#include "PointCloud.h"
+
+// one voxel of the truncated signed distance field
+struct TsdfVoxel
+{
+	short nDistance;			// distance / truncation, scaled to +/-32767
+	unsigned short nWeight;		// 0 = never observed
+	unsigned int color;			// running mean, packed RGBA
+};
+
+// Truncated signed distance volume for fusing depth frames of a static
+// scene (KinectFusion style, camera fixed at the volume frame).
+// The volume is a fixed grid of 8x8x8-voxel blocks, but blocks are only
+// taken from a bounded pool where depth was observed, so memory stays at
+// nMaxBlocks no matter how long we scan. Integration and surface
+// extraction run over z-slices of blocks in parallel.
+class TsdfVolume
+{
+public:
+	static const int nBlockSide = 8;
+	static const int nBlockVoxels = nBlockSide * nBlockSide * nBlockSide;
+
+	TsdfVolume();
+	~TsdfVolume();
+
+	// fVoxelSize [m]; the volume spans nBlocks* * 8 voxels starting at
+	// (fOriginX, fOriginY, fOriginZ) in camera space
+	void Initialize(
+		float fVoxelSize,
+		int nBlocksX, int nBlocksY, int nBlocksZ,
+		float fOriginX, float fOriginY, float fOriginZ,
+		int nMaxBlocks);
+	void Reset();
+
+	// pDepth [mm], pColor one packed RGBA per depth pixel (may be NULL);
+	// rays back-project depth pixels and, inverted, project voxels, so both
+	// follow the same lens model; intrinsics only seed the inversion
+	void Integrate(
+		const UINT16* pDepth,
+		const unsigned int* pColor,
+		int nWidth, int nHeight,
+		const float* pRayX, const float* pRayY,
+		const SensorIntrinsics& intrinsics);
+
+	// zero crossings between neighbouring voxels, interpolated;
+	// out grows as needed and its pIndex entries are -1 (no pixel)
+	void ExtractSurface(PointList& out);
+
+	float fVoxelSize;
+	float fTruncation;
+	int nFrames;
+
+	int nAllocatedBlocks;
+	int nMaxBlocks;
+
+private:
+	int AllocateBlock(int bx, int by, int bz);
+	void AllocateAlongRay(float X, float Y, float Z);
+	bool FindVoxel(int vx, int vy, int vz, const TsdfVoxel*& pVoxel) const;
+	int ExtractBlock(int iBlock, float* pX, float* pY, float* pZ, unsigned int* pColor) const;
+
+	TsdfVolume(const TsdfVolume&);
+	TsdfVolume& operator=(const TsdfVolume&);
+
+	int nBlocksX;
+	int nBlocksY;
+	int nBlocksZ;
+	float fOriginX;
+	float fOriginY;
+	float fOriginZ;
+
+	// grid of block indices into the pool (-1 = not allocated)
+	int* pBlockTable;
+
+	// pool of blocks, their grid coordinates, and the blocks of each z-slice
+	TsdfVoxel* pVoxels;
+	int* pBlockCoords;
+	std::vector<std::vector<int> > sliceBlocks;
+	bool bPoolFull;
+};
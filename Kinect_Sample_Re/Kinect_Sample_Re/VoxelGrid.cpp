@@ -0,0 +1,162 @@
+#include <string.h>
+#include <math.h>
+#include "VoxelGrid.h"
+#include "AlignedMemory.h"
+
+// 21 bits per axis: +/-1M voxels, i.e. +/-1 km at the 1 mm minimum leaf
+static const float fMinLeafSize = 0.001f;
+static const int nAxisBits = 21;
+static const int nAxisOffset = 1 << (nAxisBits - 1);
+static const unsigned long long nAxisMask = (1ULL << nAxisBits) - 1;
+
+static inline unsigned long long VoxelKey(int ix, int iy, int iz)
+{
+	return ((unsigned long long)(ix + nAxisOffset) & nAxisMask) |
+		(((unsigned long long)(iy + nAxisOffset) & nAxisMask) << nAxisBits) |
+		(((unsigned long long)(iz + nAxisOffset) & nAxisMask) << (2 * nAxisBits));
+}
+
+VoxelGrid::VoxelGrid() :
+nVoxels(0),
+nTableSize(0),
+nTableBits(0),
+pSlotVoxel(NULL),
+pSlotKey(NULL),
+nCapacity(0),
+pVoxelSlot(NULL),
+pVoxelCount(NULL),
+pVoxelIndex(NULL),
+pSumX(NULL),
+pSumY(NULL),
+pSumZ(NULL),
+pSumR(NULL),
+pSumG(NULL),
+pSumB(NULL)
+{
+}
+
+VoxelGrid::~VoxelGrid()
+{
+	AlignedFree(pSlotVoxel);
+	AlignedFree(pSlotKey);
+	AlignedFree(pVoxelSlot);
+	AlignedFree(pVoxelCount);
+	AlignedFree(pVoxelIndex);
+	AlignedFree(pSumX);
+	AlignedFree(pSumY);
+	AlignedFree(pSumZ);
+	AlignedFree(pSumR);
+	AlignedFree(pSumG);
+	AlignedFree(pSumB);
+}
+
+void VoxelGrid::Reserve(int nPoints)
+{
+	if (nPoints <= nCapacity)
+		return;
+
+	AlignedFree(pSlotVoxel);
+	AlignedFree(pSlotKey);
+	AlignedFree(pVoxelSlot);
+	AlignedFree(pVoxelCount);
+	AlignedFree(pVoxelIndex);
+	AlignedFree(pSumX);
+	AlignedFree(pSumY);
+	AlignedFree(pSumZ);
+	AlignedFree(pSumR);
+	AlignedFree(pSumG);
+	AlignedFree(pSumB);
+
+	nCapacity = nPoints;
+	pVoxelSlot = AlignedAllocArray<int>(nCapacity);
+	pVoxelCount = AlignedAllocArray<int>(nCapacity);
+	pVoxelIndex = AlignedAllocArray<int>(nCapacity);
+	pSumX = AlignedAllocArray<float>(nCapacity);
+	pSumY = AlignedAllocArray<float>(nCapacity);
+	pSumZ = AlignedAllocArray<float>(nCapacity);
+	pSumR = AlignedAllocArray<unsigned int>(nCapacity);
+	pSumG = AlignedAllocArray<unsigned int>(nCapacity);
+	pSumB = AlignedAllocArray<unsigned int>(nCapacity);
+
+	// keep the load factor at or below 1/2
+	nTableBits = 1;
+	while ((1 << nTableBits) < 2 * nCapacity)
+		nTableBits++;
+	nTableSize = 1 << nTableBits;
+	pSlotVoxel = AlignedAllocArray<int>(nTableSize);
+	pSlotKey = AlignedAllocArray<unsigned long long>(nTableSize);
+	memset(pSlotVoxel, 0xff, sizeof(int)* nTableSize);
+}
+
+void VoxelGrid::Downsample(const PointList& in, float fLeafSize, PointList& out)
+{
+	// with headroom, as the count changes a little from frame to frame
+	if (nCapacity < in.nCount)
+		Reserve(in.nCount + in.nCount / 2);
+	if (out.nCapacity < in.nCount)
+		out.Allocate(in.nCount + in.nCount / 2);
+
+	if (fLeafSize < fMinLeafSize) fLeafSize = fMinLeafSize;
+	const float fInvLeafSize = 1.0f / fLeafSize;
+	const unsigned int nSlotMask = (unsigned int)nTableSize - 1;
+	const int nShift = 64 - nTableBits;
+
+	nVoxels = 0;
+	for (int ii = 0; ii < in.nCount; ii++)
+	{
+		const unsigned long long key = VoxelKey(
+			(int)floorf(in.pX[ii] * fInvLeafSize),
+			(int)floorf(in.pY[ii] * fInvLeafSize),
+			(int)floorf(in.pZ[ii] * fInvLeafSize));
+
+		// Fibonacci hashing, linear probing
+		unsigned int nSlot = (unsigned int)((key * 0x9E3779B97F4A7C15ULL) >> nShift);
+		int iVoxel;
+		for (;;)
+		{
+			iVoxel = pSlotVoxel[nSlot];
+			if (iVoxel < 0)
+			{
+				iVoxel = nVoxels++;
+				pSlotVoxel[nSlot] = iVoxel;
+				pSlotKey[nSlot] = key;
+				pVoxelSlot[iVoxel] = nSlot;
+				pVoxelCount[iVoxel] = 0;
+				pVoxelIndex[iVoxel] = in.pIndex[ii];
+				pSumX[iVoxel] = pSumY[iVoxel] = pSumZ[iVoxel] = 0;
+				pSumR[iVoxel] = pSumG[iVoxel] = pSumB[iVoxel] = 0;
+				break;
+			}
+			if (pSlotKey[nSlot] == key)
+				break;
+			nSlot = (nSlot + 1) & nSlotMask;
+		}
+
+		const unsigned int color = in.pColor[ii];
+		pVoxelCount[iVoxel]++;
+		pSumX[iVoxel] += in.pX[ii];
+		pSumY[iVoxel] += in.pY[ii];
+		pSumZ[iVoxel] += in.pZ[ii];
+		pSumR[iVoxel] += color & 0xff;
+		pSumG[iVoxel] += (color >> 8) & 0xff;
+		pSumB[iVoxel] += (color >> 16) & 0xff;
+	}
+
+	// write the means and empty the used slots for the next frame
+	for (int vv = 0; vv < nVoxels; vv++)
+	{
+		const unsigned int nCount = pVoxelCount[vv];
+		const float fInvCount = 1.0f / nCount;
+		out.pX[vv] = pSumX[vv] * fInvCount;
+		out.pY[vv] = pSumY[vv] * fInvCount;
+		out.pZ[vv] = pSumZ[vv] * fInvCount;
+		out.pColor[vv] = 0xff000000 |
+			((pSumB[vv] / nCount) << 16) |
+			((pSumG[vv] / nCount) << 8) |
+			(pSumR[vv] / nCount);
+		out.pIndex[vv] = pVoxelIndex[vv];
+
+		pSlotVoxel[pVoxelSlot[vv]] = -1;
+	}
+	out.nCount = nVoxels;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "PointCloud.h"
+
+// Voxel grid downsampling: every occupied cube of fLeafSize [m] becomes one
+// point at the mean position and mean color of the points inside it.
+// Voxels are found through an open-addressing hash on the quantized
+// coordinates; the table and the accumulators only grow, and only the slots
+// used by the previous frame are cleared, so a frame costs O(points).
+class VoxelGrid
+{
+public:
+	VoxelGrid();
+	~VoxelGrid();
+
+	// out.pIndex gets the pixel of the first point that fell into each voxel
+	void Downsample(const PointList& in, float fLeafSize, PointList& out);
+
+	int nVoxels;
+
+private:
+	void Reserve(int nPoints);
+
+	VoxelGrid(const VoxelGrid&);
+	VoxelGrid& operator=(const VoxelGrid&);
+
+	// hash table: voxel id per slot (-1 = empty), and its key
+	int nTableSize;
+	int nTableBits;
+	int* pSlotVoxel;
+	unsigned long long* pSlotKey;
+
+	// per-voxel accumulators
+	int nCapacity;
+	int* pVoxelSlot;
+	int* pVoxelCount;
+	int* pVoxelIndex;
+	float* pSumX;
+	float* pSumY;
+	float* pSumZ;
+	unsigned int* pSumR;
+	unsigned int* pSumG;
+	unsigned int* pSumB;
+};